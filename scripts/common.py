@@ -1,21 +1,88 @@
-import sys, builtins
+import sys, builtins, json
 
-def question(data):
-  """Send and receive from parent process"""
+try:
+  import msgpack
+except ImportError:
+  msgpack = None
+
+# where we talk to parent, stdin/stdout unless run by worker.py
+_in = sys.stdin.buffer
+_out = sys.stdout.buffer
+
+def connect(inStream, outStream):
+  """Talk to parent through these binary streams instead"""
+  global _in, _out
+  _in, _out = inStream, outStream
+
+def _write(data):
   if isinstance(data, str):
     data = data.encode('utf8')
   sz = len(data)
-  sys.stdout.buffer.write(sz.to_bytes(4, 'big'))
-  sys.stdout.buffer.write(data)
-  sys.stdout.buffer.flush()
-  #print(f"sent {sz} bytes to parent, starting to read from input\n")
+  _out.write(sz.to_bytes(4, 'big'))
+  _out.write(data)
+  _out.flush()
 
+def _read():
   # read size bigendian
-  buf = sys.stdin.buffer.read(4)
-  #print(f"reading {buf} from input\n")
+  buf = _in.read(4)
+  if len(buf) < 4:
+    raise SystemExit("Lost connection to parent")
   sz = int.from_bytes(buf, 'big')
-  #print(f"reading {sz} bytes from input\n")
-  return sys.stdin.buffer.read(sz)
+  return _in.read(sz)
+
+def question(data):
+  """Send and receive from parent process"""
+  _write(data)
+  return _read()
+
+_useBinary = None
+
+def _binary():
+  global _useBinary
+  if _useBinary is None:
+    _useBinary = False
+    if msgpack is not None:
+      res = json.loads(question(json.dumps(["binary_encoding"])))
+      _useBinary = res.get("binary_encoding") == "msgpack"
+  return _useBinary
+
+def _encode(cmd):
+  return msgpack.packb(cmd) if _binary() else json.dumps(cmd)
+
+def _decode(data):
+  return msgpack.unpackb(data) if _binary() else json.loads(data)
+
+def request(cmd):
+  """Send a json request (dict or list) to parent, returns the decoded answer.
+  Uses the binary msgpack encoding when both sides supports it,
+  much cheaper for large requests such as fixup_binaries."""
+  return _decode(question(_encode(cmd)))
+
+_nextId = 0
+_answers = {}
+
+def send(cmd):
+  """Send a request (dict) without waiting for the answer, returns its id.
+  Parent answers these out of order, fixup_binaries runs concurrently."""
+  global _nextId
+  _nextId += 1
+  cmd = dict(cmd)
+  cmd["id"] = _nextId
+  _write(_encode(cmd))
+  return _nextId
+
+def receive(reqId):
+  """Wait for the answer to a request from send(),
+  answers to other requests that arrives meanwhile are kept."""
+  while reqId not in _answers:
+    res = _decode(_read())
+    _answers[res.pop("id")] = res
+  return _answers.pop(reqId)
+
+def requestAll(cmds):
+  """Pipeline all cmds, returns their answers in the same order"""
+  ids = [send(cmd) for cmd in cmds]
+  return [receive(reqId) for reqId in ids]
 
 def print(*args, **kwargs):
   """Print to stderr"""
@@ -31,7 +31,7 @@ but parent process dylibbundler might still have some porting
 issues to fix. as of 2024-06-30
 """
 
-from common import question, print
+from common import question, request, requestAll, print
 from os import path, makedirs, listdir, environ, symlink
 from collections import OrderedDict
 import json, shutil, re, sys, os
@@ -303,17 +303,22 @@ class DeployQt():
 
   def postProcess(self)->bool:
     cmd = {"add_search_paths": self.searchPaths()}
-    res = json.loads(question(json.dumps(cmd)))
+    res = request(cmd)
     if "error" in res and res['error']:
       print("Failed to set search paths to parent process, error "
             f"{res['error']}")
       return False
 
-    cmd = {"fixup_binaries": DeployQt.dylibs}
-    res = json.loads(question(json.dumps(cmd)))
-    if "error" in res and res['error']:
-      print(f"*Failed to run strip on {dst}, error:{res['error']}")
-      return False
+    # pipeline in chunks, parent fixes them concurrently
+    chunk = 16
+    libs = DeployQt.dylibs
+    cmds = [{"fixup_binaries": libs[i:i+chunk]}
+            for i in range(0, len(libs), chunk)]
+    for cmd, res in zip(cmds, requestAll(cmds)):
+      res = res.get("fixup_binaries", res)
+      if "error" in res and res['error']:
+        print(f"*Failed to fixup {cmd['fixup_binaries']}, error:{res['error']}")
+        return False
     return True
 
   def createQtConf(self)->None:
@@ -0,0 +1,105 @@
+"""Long lived script worker, keeps python and the imports of the
+scripts warm between bundler runs, ie. in CI.
+
+  python3 worker.py /tmp/dylibbundler.sock [scripts to preload ...]
+  dylibbundler --script-worker=/tmp/dylibbundler.sock ...
+
+Each connection from the bundler is a session. It starts with
+{"run": path, "args": [...]}, after that the script talks to the bundler
+through common.question/request just as when started by it. The session
+ends with {"exit_status": code}. Each session runs in a forked child of
+the worker, so sessions can't disturb each other. Output from the
+scripts ends up on the workers stderr.
+"""
+import sys, os, stat, socket, json, runpy, signal, traceback
+import common
+
+def session(conn):
+  common.connect(conn.makefile('rb'), conn.makefile('wb'))
+  req = json.loads(common._read())
+  script = req["run"]
+  sys.argv = [script] + req.get("args", [])
+  sys.path.insert(0, os.path.dirname(script))
+
+  status = 0
+  try:
+    runpy.run_path(script, run_name="__main__")
+  except SystemExit as e:
+    if e.code is None or isinstance(e.code, int):
+      status = e.code or 0
+    else:
+      common.print(e.code)
+      status = 1
+  except Exception:
+    traceback.print_exc()
+    status = 1
+
+  try:
+    common._write(json.dumps({"exit_status": status}))
+  except OSError:
+    pass # bundler gave up on us, ie. timeout
+  os._exit(0)
+
+def preload(scripts):
+  """Run top level of scripts once, imports they do stays cached"""
+  for script in scripts:
+    try:
+      sys.path.insert(0, os.path.dirname(os.path.abspath(script)))
+      runpy.run_path(script, run_name="__worker__")
+    except BaseException as e:
+      common.print(f"*Failed to preload {script}: {e}")
+
+def removeStale(sockPath):
+  """Unlink sockPath if a crashed worker left it, False if it is in use
+  or not a socket at all"""
+  try:
+    if not stat.S_ISSOCK(os.lstat(sockPath).st_mode):
+      return False
+  except FileNotFoundError:
+    return True
+  probe = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  try:
+    probe.connect(sockPath)
+    return False # another worker answers there
+  except (ConnectionRefusedError, FileNotFoundError):
+    pass
+  finally:
+    probe.close()
+  os.unlink(sockPath)
+  return True
+
+def main():
+  if len(sys.argv) < 2:
+    common.print(__doc__)
+    exit(1)
+
+  sockPath = sys.argv[1]
+  if not removeStale(sockPath):
+    common.print(f"*{sockPath} is in use or not a socket, not replacing it")
+    exit(1)
+  server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  # a session runs any script it is given, only let our user connect
+  oldMask = os.umask(0o077)
+  try:
+    server.bind(sockPath)
+  finally:
+    os.umask(oldMask)
+  server.listen(16)
+  # sessions are reaped automatically
+  signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+
+  preload(sys.argv[2:])
+  common.print(f"* Script worker listening on {sockPath}")
+
+  while True:
+    conn, _ = server.accept()
+    if os.fork() == 0:
+      # scripts wait for their own subprocesses, exit statuses are lost
+      # with SIGCHLD ignored
+      signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+      server.close()
+      session(conn)
+    conn.close()
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,147 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+// this lib should not depend on anything in any other lib
+// except libc++
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include "ThreadPool.h"
+
+namespace {
+
+unsigned sharedSize = 0;
+
+} // namespace
+
+
+ThreadPool::ThreadPool(unsigned threads):
+  m_stop{false}
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  m_workers.reserve(threads);
+  for (unsigned i = 0; i < threads; ++i)
+    m_workers.emplace_back([this]{ workerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_stop = true;
+  }
+  m_cond.notify_all();
+  for (auto& worker : m_workers)
+    worker.join();
+}
+
+void
+ThreadPool::push(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_jobs.emplace_back(std::move(job));
+  }
+  m_cond.notify_one();
+}
+
+void
+ThreadPool::workerLoop()
+{
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock{m_mutex};
+      m_cond.wait(lock, [this]{ return m_stop || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        return; // stopped and drained
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void
+ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if (count == 0) return;
+
+  // shared with the helpers, a helper might not get scheduled
+  // until after we have returned
+  struct State {
+    std::atomic<size_t> next{0};
+    size_t done = 0;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable cond;
+  };
+  auto state = std::make_shared<State>();
+
+  auto work = [state, count, &fn]() {
+    for (size_t i; (i = state->next++) < count;) {
+      std::exception_ptr err;
+      try {
+        fn(i);
+      } catch (...) {
+        err = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock{state->mutex};
+      if (err && !state->error)
+        state->error = err;
+      if (++state->done == count)
+        state->cond.notify_all();
+    }
+  };
+
+  // fn is only referenced while an index is still unclaimed,
+  // and we don't return before all indexes are done
+  auto helpers = std::min(count - 1, m_workers.size());
+  for (size_t i = 0; i < helpers; ++i)
+    push(work);
+  work();
+
+  std::unique_lock<std::mutex> lock{state->mutex};
+  state->cond.wait(lock, [&]{ return state->done == count; });
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+// static
+ThreadPool&
+ThreadPool::shared()
+{
+  // never destroyed, exit() might be called from one of its workers
+  static ThreadPool* pool = new ThreadPool{sharedSize};
+  return *pool;
+}
+
+// static
+void
+ThreadPool::setSharedSize(unsigned threads)
+{
+  sharedSize = threads;
+}
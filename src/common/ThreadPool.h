@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// this lib should not depend on anything in any other lib
+// except libc++
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/// A fixed size pool of worker threads fed from a FIFO queue
+class ThreadPool
+{
+public:
+  /// @brief Starts the workers
+  /// @param threads Number of workers, 0 means one per hardware thread
+  explicit ThreadPool(unsigned threads = 0);
+  /// Finishes all queued work, then joins the workers
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// @brief Queue fn to be run on a worker
+  /// @return A future to the result, exceptions are rethrown on get()
+  template<typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& fn)
+  {
+    using R = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(
+      std::forward<F>(fn));
+    auto fut = task->get_future();
+    push([task]{ (*task)(); });
+    return fut;
+  }
+
+  /// @brief Run fn(0) ... fn(count-1) in parallel and wait for all of them
+  /// The calling thread takes part in the work, so it is safe to call
+  /// from within a task already running on this pool.
+  /// Rethrows the first exception thrown by fn, once all are done.
+  void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  /// Number of worker threads
+  size_t size() const { return m_workers.size(); }
+
+  /// The pool shared by the whole process
+  static ThreadPool& shared();
+  /// @brief Set the number of workers for the shared pool
+  /// Must be called before the first call to shared(), 0 means auto
+  static void setSharedSize(unsigned threads);
+
+private:
+  void push(std::function<void()> job);
+  void workerLoop();
+
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_stop;
+};
+
+#endif // THREADPOOL_H
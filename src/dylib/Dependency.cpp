@@ -44,63 +44,31 @@ THE SOFTWARE.
 
 namespace fs = std::filesystem;
 
-void cleanupFramwork(
-    const fs::path frameworkPath,
-    std::vector<std::string> keep
-) {
-    std::error_code err;
-    keep.push_back("Versions");
-    keep.push_back("Resources");
-    keep.push_back("Libraries");
-    keep.push_back("Helpers");
-
-    auto clean = [&err](fs::path path, std::vector<std::string>&keep) {
-        for (auto& entry : fs::directory_iterator(path)) {
-            if (std::find(keep.begin(), keep.end(), entry.path().filename()) != keep.end())
-                continue; // keep this path
-
-            fs::remove_all(entry, err);
-            if (err) std::cerr << "Error occurred when cleaning up Framework "
-                               << path << "\n error: " << err.message()
-                               << std::endl;
-        }
-    };
-
-    // cleanup inside Versions
-    std::vector<std::string> k{"Current"};
-    auto curPath = frameworkPath / "Versions" / "Current";
-    if (fs::is_symlink(curPath, err))
-        k.push_back(fs::read_symlink(curPath).string());
-    clean(frameworkPath / "Versions", k);
-    // inside the current versions dir
-    clean(frameworkPath / "Versions" / k.back(), keep);
-
-    // cleanup root
-    clean(frameworkPath, keep);
-}
-
 Dependency::Dependency(
     PathRef path, PathRef dependent_file,
     bool isExecutable
 ) :
     m_original_file{path}, m_canonical_file{},
+    m_original_id{PathTable::shared().intern(path)}, m_canonical_id{},
     m_prefix{}, m_symlinks{},
-    m_framework(path.before(".framework") != path),
+    m_framework(PathTable::shared().contains(m_original_id, ".framework")),
     m_executable{isExecutable},
-    m_missing_prefixes{false}
+    m_missing_prefixes{false},
+    m_unresolved{false}
 {
     std::error_code err;
+    auto& table = PathTable::shared();
     if (DylibBundler::isRpath(path)) {
-        m_canonical_file = DylibBundler::instance()->
-            searchFilenameInRPaths(path, dependent_file);
+        setCanonical(DylibBundler::instance()->
+            searchFilenameInRPaths(path, dependent_file));
     } else {
         if (fs::is_symlink(path, err)) {
-            m_canonical_file = fs::read_symlink(path, err);
+            setCanonical(fs::read_symlink(path, err));
         } else if (err) {
-            m_canonical_file = fs::canonical(m_original_file, err);
-            if (err) m_canonical_file = path;
+            m_canonical_id = table.canonical(m_original_id);
+            m_canonical_file = table.path(m_canonical_id);
         } else {
-            m_canonical_file = m_original_file; // no idea what it is?
+            setCanonical(m_original_file); // no idea what it is?
         }
     }
 
@@ -108,7 +76,7 @@ Dependency::Dependency(
         addSymlink(path);
 
     m_prefix = m_framework
-                ? m_canonical_file.before(".framework")
+                ? Path(std::string(table.before(m_canonical_id, ".framework")))
                 : m_canonical_file.parent_path();
 
     // check if this dependency is in /usr/lib, /System/Library, or in ignored list
@@ -154,8 +122,10 @@ Dependency::findPrefix(PathRef path, PathRef dependent_file) {
             if (fs::exists(path))
             {
                 if (fs::is_symlink(path)) {
-                    m_canonical_file = (fs::canonical(fs::path(search_path) /
-                        fs::read_symlink(path))).string();
+                    setCanonical(fs::canonical(fs::path(search_path) /
+                        fs::read_symlink(path)));
+                } else if (!fs::exists(m_canonical_file)) {
+                    setCanonical(path); // its install name is relative
                 }
 
                 if (Settings::verbose())
@@ -174,12 +144,19 @@ Dependency::findPrefix(PathRef path, PathRef dependent_file) {
         (m_prefix.empty() ||
          !fs::exists(m_prefix / getCanonical().filename())))
     {
-        std::cerr << "\n/!\\ WARNING : Library " << canonical_name
-                  << " has an incomplete name (location unknown)" << std::endl;
+        if (Settings::shouldAskUser())
+            std::cerr << "\n/!\\ WARNING : Library " << canonical_name
+                      << " has an incomplete name (location unknown)" << std::endl;
         m_missing_prefixes = true;
 
         while (true) {
             auto dir = getUserInputDirForFile(canonical_name);
+            if (dir.empty()) {
+                // may not ask, reported together with the others
+                m_unresolved = true;
+                DylibBundler::instance()->addUnresolved(path, dependent_file);
+                return true;
+            }
             if (fs::exists(dir) && fs::is_directory(dir)) {
                 Settings::addSearchPath(dir);
                 return findPrefix(path, dependent_file);
@@ -190,8 +167,8 @@ Dependency::findPrefix(PathRef path, PathRef dependent_file) {
     }
 
     if (m_framework)
-        return fs::exists(Path(m_prefix) /
-            m_canonical_file.after(".framework"));
+        return fs::exists(Path(m_prefix) / PathTable::shared().after(
+            m_canonical_id, ".framework"));
 
     return fs::exists(fs::path(m_prefix) / getCanonical());
 }
@@ -213,21 +190,18 @@ std::string
 Dependency::getFrameworkName() const
 {
     if (!m_framework) return "";
-    auto frmDir = m_original_file.upto(".framework")
-                                 .filename().string();
-    return frmDir.substr(0, frmDir.size()-10);
+    auto& table = PathTable::shared();
+    auto frmDir = table.component(
+        m_original_id, table.find(m_original_id, ".framework"));
+    return std::string(frmDir.substr(0, frmDir.size()-10));
 }
 
 bool
 Dependency::isInAppBundle() const
 {
-    std::string orig = m_original_file.string(),
-                cont = Settings::appBundleContentsDir().string();
-
-    if (orig.size() > cont.size())
-        return orig.substr(0, cont.size()) == cont;
-
-    return false;
+    auto cont = Settings::appBundleContentsDir().string();
+    return m_original_file.native().size() > cont.size() &&
+           PathTable::shared().startsWith(m_original_id, cont);
 }
 
 Path
@@ -239,7 +213,8 @@ Dependency::getInstallPath() const
         auto path = Settings::frameworkDir()
                   / getFrameworkName()
                   + ".framework"
-                  / m_canonical_file.after(".framework");
+                  / Path(std::string(PathTable::shared().after(
+                        m_canonical_id, ".framework")));
         return path;
     } else if (m_executable)
         return Settings::appBundleExecDir() / getCanonical().filename();
@@ -251,13 +226,20 @@ Dependency::getInnerPath() const
 {
     if (m_framework) {
         auto path = Settings::inside_framework_path()
-                  / m_canonical_file.from(".framework");
+                  / PathTable::shared().from(m_canonical_id, ".framework");
         return path;
     }
     return Settings::inside_lib_path() / getCanonical().filename();
 }
 
 
+void
+Dependency::setCanonical(PathRef path)
+{
+    m_canonical_file = path;
+    m_canonical_id = PathTable::shared().intern(path);
+}
+
 void
 Dependency::addSymlink(PathRef link)
 {
@@ -272,7 +254,7 @@ Dependency::addSymlink(PathRef link)
 bool
 Dependency::mergeIfSameAs(Dependency& dep2)
 {
-    if(dep2.getCanonical() == getCanonical()) {
+    if(dep2.m_canonical_id == m_canonical_id) {
         for(auto& link : m_symlinks) {
             dep2.addSymlink(link);
         }
@@ -288,7 +270,8 @@ Dependency::copyMyself() const
     std::stringstream ss;
     Path from, to;
     if (m_framework) {
-        from = getCanonical().upto(".framework");
+        from = std::string(
+            PathTable::shared().upto(m_canonical_id, ".framework"));
         to = Settings::frameworkDir()
            / getFrameworkName()
            + ".framework";
@@ -309,46 +292,43 @@ Dependency::copyMyself() const
     if (!fs::exists(to, err))
         createFolder(to);
 
-    auto copyOptions = fs::copy_options::update_existing
-                     | fs::copy_options::recursive
-                     | fs::copy_options::copy_symlinks;
-    fs::copy(from, to, copyOptions, err);
-    if (err) {
-        ss << "\nFailed to copy " << from << " to: " << to
-           << ", error: " << err.message() << "\n";
-        exitMsg(ss.str());
-    }
-
-    if (m_framework)
-        cleanupFramwork(to,
+    if (m_framework) {
+        copyFramework(from, to,
             std::vector<std::string>{getCanonical().filename().string()});
+    } else {
+        auto copyOptions = fs::copy_options::update_existing
+                         | fs::copy_options::recursive
+                         | fs::copy_options::copy_symlinks;
+        fs::copy(from, to, copyOptions, err);
+        if (err) {
+            ss << "\nFailed to copy " << from << " to: " << to
+               << ", error: " << err.message() << "\n";
+            exitMsg(ss.str());
+        }
+    }
 
     // Fix the lib's inner name
     Tools::InstallName installTool;
     installTool.id(getInnerPath(), getInstallPath());
 }
 
+std::vector<std::pair<Path, Path>>
+Dependency::nameChanges() const
+{
+    // for main lib file and its symlinks
+    std::vector<std::pair<Path, Path>> changes;
+    changes.emplace_back(m_original_file, getInnerPath());
+    for(const auto& link : m_symlinks)
+        changes.emplace_back(link, getInnerPath());
+    return changes;
+}
+
 void
 Dependency::fixFileThatDependsOnMe(PathRef file) const
 {
-    // for main lib file
     Tools::InstallName installTool;
-    installTool.change(m_original_file, getInnerPath(), file);
-    // for symlinks
-    for(const auto& link : m_symlinks) {
-        installTool.change(link, getInnerPath(), file);
-    }
-
-    // FIXME - hackish
-    if(m_missing_prefixes)
-    {
-        // for main lib file
-        installTool.change(m_original_file, getInnerPath(), file);
-        // for symlinks
-        for(const auto& link : m_symlinks) {
-            installTool.change(link, getInnerPath(), file);
-        }
-    }
+    for (const auto& [from, to] : nameChanges())
+        installTool.change(from, to, file);
 }
 
 Json::VluType
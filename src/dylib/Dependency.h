@@ -32,6 +32,7 @@ THE SOFTWARE.
 #include <filesystem>
 #include "Json.h"
 #include "Types.h"
+#include "PathTable.h"
 
 class Dependency
 {
@@ -48,6 +49,8 @@ public:
     std::string getFrameworkName() const;
     bool isFramework() const { return m_framework; }
     bool isExecutable() const { return m_executable; }
+    /// not found and the user may not be asked, never bundled
+    bool isUnresolved() const { return m_unresolved; }
 
     const std::vector<Path>& getSymlinks() const {
         return m_symlinks;
@@ -55,6 +58,8 @@ public:
     PathRef getPrefix() const{ return m_prefix; }
 
     void copyMyself() const;
+    /// the install names a file loads me by, to what they should become
+    std::vector<std::pair<Path, Path>> nameChanges() const;
     void fixFileThatDependsOnMe(PathRef file) const;
 
     // Compares the given dependency with this one. If both refer to the same file,
@@ -66,6 +71,7 @@ public:
 private:
 
     void addSymlink(PathRef link);
+    void setCanonical(PathRef path);
 
     // initialize function to be able to search many times
     bool findPrefix(PathRef path, PathRef dependent_file);
@@ -74,6 +80,8 @@ private:
     // origin
     Path m_original_file; // the file as it is in bin/lib
     Path m_canonical_file; // as original_file but with symlinks resolved
+    // the two above in PathTable::shared()
+    PathTable::Id m_original_id, m_canonical_id;
     Path m_prefix;
     std::vector<Path> m_symlinks;
     bool m_framework, m_executable;
@@ -81,6 +89,7 @@ private:
     // if some libs are missing prefixes, this will be set to true
     // more stuff will then be necessary to do
     bool m_missing_prefixes = false;
+    bool m_unresolved = false;
 };
 
 
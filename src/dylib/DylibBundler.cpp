@@ -29,7 +29,8 @@ THE SOFTWARE.
 #include <cstdlib>
 #include <set>
 #include <map>
-#include <regex>
+#include <unordered_map>
+#include <sstream>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
@@ -44,6 +45,8 @@ THE SOFTWARE.
 #include "Settings.h"
 #include "Dependency.h"
 #include "Tools.h"
+#include "ThreadPool.h"
+#include "MachO.h"
 
 namespace fs = std::filesystem;
 
@@ -55,7 +58,11 @@ DylibBundler::DylibBundler():
     m_deps_per_file{},
     m_dep_state{},
     m_rpaths_per_file{},
-    m_rpath_to_fullpath{},
+    m_rpath_resolver{},
+    m_pruned{},
+    m_prune_roots{},
+    m_fixed{},
+    m_frameworks_copied{},
     m_currentFile{}
 {
     assert(DylibBundler::s_instance == nullptr &&
@@ -64,7 +71,10 @@ DylibBundler::DylibBundler():
 }
 
 DylibBundler::~DylibBundler()
-{}
+{
+    if (DylibBundler::s_instance == this)
+        DylibBundler::s_instance = nullptr;
+}
 
 DylibBundler*
 DylibBundler::instance()
@@ -74,19 +84,49 @@ DylibBundler::instance()
 
 DylibBundler *DylibBundler::s_instance = nullptr;
 
-void
-DylibBundler::changeLibPathsOnFile(PathRef file ) {
+typedef std::lock_guard<std::recursive_mutex> Lock;
+
+std::vector<std::pair<Path, Path>>
+DylibBundler::libPathChanges(PathRef file)
+{
+    Lock lock{m_mutex};
     if (m_deps_per_file.find(file.string()) == m_deps_per_file.end()) {
         std::cout << "    ";
         collectDependencies(file, false);
         std::cout << "\n";
     }
-    std::cout << "  * Fixing dependencies on " << file << std::endl;
-
+    std::vector<std::pair<Path, Path>> changes;
     for(const auto& idx : m_deps_per_file.at(file.string())) {
-        m_deps[idx].fixFileThatDependsOnMe(file);
+        if (m_deps[idx].isUnresolved())
+            continue; // nowhere to point it at
+        for (auto& change : m_deps[idx].nameChanges()) {
+            if (std::find(changes.begin(), changes.end(), change)
+                == changes.end())
+                changes.push_back(std::move(change));
+        }
     }
-    m_dep_state[file.string()] |= LibPathsChanged;
+    return changes;
+}
+
+bool
+DylibBundler::claimFixup(PathRef dest)
+{
+    Lock lock{m_mutex};
+    auto& state = m_dep_state[dest.string()];
+    if ((state & (Done | Queued)) != 0)
+        return false;
+    state |= Queued;
+    return true;
+}
+
+void
+DylibBundler::setState(PathRef file, DepState state)
+{
+    {
+        Lock lock{m_mutex};
+        m_dep_state[file.string()] |= state;
+    }
+    m_state_changed.notify_all();
 }
 
 bool // static
@@ -103,63 +143,37 @@ DylibBundler::searchFilenameInRPaths(
     PathRef rpath_file,
     PathRef dependent_file
 ) {
-    Path fullpath;
-    auto rpathStr = rpath_file.string();
-    std::string suffix = std::regex_replace(
-        rpathStr, std::regex("^@[a-z_]+path/"), "");
+    Lock lock{m_mutex};
+    Path fullpath = m_rpath_resolver.resolve(rpath_file, dependent_file);
+    if (!fullpath.empty())
+        return fullpath;
 
-    const auto check_path = [&](PathRef path)
-    {
-        auto depParentDir = dependent_file.parent_path();
-        if (dependent_file != rpath_file)
-        {
-            auto firstDir = path.begin()->filename();
-            if (firstDir == "@loader_path" || firstDir == "@rpath") {
-                std::error_code err;
-                auto canonical = fs::canonical(
-                    path.strip_prefix(), err);
-                if (!err) {
-                    fullpath = canonical;
-                    return true;
-                }
-            }
-        }
-        return false;
-    };
-
-    // fullpath previously stored
-    if (m_rpath_to_fullpath.find(rpathStr) != m_rpath_to_fullpath.end())
-    {
-        fullpath = m_rpath_to_fullpath[rpathStr];
-    }
-    else if (!check_path(rpath_file))
-    {
-        for (const auto& rpath : m_rpaths_per_file[dependent_file.string()]) {
-            if (check_path(static_cast<Path>(rpath) / suffix))
-                break;
-        }
-        if (m_rpath_to_fullpath.find(rpathStr) != m_rpath_to_fullpath.end())
-        {
-            fullpath = m_rpath_to_fullpath[rpathStr];
-        }
-    }
-
-    if (fullpath.empty()) {
+    auto rpathStr = rpath_file.string();
+    Path suffix{std::string(RPathResolver::suffix(rpathStr))};
+    std::error_code err;
+    if (dependent_file != rpath_file && fs::exists(suffix, err)) {
+        fullpath = fs::canonical(suffix, err);
+    } else {
         for (const auto& searchPath : Settings::searchPaths()) {
             if (fs::exists(searchPath / suffix)) {
                 fullpath = searchPath / suffix;
                 break;
             }
         }
+    }
 
-        // let user tell the path to look in
-        if (fullpath.empty()) {
+    // let user tell the path to look in
+    if (fullpath.empty()) {
+        if (Settings::shouldAskUser())
             std::cerr << "\n/!\\ WARNING : can't get path for '"
                       << rpath_file << "'\n"
                       << "Consider adding dir to search path as a switch, ie: -s=../dir1 -s=dir2/\n";
-            auto dir = getUserInputDirForFile(Path(suffix));
-            fullpath = dir.string() + suffix;
-            std::error_code err;
+        auto dir = getUserInputDirForFile(suffix);
+        if (dir.empty()) {
+            addUnresolved(rpath_file, dependent_file);
+            fullpath = rpath_file;
+        } else {
+            fullpath = dir / suffix;
             auto canonical = fs::canonical(fullpath, err);
             if (!err)
                 fullpath = canonical;
@@ -167,33 +181,53 @@ DylibBundler::searchFilenameInRPaths(
         }
     }
 
+    m_rpath_resolver.remember(rpath_file, dependent_file, fullpath);
     return fullpath;
 }
 
 void
-DylibBundler::fixRPathsOnFile(
-    PathRef original_file,
-    PathRef file_to_fix
-) {
-    if (Settings::createAppBundle()) return; // don't change @rpath on app bundles
-    std::vector<std::string> rpaths_to_fix;
+DylibBundler::addUnresolved(PathRef installName, PathRef dependent_file)
+{
+    Lock lock{m_mutex};
+    m_unresolved[installName.string()].insert(dependent_file.string());
+}
 
-    if ((m_dep_state[file_to_fix.string()] & RPathsChanged) != 0) return;
+bool
+DylibBundler::reportUnresolved() const
+{
+    Lock lock{m_mutex};
+    if (m_unresolved.empty())
+        return false;
 
-    for (const auto& pair : m_rpaths_per_file){
-        if (pair.first == original_file) {
-            for (const auto& rpath : pair.second)
-                rpaths_to_fix.emplace_back(rpath.string());
-            break;
-        }
+    std::cerr << "\n\n/!\\ ERROR : " << m_unresolved.size()
+              << (m_unresolved.size() > 1 ? " libraries" : " library")
+              << " could not be found:\n";
+    for (const auto& [name, loaders] : m_unresolved) {
+        std::cerr << "  " << name << "\n";
+        for (const auto& loader : loaders)
+            std::cerr << "    needed by " << loader << "\n";
     }
+    std::cerr << "Add their dirs with -s, or list them in a --resolve-map "
+              << "file as '<library name> <dir>'" << std::endl;
+    return true;
+}
+
+std::vector<std::pair<Path, Path>>
+DylibBundler::rpathChanges(PathRef original_file, PathRef file_to_fix)
+{
+    std::vector<std::pair<Path, Path>> changes;
+    if (Settings::createAppBundle()) return changes; // don't change @rpath on app bundles
+
+    Lock lock{m_mutex};
+    if ((m_dep_state[file_to_fix.string()] & RPathsChanged) != 0)
+        return changes;
 
-    Tools::InstallName installTool;
-    for (const auto& rpath : rpaths_to_fix) {
-        installTool.rpath(
-            Path(rpath), Settings::inside_lib_path(), file_to_fix);
+    auto found = m_rpaths_per_file.find(original_file.string());
+    if (found != m_rpaths_per_file.end()) {
+        for (const auto& rpath : found->second)
+            changes.emplace_back(rpath, Settings::inside_lib_path());
     }
-    m_dep_state[file_to_fix.string()] |= RPathsChanged;
+    return changes;
 }
 
 void
@@ -225,6 +259,7 @@ DylibBundler::addDependency(PathRef path, PathRef file)
 void
 DylibBundler::collectDependencies(PathRef file, bool isExecutable)
 {
+    Lock lock{m_mutex};
     m_currentFile = file;
     if (m_dep_state.find(file.string()) != m_dep_state.end())
         return;
@@ -234,6 +269,7 @@ DylibBundler::collectDependencies(PathRef file, bool isExecutable)
 
     for (auto rpath : otool.rpaths)
         m_rpaths_per_file[file.string()].emplace_back(rpath);
+    m_rpath_resolver.addLoader(file, otool.rpaths, isExecutable);
 
     Settings::verbose() ?
         std::cout << std::endl << "Collect dependencies for '"
@@ -243,7 +279,8 @@ DylibBundler::collectDependencies(PathRef file, bool isExecutable)
 
     for (const auto& path : otool.dependencies)
     {
-        if (path.before(".framework") != path &&
+        if (PathTable::shared().contains(
+                PathTable::shared().intern(path), ".framework") &&
             !Settings::bundleFrameworks())
         {
             if (Settings::verbose())
@@ -274,6 +311,7 @@ DylibBundler::collectDependencies(PathRef file, bool isExecutable)
 void
 DylibBundler::collectSubDependencies()
 {
+    Lock lock{m_mutex};
     size_t dep_amount;
 
     // recursively collect each dependency's dependencies
@@ -283,17 +321,22 @@ DylibBundler::collectSubDependencies()
         // can't use range based loop, m_deps might grow
         for (size_t i = 0; i < m_deps.size(); ++i)
         {
+            if (m_deps[i].isUnresolved())
+                continue; // nothing to scan, reported by reportUnresolved
             auto original_path = m_deps[i].getOriginal();
             Settings::verbose() ?
                 std::cout << "* SubDependencies for: " << original_path << std::endl
               : std::cout << ".";
             fflush(stdout);
             if (isRpath(original_path)) {
-                original_path = searchFilenameInRPaths(
-                    original_path, original_path);
+                // resolved against the binary loading it when added
+                original_path = m_deps[i].getCanonical();
             } else if (!fs::exists(original_path)) {
+                // found in a search path, prefix is the dir it is in
                 original_path = m_deps[i].getPrefix()
-                              / original_path;
+                              / (m_deps[i].isFramework()
+                                  ? original_path
+                                  : original_path.filename());
             }
 
             collectDependencies(original_path, false);
@@ -305,16 +348,267 @@ DylibBundler::collectSubDependencies()
 
 bool
 DylibBundler::hasFrameworkDep() {
+    Lock lock{m_mutex};
     return m_deps.end() != std::find_if(
         m_deps.begin(), m_deps.end(),[](const auto &dep){
         return dep.isFramework();
     });
 }
 
+namespace {
+
+/// what a binary loads and which of those it imports symbols from
+struct SymbolScan {
+    std::vector<Path> dylibs;
+    std::vector<bool> used;
+    /// flat namespace or weak imports, bound to whichever image has it
+    std::vector<std::string> lookups;
+    std::vector<std::string> exports;
+    /// false if we can't tell, then everything it loads is used
+    bool ok = true;
+};
+
+void
+scanObject(const MachO::mach_object& obj, SymbolScan& scan)
+{
+    auto dylibs = obj.dylibsByOrdinal();
+    if (scan.dylibs.empty()) {
+        scan.dylibs = dylibs;
+        scan.used.assign(dylibs.size(), false);
+    } else if (dylibs != scan.dylibs) {
+        scan.ok = false; // slices load different dylibs
+        return;
+    }
+
+    const bool twoLevel = obj.header32()->flags() & MachO::MH_TWOLEVEL;
+    auto use = [&](int ordinal, std::string_view name) {
+        if (!twoLevel || ordinal == MachO::BIND_SPECIAL_DYLIB_FLAT_LOOKUP ||
+            ordinal == MachO::BIND_SPECIAL_DYLIB_WEAK_LOOKUP)
+        {
+            scan.lookups.emplace_back(name);
+        } else if (ordinal > 0 && size_t(ordinal) <= dylibs.size()) {
+            scan.used[ordinal - 1] = true;
+        } else if (ordinal > 0) {
+            scan.ok = false;
+        }
+    };
+
+    MachO::dyld_info info{obj};
+    if (!info.forEachImport([&](const MachO::dyld_import& imp) {
+            use(imp.libraryOrdinal, imp.name);
+        }))
+    {
+        scan.ok = false;
+    }
+    info.forEachExport([&](const MachO::dyld_export& exp) {
+        scan.exports.emplace_back(exp.name);
+    });
+
+    // older binaries only have these
+    auto syms = obj.symbols();
+    for (const auto& sym : syms.undefined()) {
+        int ordinal = sym.libraryOrdinal();
+        if (ordinal == 0xfe) // DYNAMIC_LOOKUP_ORDINAL
+            ordinal = MachO::BIND_SPECIAL_DYLIB_FLAT_LOOKUP;
+        else if (ordinal == 0xff) // EXECUTABLE_ORDINAL
+            ordinal = MachO::BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE;
+        use(ordinal, sym.name());
+    }
+    for (const auto& sym : syms.exports())
+        scan.exports.emplace_back(sym.name());
+
+    // reexported dylibs are part of what this one provides
+    for (const auto& path : obj.reexportDylibPaths()) {
+        auto it = std::find(dylibs.begin(), dylibs.end(), path);
+        if (it != dylibs.end())
+            scan.used[it - dylibs.begin()] = true;
+    }
+}
+
+SymbolScan
+scanSymbols(PathRef file)
+{
+    SymbolScan scan;
+    MachO::MachOLoader loader(file);
+    if (loader.isFat()) {
+        for (const auto& obj : loader.fatObject()->objects())
+            scanObject(obj, scan);
+    } else if (loader.isObject()) {
+        scanObject(*loader.object(), scan);
+    } else {
+        scan.ok = false;
+    }
+    return scan;
+}
+
+} // namespace
+
+void
+DylibBundler::pruneUnusedDependencies()
+{
+    prune(false);
+}
+
+void
+DylibBundler::unpruneUsedBy(const std::vector<Path>& roots)
+{
+    Lock lock{m_mutex};
+    if (m_pruned.empty())
+        return;
+    for (const auto& root : roots)
+        m_prune_roots.insert(root.string());
+    prune(true);
+}
+
+void
+DylibBundler::prune(bool onlyUnprune)
+{
+    Lock lock{m_mutex};
+    std::cout << (onlyUnprune
+                  ? "* Looking for pruned dependencies used by scripts"
+                  : "* Looking for unused dependencies") << std::endl;
+
+    // one node per binary, a binary might be in m_deps several times
+    std::vector<Path> files;
+    std::vector<bool> isRoot;
+    std::map<std::string, size_t> nodeOf, nodeOfName;
+    for (const auto& dep : m_deps) {
+        auto key = dep.getCanonical().string();
+        auto found = nodeOf.find(key);
+        size_t node = files.size();
+        if (found == nodeOf.end()) {
+            files.push_back(dep.getCanonical());
+            isRoot.push_back(false);
+            nodeOf[key] = node;
+        } else
+            node = found->second;
+
+        if (dep.isExecutable() || m_prune_roots.count(key) ||
+            m_prune_roots.count(dep.getOriginal().string()))
+            isRoot[node] = true;
+        nodeOf.emplace(dep.getOriginal().string(), node);
+        nodeOf.emplace(dep.getInnerPath().string(), node);
+        for (const auto& link : dep.getSymlinks())
+            nodeOf.emplace(link.string(), node);
+        nodeOfName.emplace(dep.getCanonical().filename().string(), node);
+        nodeOfName.emplace(dep.getOriginal().filename().string(), node);
+    }
+
+    auto resolve = [&](PathRef loadPath) -> int {
+        auto found = nodeOf.find(loadPath.string());
+        if (found != nodeOf.end())
+            return static_cast<int>(found->second);
+        found = nodeOfName.find(loadPath.filename().string());
+        return found != nodeOfName.end() ? static_cast<int>(found->second) : -1;
+    };
+
+    std::vector<SymbolScan> scans(files.size());
+    ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+        scans[i] = scanSymbols(files[i]);
+    });
+
+    std::unordered_map<std::string, std::vector<size_t>> exporters;
+    for (size_t i = 0; i < scans.size(); ++i)
+        for (const auto& name : scans[i].exports)
+            exporters[name].push_back(i);
+
+    // i uses uses[i], i is loaded by loadedBy[i]
+    std::vector<std::set<size_t>> uses(files.size()), loadedBy(files.size());
+    for (size_t i = 0; i < scans.size(); ++i) {
+        const auto& scan = scans[i];
+        for (size_t k = 0; k < scan.dylibs.size(); ++k) {
+            int target = resolve(scan.dylibs[k]);
+            if (target < 0 || size_t(target) == i)
+                continue; // system library or not bundled
+            loadedBy[target].insert(i);
+            if (!scan.ok || scan.used[k])
+                uses[i].insert(target);
+        }
+        for (const auto& name : scan.lookups) {
+            auto found = exporters.find(name);
+            if (found != exporters.end())
+                uses[i].insert(found->second.begin(), found->second.end());
+        }
+    }
+
+    std::vector<bool> reached(files.size(), false);
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (isRoot[i])
+            todo.push_back(i);
+    while (!todo.empty()) {
+        auto i = todo.back();
+        todo.pop_back();
+        if (reached[i])
+            continue;
+        reached[i] = true;
+        todo.insert(todo.end(), uses[i].begin(), uses[i].end());
+    }
+
+    if (onlyUnprune) {
+        // what is bundled by now stays bundled, only bring back
+        // what the new roots use
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (reached[i] && m_pruned.erase(files[i].string()))
+                std::cout << "  * unpruned " << files[i].filename()
+                          << ", used by binaries from a script" << std::endl;
+        }
+        return;
+    }
+
+    size_t pruned = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (reached[i])
+            continue;
+        ++pruned;
+        m_pruned.insert(files[i].string());
+
+        std::stringstream byUsed, byUnused;
+        for (auto by : loadedBy[i])
+            (reached[by] ? byUsed : byUnused)
+                << " " << files[by].filename().string();
+        std::cout << "  * pruned " << files[i].filename() << ", ";
+        if (!byUsed.str().empty())
+            std::cout << "no symbol is imported from it by" << byUsed.str();
+        else if (!byUnused.str().empty())
+            std::cout << "only loaded by unused" << byUnused.str();
+        else
+            std::cout << "not loaded by anything";
+        std::cout << std::endl;
+    }
+    std::cout << "  pruned " << pruned << " of " << files.size()
+              << " binaries" << std::endl;
+}
+
+std::vector<Path>
+DylibBundler::prunedLoadPaths() const
+{
+    std::vector<Path> paths;
+    Lock lock{m_mutex};
+    // whatever name a file might load it by, changed or not
+    for (const auto& dep : m_deps) {
+        if (!isPruned(dep))
+            continue;
+        paths.push_back(dep.getOriginal());
+        paths.push_back(dep.getInnerPath());
+        for (const auto& link : dep.getSymlinks())
+            paths.push_back(link);
+    }
+    return paths;
+}
+
+bool
+DylibBundler::isPruned(const Dependency& dep) const
+{
+    Lock lock{m_mutex};
+    return m_pruned.count(dep.getCanonical().string()) > 0;
+}
+
 Json::VluType
 DylibBundler::toJson(std::string_view srcFile) const
 {
     using namespace Json;
+    Lock lock{m_mutex};
     Array srcFiles;
 
     std::error_code err;
@@ -332,7 +626,8 @@ DylibBundler::toJson(std::string_view srcFile) const
         if (srcFile == pair.first || srcFile.empty()) {
             Array value;
             for (const auto& idx : pair.second)
-                value.push(m_deps[idx].toJson());
+                if (!isPruned(m_deps[idx]))
+                    value.push(m_deps[idx].toJson());
             src_files.set(pair.first, value);
         }
     }
@@ -347,44 +642,337 @@ DylibBundler::toJson(std::string_view srcFile) const
     return root;
 }
 
+namespace {
+    struct GraphNode {
+        Path src, installPath;
+        uint64_t size = 0, closureSize = 0;
+        size_t closureCount = 0;
+        int depth = -1;
+        bool executable = false, framework = false, pruned = false;
+        std::set<std::string> archs;
+        // target node and kind: load, weak or reexport
+        std::set<std::pair<size_t, std::string>> edges;
+    };
+
+    std::string dotEscape(const std::string& str)
+    {
+        std::string res;
+        for (const auto ch : str) {
+            if (ch == '"' || ch == '\\')
+                res += '\\';
+            res += ch;
+        }
+        return res;
+    }
+
+    /// size in KiB rounded up, our json numbers are floats which hold
+    /// every KiB count up to 16 GiB exactly, but not every byte count
+    int kiB(uint64_t size)
+    {
+        return static_cast<int>((size + 1023) / 1024);
+    }
+
+    std::string kiloBytes(uint64_t size)
+    {
+        return std::to_string(kiB(size)) + " KiB";
+    }
+
+    void writeGraphDot(
+        std::ostream& out, const std::vector<GraphNode>& nodes)
+    {
+        out << "digraph dependencies {\n"
+            << "  node [shape=box];\n";
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const auto& node = nodes[i];
+            std::string archs;
+            for (const auto& arch : node.archs)
+                archs += (archs.empty() ? "" : " ") + arch;
+            out << "  n" << i << " [label=\""
+                << dotEscape(node.src.filename().string())
+                << "\\n" << kiloBytes(node.size) << ", closure "
+                << kiloBytes(node.closureSize)
+                << "\\n" << dotEscape(archs) << "\"";
+            if (node.executable)
+                out << " shape=doubleoctagon";
+            if (node.pruned)
+                out << " style=dashed";
+            out << "];\n";
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (const auto& [to, kind] : nodes[i].edges) {
+                out << "  n" << i << " -> n" << to;
+                if (kind == "weak")
+                    out << " [style=dashed label=weak]";
+                else if (kind == "reexport")
+                    out << " [style=bold label=reexport]";
+                out << ";\n";
+            }
+        }
+        out << "}\n";
+    }
+
+    void writeGraphJson(
+        std::ostream& out, const std::vector<GraphNode>& nodes,
+        const std::vector<size_t>& heaviest)
+    {
+        using namespace Json;
+        Array jsNodes, jsEdges, jsHeaviest;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const auto& node = nodes[i];
+            Array archs;
+            for (const auto& arch : node.archs)
+                archs.push(String(arch));
+            jsNodes.push(std::make_unique<Object>(ObjInitializer{
+                {"id", Number(static_cast<int>(i))},
+                {"path", String(node.src.string())},
+                {"install_path", String(node.installPath.string())},
+                {"size_kib", Number(kiB(node.size))},
+                {"archs", archs},
+                {"executable", Bool(node.executable)},
+                {"framework", Bool(node.framework)},
+                {"pruned", Bool(node.pruned)},
+                {"depth", Number(node.depth)},
+                {"closure_size_kib", Number(kiB(node.closureSize))},
+                {"closure_count", Number(static_cast<int>(node.closureCount))}
+            }));
+            for (const auto& [to, kind] : node.edges) {
+                jsEdges.push(std::make_unique<Object>(ObjInitializer{
+                    {"from", Number(static_cast<int>(i))},
+                    {"to", Number(static_cast<int>(to))},
+                    {"kind", String(kind)}
+                }));
+            }
+        }
+        for (const auto idx : heaviest)
+            jsHeaviest.push(Number(static_cast<int>(idx)));
+
+        Object root{ObjInitializer{
+            {"nodes", jsNodes},
+            {"edges", jsEdges},
+            {"heaviest", jsHeaviest}
+        }};
+        out << root.serialize(2).rdbuf() << "\n";
+    }
+} // namespace
+
+void
+DylibBundler::exportGraph(PathRef file) const
+{
+    std::vector<GraphNode> nodes;
+    // every name a dependency is loaded by, to its node
+    std::map<std::string, size_t> byName;
+    {
+        Lock lock{m_mutex};
+        for (const auto& dep : m_deps) {
+            auto src = dep.getCanonical().string();
+            auto found = byName.find(src);
+            size_t idx = found != byName.end() ? found->second : nodes.size();
+            if (idx == nodes.size()) {
+                nodes.emplace_back();
+                nodes.back().src = dep.getCanonical();
+                nodes.back().installPath = dep.getInstallPath();
+                nodes.back().framework = dep.isFramework();
+                nodes.back().pruned = isPruned(dep);
+            }
+            nodes[idx].executable |= dep.isExecutable();
+            byName[src] = idx;
+            byName[dep.getOriginal().string()] = idx;
+            for (const auto& link : dep.getSymlinks())
+                byName[link.string()] = idx;
+        }
+    }
+
+    // edges from the load commands, each binary read once in parallel
+    ThreadPool::shared().parallelFor(nodes.size(), [&](size_t i) {
+        auto& node = nodes[i];
+        std::error_code err;
+        node.size = fs::file_size(node.src, err);
+        if (err) node.size = 0;
+
+        MachO::MachOLoader loader{node.src, false};
+        std::vector<const MachO::mach_object*> objs;
+        if (loader.isFat()) {
+            for (const auto& obj : loader.fatObject()->objects())
+                objs.push_back(&obj);
+        } else if (loader.isObject()) {
+            objs.push_back(loader.object());
+        }
+
+        auto addEdges = [&](const std::vector<Path>& paths, const char* kind) {
+            for (const auto& path : paths) {
+                auto found = byName.find(path.string());
+                if (found != byName.end() && found->second != i)
+                    node.edges.emplace(found->second, kind);
+            }
+        };
+        for (const auto obj : objs) {
+            node.archs.insert(MachO::archName(
+                obj->header32()->cputype(), obj->header32()->cpusubtype()));
+            addEdges(obj->loadDylibPaths(), "load");
+            addEdges(obj->weakLoadDylib(), "weak");
+            addEdges(obj->reexportDylibPaths(), "reexport");
+        }
+    });
+
+    // depth from the nearest executable
+    std::vector<size_t> queue;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].executable) {
+            nodes[i].depth = 0;
+            queue.push_back(i);
+        }
+    }
+    for (size_t q = 0; q < queue.size(); ++q) {
+        for (const auto& edge : nodes[queue[q]].edges) {
+            if (nodes[edge.first].depth < 0) {
+                nodes[edge.first].depth = nodes[queue[q]].depth + 1;
+                queue.push_back(edge.first);
+            }
+        }
+    }
+
+    // what each node brings along, itself included
+    for (auto& node : nodes) {
+        std::vector<char> seen(nodes.size(), false);
+        std::vector<size_t> todo;
+        for (const auto& edge : node.edges)
+            todo.push_back(edge.first);
+        node.closureSize = node.size;
+        node.closureCount = 1;
+        while (!todo.empty()) {
+            auto idx = todo.back();
+            todo.pop_back();
+            if (seen[idx] || &nodes[idx] == &node)
+                continue;
+            seen[idx] = true;
+            node.closureSize += nodes[idx].size;
+            ++node.closureCount;
+            for (const auto& edge : nodes[idx].edges)
+                todo.push_back(edge.first);
+        }
+    }
+
+    std::vector<size_t> heaviest;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!nodes[i].executable)
+            heaviest.push_back(i);
+    }
+    std::sort(heaviest.begin(), heaviest.end(), [&](size_t a, size_t b) {
+        return nodes[a].closureSize > nodes[b].closureSize;
+    });
+    heaviest.resize(std::min<size_t>(heaviest.size(), 10));
+
+    std::ofstream out{file.string()};
+    if (file.extension() == ".dot")
+        writeGraphDot(out, nodes);
+    else
+        writeGraphJson(out, nodes, heaviest);
+    if (!out)
+        exitMsg(std::string("Could not write graph to ") + file.string());
+
+    std::cout << "\n* Wrote dependency graph to " << file << "\n"
+              << "  heaviest subtrees:\n";
+    for (const auto idx : heaviest) {
+        std::cout << "    " << kiloBytes(nodes[idx].closureSize)
+                  << " in " << nodes[idx].closureCount
+                  << (nodes[idx].closureCount > 1 ? " files " : " file ")
+                  << nodes[idx].src << "\n";
+    }
+    std::cout << std::flush;
+}
+
 Json::VluType
 DylibBundler::fixPathsInBinAndCodesign(const Json::Array* files)
 {
     auto resObj = std::make_unique<Json::Object>();
     try {
-        for (auto& file : *files) {
-            if (!file->isString()) {
-                std::stringstream msg;
-                msg << "*Expected a string, but got a " << file->typeName()
-                    << std::endl;
-                throw msg.str();
+        // collecting is serialized, it builds up our shared state
+        {
+            Lock lock{m_mutex};
+            for (auto& file : *files) {
+                if (!file->isString()) {
+                    std::stringstream msg;
+                    msg << "*Expected a string, but got a " << file->typeName()
+                        << std::endl;
+                    throw msg.str();
+                }
+                collectDependencies(Path(file->asString()->vlu()), false);
+            }
+            collectSubDependencies();
+
+            // pruning ran before the scripts, what their binaries
+            // import from must be bundled after all
+            if (Settings::pruneUnused()) {
+                std::vector<Path> roots;
+                for (auto& file : *files)
+                    roots.emplace_back(file->asString()->vlu());
+                unpruneUsedBy(roots);
+            }
+
+            // nobody is asked under --no-interactive, the script must know
+            if (reportUnresolved()) {
+                std::string names;
+                for (const auto& entry : m_unresolved)
+                    names += " " + entry.first;
+                throw std::string("*Could not find:") + names;
             }
-            collectDependencies(Path(file->asString()->vlu()), false);
-        }
-        collectSubDependencies();
 
-        std::cout << "\n Postprocess requested by a script: " << std::endl;
+            std::cout << "\n Postprocess requested by a script: " << std::endl;
 
-        // print info to user
-        if (Settings::verbose()) {
-            for(const auto& dep : m_deps) {
-                if ((m_dep_state[dep.getInstallPath().string()] & Done) == 0)
-                    dep.print();
+            // print info to user
+            if (Settings::verbose()) {
+                for(const auto& dep : m_deps) {
+                    if ((m_dep_state[dep.getInstallPath().string()] & Done) == 0)
+                        dep.print();
+                }
             }
+            std::cout << std::endl;
         }
-        std::cout << std::endl;
 
         // copy dependency files if requested by user
         if(Settings::bundleLibs())
         {
-            // can't use range based loop here, m_deps might grow
-            for(size_t i = 0; i < m_deps.size(); ++i) {
-                const auto& dep = m_deps[i];
-                if ((m_dep_state[dep.getInstallPath().string()] & Done) == 0)
-                    fixupBinary(
-                        dep.getCanonical(),
-                        dep.getInstallPath(), true);
+            // each binary is fixed on its own, do them in parallel.
+            // m_deps might grow while fixing, loop until nothing new shows up
+            std::vector<std::pair<Path, Path>> todo;
+            for (size_t scanned = 0;; todo.clear()) {
+                {
+                    Lock lock{m_mutex};
+                    for (; scanned < m_deps.size(); ++scanned) {
+                        const auto& dep = m_deps[scanned];
+                        auto state = m_dep_state[dep.getInstallPath().string()];
+                        if ((state & (Done | Queued)) == 0 && !isPruned(dep)
+                            && !dep.isUnresolved())
+                            todo.emplace_back(
+                                dep.getCanonical(), dep.getInstallPath());
+                    }
+                }
+                if (todo.empty()) break;
+
+                ThreadPool::shared().parallelFor(todo.size(), [&](size_t i) {
+                    fixupBinary(todo[i].first, todo[i].second, true);
+                });
+            }
+
+            // binaries queued by another request might still be in work,
+            // don't answer before they are fixed
+            std::unique_lock<std::recursive_mutex> lock{m_mutex};
+            std::vector<std::string> queued;
+            for (const auto& dep : m_deps) {
+                auto dest = dep.getInstallPath().string();
+                if ((m_dep_state[dest] & Queued) != 0 && !isPruned(dep))
+                    queued.push_back(dest);
             }
+            std::string failed;
+            for (const auto& dest : queued) {
+                m_state_changed.wait(lock, [&]() {
+                    return (m_dep_state[dest] & (Done | Failed)) != 0;
+                });
+                if ((m_dep_state[dest] & Failed) != 0)
+                    failed += " " + dest;
+            }
+            if (!failed.empty())
+                throw std::string("*Failed to fixup:") + failed;
         }
         resObj->set("result", Json::Bool(true));
     } catch(std::exception& e) {
@@ -397,53 +985,189 @@ DylibBundler::fixPathsInBinAndCodesign(const Json::Array* files)
 }
 
 void
-DylibBundler::createDestDir() const
+DylibBundler::fixupBinary(PathRef src, PathRef dest, bool isSubDependency)
 {
-    std::error_code err;
-    std::stringstream ss;
-    auto dest_folder = Settings::destFolder();
-    std::cout << "* Checking output directory " << dest_folder << std::endl;
+    if (!claimFixup(dest)) {
+        std::cout << "\n*Skipping " << dest << " already done \n";
+        return;
+    }
+    try {
+        executeFixup(planFixup(src, dest, isSubDependency),
+                     Settings::thinArchs());
+    } catch (...) {
+        // let requests waiting for it know it never will be done
+        setState(dest, Failed);
+        throw;
+    }
+}
 
-    createFolder(dest_folder);
+FixupPlan
+DylibBundler::planFixup(PathRef src, PathRef dest, bool isSubDependency)
+{
+    FixupPlan plan;
+    plan.src = src;
+    plan.dest = dest;
+    int state;
+    {
+        Lock lock{m_mutex};
+        state = m_dep_state[dest.string()];
+        auto found = m_deps_per_file.find(dest.string());
+        if (found != m_deps_per_file.end()) {
+            for (const auto idx : found->second) {
+                plan.executable |= m_deps[idx].isExecutable();
+                plan.framework |= m_deps[idx].isFramework();
+            }
+        }
+    }
+
+    plan.thin = !Settings::thinArchs().empty();
+    plan.copy = !fs::exists(dest) && (state & Copied) == 0;
+    plan.changes = libPathChanges(dest);
+    plan.rpaths = rpathChanges(src, dest);
+    auto pruned = prunedLoadPaths();
+    if (!pruned.empty()) {
+        // only weaken what this binary loads
+        Tools::OTool otool;
+        otool.scanBinary(src);
+        for (const auto& path : otool.dependencies) {
+            if (std::find(pruned.begin(), pruned.end(), path) != pruned.end()
+                && std::find(plan.weaken.begin(), plan.weaken.end(), path)
+                   == plan.weaken.end())
+            {
+                plan.weaken.push_back(path);
+            }
+        }
+    }
+    plan.codesign = (state & Codesigned) == 0 && Settings::canCodesign();
+
+    // an identical dylib fixed up the same way might be in the store
+    if (isSubDependency && !Settings::storeDir().empty())
+        plan.storeKey = plan.hashKey(Settings::thinArchs());
+    return plan;
 }
 
 void
-DylibBundler::fixupBinary(PathRef src, PathRef dest, bool isSubDependency)
+DylibBundler::executeFixup(const FixupPlan& plan,
+                           const std::vector<std::string>& thinArchs)
 {
-    if ((m_dep_state[dest.string()] & Done) == Done) {
-        std::cout << "\n*Skipping " << dest << " already done \n";
-        return;
-    }
+    PathRef src = plan.src, dest = plan.dest;
     if (Settings::verbose()) {
-        std::cout << "\n* Processing "
-                  << (isSubDependency ? " dependency " : "")
-                  << src;
+        std::cout << "\n* Processing " << src;
         if (src != dest)
             std::cout << std::string(" into ") << dest;
         std::cout << std::endl;
     }
-    if (!fs::exists(dest) &&
-        (m_dep_state[dest.string()] & Copied) == 0
-    ) {
-        copyFile(src, dest); // to set write permission or move
-        m_dep_state[dest.string()] |= Copied;
+    {
+        Lock lock{m_mutex};
+        m_fixed.emplace_back(dest, plan.executable);
+    }
+
+    // a saved plan may be applied to another tree, look again
+    bool copy = !fs::exists(dest);
+
+    // the bundle around a framework binary is never in the store
+    bool frameworkCopied = copy && plan.framework;
+    if (frameworkCopied)
+        copyFrameworkOf(src, dest);
+
+    bool useStore = !plan.storeKey.empty() && !Settings::storeDir().empty();
+    if (useStore && fetchFromStore(plan.storeKey, dest, frameworkCopied)) {
+        if (Settings::verbose())
+            std::cout << "  * Linked " << dest << " from store\n";
+        setState(dest, Done);
+        return;
+    }
+
+    if (copy && !fs::exists(dest)) {
+        if (plan.thin)
+            thinFile(src, dest, thinArchs); // unwanted slices never copied
+        else
+            copyFile(src, dest); // to set write permission or move
+    } else if (plan.thin) {
+        thinFile(dest, dest, thinArchs);
+    }
+    if (copy)
+        setState(dest, Copied);
+    {
+        // all edits below go out in a single rewrite of dest
+        Tools::InstallName::Batch batch{dest};
+        Tools::InstallName installTool;
+        std::cout << "  * Fixing dependencies on " << dest << std::endl;
+        for (const auto& [from, to] : plan.changes)
+            installTool.change(from, to, dest);
+        setState(dest, LibPathsChanged);
+        for (const auto& [from, to] : plan.rpaths)
+            installTool.rpath(from, to, dest);
+        if (!plan.rpaths.empty())
+            setState(dest, RPathsChanged);
+        if (!plan.weaken.empty())
+            installTool.weaken(plan.weaken, dest);
+        batch.commit();
     }
-    changeLibPathsOnFile(dest);
-    fixRPathsOnFile(src, dest);
 
-    if ((m_dep_state[dest.string()] & Codesigned) == 0 &&
-        Settings::canCodesign()
-    ) {
+    if (plan.codesign) {
         adhocCodeSign(dest);
-        m_dep_state[dest.string()] |= Codesigned;
+        setState(dest, Codesigned);
     }
 
+    if (useStore)
+        addToStore(plan.storeKey, dest);
+
     if (Settings::verbose())
-        std::cout << "\n-- Done Processing "
-                  << (isSubDependency ? " dependency " : "")
-                  << " for " << src << std::endl;
+        std::cout << "\n-- Done Processing " << src << std::endl;
 
-    m_dep_state[dest.string()] |= Done;
+    setState(dest, Done);
+}
+
+void
+DylibBundler::copyFrameworkOf(PathRef src, PathRef dest)
+{
+    auto& table = PathTable::shared();
+    Path from{std::string(table.upto(table.intern(src), ".framework"))},
+         to{std::string(table.upto(table.intern(dest), ".framework"))};
+    std::once_flag* once;
+    {
+        Lock lock{m_mutex};
+        once = &m_frameworks_copied[to.string()];
+    }
+    std::call_once(*once, [&]() {
+        if (Settings::verbose())
+            std::cout << "  * Copying framework " << from
+                      << " to " << to << std::endl;
+        copyFramework(from, to, {src.filename().string()});
+    });
+    if (fs::exists(dest))
+        setWritable(dest, true);
+}
+
+bool
+DylibBundler::fetchFromStore(
+    const std::string& key, PathRef dest, bool replace) const
+{
+    auto stored = Settings::storeDir() / "fixups" / key;
+    if (!fs::exists(stored))
+        return false;
+    if (!replace && fs::exists(dest) && !Settings::canOverwriteFiles()) {
+        std::stringstream ss;
+        ss << "\n\nError : File " << dest << " already exists. "
+           << "Remove it or enable overwriting.";
+        exitMsg(ss.str());
+    }
+    linkOrCopy(stored, dest);
+    return true;
+}
+
+void
+DylibBundler::addToStore(const std::string& key, PathRef dest) const
+{
+    // objects are keyed by content, so equal results share one file,
+    // fixups map each input and how it was fixed to its object
+    auto object = Settings::storeDir() / "objects" / fastHash(dest);
+    if (fs::exists(object))
+        linkOrCopy(object, dest);
+    else
+        linkOrCopy(dest, object);
+    linkOrCopy(object, Settings::storeDir() / "fixups" / key);
 }
 
 void
@@ -453,23 +1177,284 @@ DylibBundler::moveAndFixBinaries()
 
     // print info to user
     for(const auto& dep : m_deps) {
-        dep.print();
+        if (!isPruned(dep))
+            dep.print();
     }
     std::cout << std::endl;
 
-    if(Settings::createAppBundle()) mkAppBundleTemplate();
+    executePlan(makePlan());
+}
+
+BundlePlan
+DylibBundler::makePlan()
+{
+    BundlePlan plan;
+    if (Settings::createAppBundle())
+        plan.appBundle = Settings::appBundlePath();
 
     // copy dependency files if requested by user
     if(Settings::bundleLibs())
     {
-        createDestDir();
+        plan.dirs.push_back(Settings::destFolder());
+        plan.thinArchs = Settings::thinArchs();
+        std::set<std::string> planned;
         // can't use rangebase loop here, m_deps might grow
         for(size_t i = 0; i < m_deps.size(); ++i) {
-            const auto& dep = m_deps[i];
-            fixupBinary(
-                dep.getCanonical(), dep.getInstallPath(), true);
+            Path src, dest;
+            {
+                Lock lock{m_mutex};
+                const auto& dep = m_deps[i];
+                if (isPruned(dep) || dep.isUnresolved())
+                    continue;
+                src = dep.getCanonical();
+                dest = dep.getInstallPath();
+            }
+            if (planned.insert(dest.string()).second)
+                plan.fixups.push_back(planFixup(src, dest, true));
+        }
+    }
+    return plan;
+}
+
+void
+DylibBundler::executePlan(const BundlePlan& plan)
+{
+    if (!plan.appBundle.empty()) {
+        if (!Settings::createAppBundle() ||
+            Settings::appBundlePath() != plan.appBundle)
+        {
+            exitMsg(std::string("The plan creates app bundle ")
+                    + plan.appBundle.string()
+                    + ", run with the -x and -a options it was made with.");
+        }
+        mkAppBundleTemplate();
+    }
+
+    for (const auto& dir : plan.dirs) {
+        std::cout << "* Checking output directory " << dir << std::endl;
+        createFolder(dir);
+    }
+
+    // each binary is fixed on its own, do them in parallel
+    ThreadPool::shared().parallelFor(plan.fixups.size(), [&](size_t i) {
+        const auto& fixup = plan.fixups[i];
+        if (!claimFixup(fixup.dest))
+            return;
+        try {
+            executeFixup(fixup, plan.thinArchs);
+        } catch (...) {
+            setState(fixup.dest, Failed);
+            throw;
+        }
+    });
+}
+
+namespace {
+    /// an LC_RPATH and the directory @loader_path stands for in it
+    struct RPathEntry {
+        std::string path;
+        Path loaderDir;
+    };
+
+    /// path with a leading @executable_path or @loader_path expanded
+    Path expandDyldPath(
+        const std::string& path, PathRef execDir, PathRef loaderDir)
+    {
+        auto expand = [&](std::string_view token, PathRef dir) {
+            if (path.compare(0, token.size(), token) != 0 ||
+                (path.size() > token.size() && path[token.size()] != '/'))
+                return Path();
+            auto rest = path.substr(std::min(path.size(), token.size() + 1));
+            return Path((dir / rest).lexically_normal());
+        };
+        auto res = expand("@executable_path", execDir);
+        if (res.empty())
+            res = expand("@loader_path", loaderDir);
+        return res.empty() ? Path(path) : res;
+    }
+
+    bool isWithin(PathRef root, PathRef path)
+    {
+        auto rel = path.lexically_relative(root);
+        return !rel.empty() && *rel.begin() != "..";
+    }
+
+    /// what is wrong with how name loads from a binary in loaderDir,
+    /// empty if it resolves within root
+    std::string checkReference(
+        const std::string& name, PathRef root, PathRef execDir,
+        PathRef loaderDir, const std::vector<RPathEntry>& rpaths)
+    {
+        std::error_code err;
+        auto inBundle = [&](PathRef found) -> std::string {
+            auto real = fs::weakly_canonical(found, err);
+            if (isWithin(root, Path(real)))
+                return {};
+            return "outside of bundle " + name + " -> " + real.string();
+        };
+
+        if (Settings::isSystemLibrary(Path(name)) ||
+            Settings::isPrefixIgnored(Path(name)))
+            return {};
+
+        const std::string rpathToken = "@rpath/";
+        if (name.compare(0, rpathToken.size(), rpathToken) == 0) {
+            auto rest = name.substr(rpathToken.size());
+            for (const auto& rpath : rpaths) {
+                auto dir = expandDyldPath(rpath.path, execDir, rpath.loaderDir);
+                auto found = dir / rest;
+                if (dir.is_absolute() && fs::exists(found, err))
+                    return inBundle(found);
+            }
+            return "unresolved " + name;
         }
+
+        auto path = expandDyldPath(name, execDir, loaderDir);
+        if (!path.is_absolute())
+            return (name[0] == '@' ? "unresolved " : "relative to cwd ") + name;
+        if (!fs::exists(path, err))
+            return "unresolved " + name;
+        if (name[0] != '@')
+            return "absolute " + name;
+        return inBundle(path);
+    }
+
+    std::vector<const MachO::mach_object*>
+    objectsIn(MachO::MachOLoader& loader)
+    {
+        std::vector<const MachO::mach_object*> objs;
+        if (loader.isFat()) {
+            for (const auto& obj : loader.fatObject()->objects())
+                objs.push_back(&obj);
+        } else if (loader.isObject()) {
+            objs.push_back(loader.object());
+        }
+        return objs;
+    }
+} // namespace
+
+bool
+DylibBundler::verifyBundle() const
+{
+    std::vector<Path> bins, execs;
+    {
+        Lock lock{m_mutex};
+        std::set<std::string> seen;
+        for (const auto& dep : m_deps) {
+            auto path = dep.getInstallPath();
+            if (isPruned(dep) || !seen.insert(path.string()).second)
+                continue;
+            bins.push_back(path);
+            if (dep.isExecutable())
+                execs.push_back(path);
+        }
+        // a plan applied from file has no collected dependencies
+        for (const auto& [path, executable] : m_fixed) {
+            if (!seen.insert(path.string()).second)
+                continue;
+            bins.push_back(path);
+            if (executable)
+                execs.push_back(path);
+        }
+    }
+    if (bins.empty()) {
+        std::cout << "\n* Nothing to verify" << std::endl;
+        return true;
     }
+
+    // called from the pool, errors stay local to each call
+    auto canonicalDir = [](PathRef path) {
+        std::error_code err;
+        auto dir = fs::absolute(path, err).parent_path();
+        return Path(fs::weakly_canonical(dir, err));
+    };
+
+    // the app bundle, otherwise the closest dir holding all binaries
+    std::error_code err;
+    Path root = Settings::createAppBundle()
+              ? Path(fs::weakly_canonical(
+                    fs::absolute(Settings::appBundlePath(), err), err))
+              : canonicalDir(bins.front());
+    for (const auto& bin : bins) {
+        while (!isWithin(root, canonicalDir(bin)) && root.has_relative_path())
+            root = Path(root.parent_path());
+    }
+    std::cout << "\n* Verifying bundle " << root << std::endl;
+
+    // dyld searches the rpaths of the executable after those of the image
+    std::vector<std::vector<RPathEntry>> execRPaths;
+    for (const auto& exec : execs) {
+        MachO::MachOLoader loader{exec, false};
+        auto objs = objectsIn(loader);
+        execRPaths.emplace_back();
+        if (!objs.empty()) {
+            for (const auto& rpath : objs[0]->rpaths())
+                execRPaths.back().push_back(
+                    {rpath.string(), canonicalDir(exec)});
+        }
+    }
+
+    std::vector<std::set<std::string>> problems(bins.size());
+    ThreadPool::shared().parallelFor(bins.size(), [&](size_t i) {
+        const auto& bin = bins[i];
+        if (!fs::exists(bin)) {
+            problems[i].insert("missing from bundle");
+            return;
+        }
+        MachO::MachOLoader loader{bin, false};
+        auto objs = objectsIn(loader);
+        if (objs.empty())
+            problems[i].insert("not a mach-o file");
+
+        auto loaderDir = canonicalDir(bin);
+        bool isExec =
+            std::find(execs.begin(), execs.end(), bin) != execs.end();
+        for (const auto obj : objs) {
+            std::vector<Path> names = obj->loadDylibPaths();
+            for (const auto& path : obj->reexportDylibPaths())
+                names.push_back(path);
+
+            // an executable loads from itself, a dylib from any of them.
+            // Without executables, ie. only plugins, each binary is
+            // checked on its own, @executable_path taken as its own dir
+            for (size_t e = 0; e < std::max<size_t>(execs.size(), 1); ++e) {
+                if (isExec && execs[e] != bin)
+                    continue;
+                std::vector<RPathEntry> rpaths;
+                for (const auto& rpath : obj->rpaths())
+                    rpaths.push_back({rpath.string(), loaderDir});
+                if (!isExec && !execs.empty())
+                    rpaths.insert(rpaths.end(),
+                        execRPaths[e].begin(), execRPaths[e].end());
+
+                auto execDir = execs.empty()
+                             ? loaderDir : canonicalDir(execs[e]);
+                for (const auto& name : names) {
+                    auto problem = checkReference(
+                        name.string(), root, execDir, loaderDir, rpaths);
+                    if (!problem.empty())
+                        problems[i].insert(problem);
+                }
+            }
+        }
+    });
+
+    size_t nProblems = 0, nBins = 0;
+    for (size_t i = 0; i < bins.size(); ++i) {
+        for (const auto& problem : problems[i])
+            std::cerr << "  " << bins[i] << ": " << problem << "\n";
+        nProblems += problems[i].size();
+        nBins += !problems[i].empty();
+    }
+    if (nProblems) {
+        std::cerr << " -- " << nProblems << " problem"
+                  << (nProblems > 1 ? "s" : "") << " in " << nBins
+                  << " binar" << (nBins > 1 ? "ies" : "y") << std::endl;
+        return false;
+    }
+
+    std::cout << " -- Verified " << bins.size() << " binaries" << std::endl;
+    return true;
 }
 
 // -----------------------------------------------------------------------
@@ -27,9 +27,15 @@ THE SOFTWARE.
 #define _crawler_
 
 #include <string>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
 #include <vector>
 #include "Types.h"
 #include "Dependency.h"
+#include "Plan.h"
+#include "RPathResolver.h"
 
 class DylibBundler {
 public:
@@ -44,24 +50,53 @@ public:
     void collectSubDependencies();
     /// @brief createDestDir/appbundle and process all files
     void moveAndFixBinaries();
+    /// @brief Decide what moveAndFixBinaries does, without touching disk
+    BundlePlan makePlan();
+    /// @brief Create dirs and fix up binaries as planned, the plan may
+    ///   come from an earlier run
+    void executePlan(const BundlePlan& plan);
     /// checks if path is a relative path i app binary
     static bool isRpath(PathRef path);
     /// @brief Search and find real paths for relative paths from binary
     /// @param rpath_file The file that has the rpath to look for
-    /// @param dependent_file The dependency we search for
-    /// @return true if found
+    /// @param dependent_file The binary that loads it
+    /// @return The full path, asks the user when it can't be found
     Path searchFilenameInRPaths(
       PathRef rpath_file, PathRef dependent_file);
+    /// @brief Remember a library that could not be found, without asking
+    void addUnresolved(PathRef installName, PathRef dependent_file);
+    /// @brief Print every library that could not be found and what
+    ///   loads them
+    /// @return true if there were any
+    bool reportUnresolved() const;
     /// @brief true if any dependency is a framework dependency
     bool hasFrameworkDep();
+    /// @brief Leave out dylibs that no used binary imports a symbol
+    ///   from, starting from the executables. Their load commands are
+    ///   made weak so the binaries still load.
+    void pruneUnusedDependencies();
+    /// @brief true if dep was left out by pruneUnusedDependencies
+    bool isPruned(const Dependency& dep) const;
+    /// @brief Resolve the dylibs each bundled binary loads the way dyld
+    ///   would, from their load commands only, and report those that are
+    ///   missing, absolute or outside of the bundle
+    /// @return true if all of them resolved within the bundle
+    bool verifyBundle() const;
 
     /// @brief Dump all dependencies to json
     /// @param srcFile Only dump for this sourcefile if set
     /// @return Json::Object unique_ptr with the dump
     Json::VluType toJson(std::string_view srcFile = "") const;
 
+    /// @brief Write the collected dependency graph with edge kinds,
+    ///   sizes, architectures and the size of what each file pulls in
+    /// @param file Graphviz dot if it ends with .dot, otherwise json
+    void exportGraph(PathRef file) const;
+
     /// @brief Called from scrips. Meant to be called from script
     ///   fix libpath and rpaths in binary and codesign(if enabled) on files
+    ///   Safe to call from several threads, the binaries are fixed in
+    ///   parallel once their dependencies are collected.
     /// @param files The files to fix
     Json::VluType fixPathsInBinAndCodesign(const Json::Array* files);
 
@@ -73,20 +108,56 @@ private:
       LibPathsChanged      = 0x04,
       RPathsChanged        = 0x08,
       Codesigned           = 0x10,
-      Done                 = 0x20
+      Done                 = 0x20,
+      Queued               = 0x40,
+      Failed               = 0x80
     };
-    void changeLibPathsOnFile(PathRef file);
-    void fixRPathsOnFile(PathRef original_file, PathRef file_to_fix);
+    /// mark dest as being processed, false if already queued or done
+    bool claimFixup(PathRef dest);
+    void setState(PathRef file, DepState state);
+    /// prune from the executables and m_prune_roots, onlyUnprune keeps
+    /// what is pruned already if it is still unused, but prunes no more
+    void prune(bool onlyUnprune);
+    /// binaries added by scripts are roots too, bring back what they use
+    void unpruneUsedBy(const std::vector<Path>& roots);
+    std::vector<std::pair<Path, Path>> libPathChanges(PathRef file);
+    std::vector<std::pair<Path, Path>> rpathChanges(
+        PathRef original_file, PathRef file_to_fix);
+    std::vector<Path> prunedLoadPaths() const;
     void addDependency(PathRef path, PathRef filename);
-    void createDestDir() const;
     void fixupBinary(PathRef src, PathRef dest, bool iDependency);
+    FixupPlan planFixup(PathRef src, PathRef dest, bool isSubDependency);
+    void executeFixup(const FixupPlan& plan,
+                      const std::vector<std::string>& thinArchs);
+    /// copy the framework bundle holding src to the one holding dest,
+    /// once, fixups of other binaries in it wait until it is done
+    void copyFrameworkOf(PathRef src, PathRef dest);
+    /// link the stored result for key to dest, false if there is none
+    /// @param replace dest was just copied by us, ie. with its framework
+    bool fetchFromStore(
+        const std::string& key, PathRef dest, bool replace) const;
+    /// share the fixed up dest as the result for key
+    void addToStore(const std::string& key, PathRef dest) const;
 
     std::vector<Dependency> m_deps;
     std::map<std::string, std::vector<size_t> > m_deps_per_file;
     std::map<std::string, int> m_dep_state;
     std::map<std::string, std::vector<Path>> m_rpaths_per_file;
-    std::map<std::string, Path> m_rpath_to_fullpath;
+    RPathResolver m_rpath_resolver;
+    std::set<std::string> m_pruned;
+    /// binaries added by scripts, used like executables when pruning
+    std::set<std::string> m_prune_roots;
+    /// install names not found, to the binaries loading them
+    std::map<std::string, std::set<std::string>> m_unresolved;
+    /// binaries fixed up so far and if they are executables
+    std::vector<std::pair<Path, bool>> m_fixed;
+    /// framework bundles copied, or being copied, by dest dir
+    std::map<std::string, std::once_flag> m_frameworks_copied;
     Path m_currentFile;
+    /// guards all of the above, scripts may fixup binaries concurrently
+    mutable std::recursive_mutex m_mutex;
+    /// signaled on every m_dep_state change
+    std::condition_variable_any m_state_changed;
     static DylibBundler *s_instance;
 };
 
@@ -0,0 +1,252 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "PathTable.h"
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr PathTable::Id noId = static_cast<PathTable::Id>(-1);
+}
+
+PathTable&
+PathTable::shared()
+{
+    static PathTable table;
+    return table;
+}
+
+PathTable::PathTable():
+    m_chunks{new std::atomic<Entry*>[maxChunks]},
+    m_count{0}
+{
+    for (size_t i = 0; i < maxChunks; ++i)
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+PathTable::~PathTable()
+{
+    for (size_t i = 0; i < maxChunks; ++i)
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+}
+
+PathTable::Id
+PathTable::intern(std::string_view path)
+{
+    std::lock_guard lock{m_mutex};
+    auto found = m_ids.find(path);
+    if (found != m_ids.end())
+        return found->second;
+
+    Id id = m_count.load(std::memory_order_relaxed);
+    if ((id >> chunkBits) >= maxChunks)
+        throw std::length_error("PathTable is full");
+    auto& chunk = m_chunks[id >> chunkBits];
+    if (!chunk.load(std::memory_order_relaxed))
+        chunk.store(new Entry[chunkSize], std::memory_order_relaxed);
+    auto& entry = chunk.load(std::memory_order_relaxed)[id & (chunkSize - 1)];
+    entry.str = std::string(path);
+    entry.canonical.store(noId, std::memory_order_relaxed);
+
+    // split like path::iterator, a root / is a component of its own and
+    // a trailing / gives an empty last component
+    const auto& str = entry.str;
+    auto& components = entry.components;
+    size_t pos = 0;
+    if (!str.empty() && str.front() == '/') {
+        components.emplace_back(0, 1);
+        while (pos < str.size() && str[pos] == '/') ++pos;
+    }
+    while (pos < str.size()) {
+        auto end = str.find('/', pos);
+        if (end == std::string::npos) end = str.size();
+        components.emplace_back(pos, end);
+        pos = end;
+        while (pos < str.size() && str[pos] == '/') ++pos;
+        if (pos == str.size() && end != str.size())
+            components.emplace_back(pos, pos);
+    }
+
+    m_ids.emplace(std::string_view(entry.str), id);
+    // readers see the whole entry once they see the count
+    m_count.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+const PathTable::Entry&
+PathTable::entry(Id id) const
+{
+    if (id >= m_count.load(std::memory_order_acquire))
+        throw std::out_of_range("PathTable: no such id");
+    return m_chunks[id >> chunkBits].load(std::memory_order_relaxed)
+            [id & (chunkSize - 1)];
+}
+
+std::string_view
+PathTable::str(Id id) const
+{
+    return entry(id).str;
+}
+
+size_t
+PathTable::size(Id id) const
+{
+    return entry(id).components.size();
+}
+
+std::string_view
+PathTable::component(Id id, size_t idx) const
+{
+    const auto& entry = this->entry(id);
+    if (idx >= entry.components.size())
+        return {};
+    auto [begin, end] = entry.components[idx];
+    return std::string_view(entry.str).substr(begin, end - begin);
+}
+
+size_t
+PathTable::find(Id id, std::string_view endsWith) const
+{
+    return find(entry(id), endsWith);
+}
+
+std::string_view
+PathTable::before(Id id, std::string_view endsWith) const
+{
+    const auto& entry = this->entry(id);
+    auto idx = find(entry, endsWith);
+    if (idx == npos)
+        return entry.str;
+    return slice(entry, 0, idx);
+}
+
+std::string_view
+PathTable::upto(Id id, std::string_view endsWith) const
+{
+    const auto& entry = this->entry(id);
+    auto idx = find(entry, endsWith);
+    if (idx == npos)
+        return entry.str;
+    return slice(entry, 0, idx + 1);
+}
+
+std::string_view
+PathTable::from(Id id, std::string_view endsWith) const
+{
+    const auto& entry = this->entry(id);
+    auto idx = find(entry, endsWith);
+    if (idx == npos)
+        return entry.str;
+    return slice(entry, idx, entry.components.size());
+}
+
+std::string_view
+PathTable::after(Id id, std::string_view endsWith) const
+{
+    const auto& entry = this->entry(id);
+    auto idx = find(entry, endsWith);
+    if (idx == npos)
+        return entry.str;
+    return slice(entry, idx + 1, entry.components.size());
+}
+
+std::string_view
+PathTable::filename(Id id) const
+{
+    const auto& entry = this->entry(id);
+    if (entry.components.empty())
+        return {};
+    auto [begin, end] = entry.components.back();
+    if (begin == 0 && end == 1 && entry.str.front() == '/')
+        return {}; // only a root
+    return std::string_view(entry.str).substr(begin, end - begin);
+}
+
+std::string_view
+PathTable::parent(Id id) const
+{
+    const auto& entry = this->entry(id);
+    auto components = entry.components.size();
+    if (components <= 1)
+        return components && entry.str.front() == '/'
+                ? std::string_view(entry.str).substr(0, 1)
+                : std::string_view();
+    return slice(entry, 0, components - 1);
+}
+
+bool
+PathTable::startsWith(Id id, std::string_view prefix) const
+{
+    return std::string_view(entry(id).str).substr(0, prefix.size()) == prefix;
+}
+
+PathTable::Id
+PathTable::canonical(Id id)
+{
+    const auto& entry = this->entry(id);
+    auto known = entry.canonical.load(std::memory_order_acquire);
+    if (known != noId)
+        return known;
+
+    // racing threads compute the same answer, whichever stores it is fine
+    std::error_code err;
+    auto canonical = fs::canonical(entry.str, err);
+    Id canonicalId = err ? id : intern(std::string_view(canonical.native()));
+
+    this->entry(canonicalId).canonical.store(
+        canonicalId, std::memory_order_release);
+    entry.canonical.store(canonicalId, std::memory_order_release);
+    return canonicalId;
+}
+
+std::string_view
+PathTable::slice(const Entry& entry, size_t begin, size_t end) const
+{
+    if (begin >= end || begin >= entry.components.size())
+        return {};
+    auto first = entry.components[begin].first;
+    auto last = entry.components[end - 1].second;
+    // a slice ending in the root keeps it, otherwise no separator at
+    // either end
+    if (last == 1 && first == 0 && entry.str.front() == '/')
+        return std::string_view(entry.str).substr(0, 1);
+    return std::string_view(entry.str).substr(first, last - first);
+}
+
+size_t
+PathTable::find(const Entry& entry, std::string_view endsWith) const
+{
+    for (size_t i = 0; i < entry.components.size(); ++i) {
+        auto [begin, end] = entry.components[i];
+        auto name = std::string_view(entry.str).substr(begin, end - begin);
+        if (name.size() >= endsWith.size() &&
+            name.substr(name.size() - endsWith.size()) == endsWith)
+        {
+            return i;
+        }
+    }
+    return npos;
+}
@@ -0,0 +1,110 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef PATHTABLE_H
+#define PATHTABLE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Types.h"
+
+/// Interned paths for the dylib subsystem. Each distinct path is stored
+/// once with its component offsets, so equality is an integer compare and
+/// the extended_path style queries are slices of the stored string.
+/// Safe to use from several threads, only interning takes a lock.
+class PathTable
+{
+public:
+    using Id = uint32_t;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    PathTable();
+    ~PathTable();
+    PathTable(const PathTable&) = delete;
+    PathTable& operator=(const PathTable&) = delete;
+
+    /// the table all of dylib shares
+    static PathTable& shared();
+
+    Id intern(std::string_view path);
+    Id intern(PathRef path) { return intern(std::string_view(path.native())); }
+
+    std::string_view str(Id id) const;
+    Path path(Id id) const { return Path(std::string(str(id))); }
+    /// number of components, a leading / counts as one like in Path
+    size_t size(Id id) const;
+    std::string_view component(Id id, size_t idx) const;
+    /// index of the first component ending with endsWith, or npos
+    size_t find(Id id, std::string_view endsWith) const;
+    bool contains(Id id, std::string_view endsWith) const {
+        return find(id, endsWith) != npos;
+    }
+
+    /// same as their Path counterparts but without building a new path,
+    /// the whole path if no component ends with endsWith
+    std::string_view before(Id id, std::string_view endsWith) const;
+    std::string_view upto(Id id, std::string_view endsWith) const;
+    std::string_view from(Id id, std::string_view endsWith) const;
+    std::string_view after(Id id, std::string_view endsWith) const;
+    std::string_view filename(Id id) const;
+    std::string_view parent(Id id) const;
+
+    /// true if the string of id starts with prefix
+    bool startsWith(Id id, std::string_view prefix) const;
+    /// fs::canonical of id, computed once, id itself if it doesn't exist
+    Id canonical(Id id);
+
+private:
+    /// [begin, end) of a component in Entry::str
+    using Slice = std::pair<uint32_t, uint32_t>;
+    /// never changes once interned, but for canonical set once
+    struct Entry {
+        std::string str;
+        std::vector<Slice> components;
+        mutable std::atomic<Id> canonical;
+    };
+    /// entries live in chunks that never move, so reading one needs
+    /// no lock while others are interned
+    static constexpr size_t chunkBits = 12;
+    static constexpr size_t chunkSize = size_t(1) << chunkBits;
+    static constexpr size_t maxChunks = size_t(1) << 16;
+
+    const Entry& entry(Id id) const;
+    std::string_view slice(const Entry& entry, size_t begin, size_t end) const;
+    size_t find(const Entry& entry, std::string_view endsWith) const;
+
+    std::unique_ptr<std::atomic<Entry*>[]> m_chunks;
+    /// entries below it are complete
+    std::atomic<Id> m_count;
+    std::unordered_map<std::string_view, Id> m_ids;
+    std::mutex m_mutex;
+};
+
+#endif // PATHTABLE_H
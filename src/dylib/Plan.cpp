@@ -0,0 +1,218 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "Plan.h"
+#include <fstream>
+#include <sstream>
+#include "Common.h"
+#include "Utils.h"
+
+namespace {
+    constexpr int planVersion = 1;
+
+    Json::Array pathPairs(const std::vector<std::pair<Path, Path>>& pairs)
+    {
+        Json::Array arr;
+        for (const auto& [from, to] : pairs) {
+            auto pair = std::make_unique<Json::Array>();
+            pair->push(from.string());
+            pair->push(to.string());
+            arr.push(std::move(pair));
+        }
+        return arr;
+    }
+
+    std::vector<std::pair<Path, Path>> pathPairs(const Json::VluBase* vlu)
+    {
+        std::vector<std::pair<Path, Path>> pairs;
+        for (const auto& pair : *vlu->asArray()) {
+            auto arr = pair->asArray();
+            pairs.emplace_back(Path(arr->at(0)->asString()->vlu()),
+                               Path(arr->at(1)->asString()->vlu()));
+        }
+        return pairs;
+    }
+
+    std::vector<std::string> strings(const Json::VluBase* vlu)
+    {
+        std::vector<std::string> strs;
+        for (const auto& str : *vlu->asArray())
+            strs.push_back(str->asString()->vlu());
+        return strs;
+    }
+} // namespace
+
+Json::VluType
+FixupPlan::toJson() const
+{
+    using namespace Json;
+    Array weakPaths;
+    for (const auto& path : weaken)
+        weakPaths.push(path.string());
+
+    return std::make_unique<Object>(ObjInitializer{
+        {"src", String(src.string())},
+        {"dest", String(dest.string())},
+        {"executable", Bool(executable)},
+        {"framework", Bool(framework)},
+        {"copy", Bool(copy)},
+        {"thin", Bool(thin)},
+        {"codesign", Bool(codesign)},
+        {"changes", pathPairs(changes)},
+        {"rpaths", pathPairs(rpaths)},
+        {"weaken", weakPaths},
+        {"store_key", String(storeKey)}
+    });
+}
+
+FixupPlan
+FixupPlan::fromJson(const Json::Object& obj)
+{
+    FixupPlan plan;
+    plan.src = Path(obj.get("src")->asString()->vlu());
+    plan.dest = Path(obj.get("dest")->asString()->vlu());
+    plan.executable = obj.get("executable")->asBool()->vlu();
+    plan.framework = obj.get("framework")->asBool()->vlu();
+    plan.copy = obj.get("copy")->asBool()->vlu();
+    plan.thin = obj.get("thin")->asBool()->vlu();
+    plan.codesign = obj.get("codesign")->asBool()->vlu();
+    plan.changes = pathPairs(obj.get("changes"));
+    plan.rpaths = pathPairs(obj.get("rpaths"));
+    for (const auto& path : strings(obj.get("weaken")))
+        plan.weaken.emplace_back(path);
+    plan.storeKey = obj.get("store_key")->asString()->vlu();
+    return plan;
+}
+
+std::string
+FixupPlan::hashKey(const std::vector<std::string>& thinArchs) const
+{
+    std::stringstream ss;
+    ss << contentKey(src) << dest.filename() << '\n'
+       << executable << codesign << framework << '\n';
+    if (thin) {
+        for (const auto& arch : thinArchs)
+            ss << arch << ',';
+    }
+    ss << '\n';
+    for (const auto& [from, to] : changes)
+        ss << "change " << from << " -> " << to << '\n';
+    for (const auto& [from, to] : rpaths)
+        ss << "rpath " << from << " -> " << to << '\n';
+    for (const auto& path : weaken)
+        ss << "weaken " << path << '\n';
+    return fastHash(ss.str());
+}
+
+Json::VluType
+BundlePlan::toJson() const
+{
+    using namespace Json;
+    Array jsDirs, jsFixups, archs;
+    for (const auto& dir : dirs)
+        jsDirs.push(dir.string());
+    for (const auto& fixup : fixups)
+        jsFixups.push(fixup.toJson());
+    for (const auto& arch : thinArchs)
+        archs.push(arch);
+
+    return std::make_unique<Object>(ObjInitializer{
+        {"version", Number(planVersion)},
+        {"app_bundle", String(appBundle.string())},
+        {"dirs", jsDirs},
+        {"thin_archs", archs},
+        {"fixups", jsFixups}
+    });
+}
+
+BundlePlan
+BundlePlan::load(PathRef file)
+{
+    std::ifstream in{file.string()};
+    if (!in)
+        exitMsg(std::string("Could not read plan ") + file.string());
+    std::stringstream ss;
+    ss << in.rdbuf();
+
+    BundlePlan plan;
+    try {
+        auto jsn = Json::parse(ss.str());
+        auto root = jsn->asObject();
+        auto version = root->get("version")->asNumber()->vlu();
+        if (version != planVersion) {
+            exitMsg(std::string("Plan ") + file.string() +
+                    " is of an unsupported version");
+        }
+        plan.appBundle = Path(root->get("app_bundle")->asString()->vlu());
+        for (const auto& dir : strings(root->get("dirs")))
+            plan.dirs.emplace_back(dir);
+        plan.thinArchs = strings(root->get("thin_archs"));
+        for (const auto& fixup : *root->get("fixups")->asArray())
+            plan.fixups.push_back(FixupPlan::fromJson(*fixup->asObject()));
+    } catch (Json::Exception& e) {
+        exitMsg(std::string("Invalid plan ") + file.string() + ", " + e.what());
+    }
+    return plan;
+}
+
+void
+BundlePlan::save(PathRef file) const
+{
+    std::ofstream out{file.string()};
+    out << toJson()->serialize(2).rdbuf() << "\n";
+    if (!out)
+        exitMsg(std::string("Could not write plan to ") + file.string());
+}
+
+void
+BundlePlan::print(std::ostream& out) const
+{
+    if (!appBundle.empty())
+        out << "create app bundle " << appBundle << "\n";
+    for (const auto& dir : dirs)
+        out << "create directory " << dir << "\n";
+
+    for (const auto& fixup : fixups) {
+        out << "fix " << fixup.dest << "\n";
+        if (!fixup.storeKey.empty())
+            out << "  link from store if there, key " << fixup.storeKey << "\n";
+        if (fixup.copy)
+            out << (fixup.framework ? "  copy framework of " : "  copy from ")
+                << fixup.src << "\n";
+        if (fixup.thin) {
+            out << "  thin to";
+            for (const auto& arch : thinArchs)
+                out << " " << arch;
+            out << "\n";
+        }
+        for (const auto& [from, to] : fixup.changes)
+            out << "  change " << from << " -> " << to << "\n";
+        for (const auto& [from, to] : fixup.rpaths)
+            out << "  rpath " << from << " -> " << to << "\n";
+        for (const auto& path : fixup.weaken)
+            out << "  weaken " << path << "\n";
+        if (fixup.codesign)
+            out << "  codesign\n";
+    }
+}
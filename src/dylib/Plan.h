@@ -0,0 +1,81 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Json.h"
+#include "Types.h"
+
+/// What fixing up one binary takes, decided before anything is touched
+struct FixupPlan {
+    Path src, dest;
+    bool executable = false;
+    /// src is the binary of a framework, the bundle around it is copied
+    bool framework = false;
+    /// dest was missing when planned, applying looks again
+    bool copy = false;
+    /// remove the slices not in BundlePlan::thinArchs
+    bool thin = false;
+    bool codesign = false;
+    /// load paths to change, from the old name to the new
+    std::vector<std::pair<Path, Path>> changes;
+    /// rpaths to change, from the old to the new
+    std::vector<std::pair<Path, Path>> rpaths;
+    /// load paths to make weak
+    std::vector<Path> weaken;
+    /// key of the result in the shared store, empty if not stored
+    std::string storeKey;
+
+    /// @brief What decides the fixed up result: the load commands of src
+    ///   and every edit made to it, hashed
+    /// @param thinArchs The architectures kept when thin
+    std::string hashKey(const std::vector<std::string>& thinArchs) const;
+
+    Json::VluType toJson() const;
+    static FixupPlan fromJson(const Json::Object& obj);
+};
+
+/// Everything a run writes to disk, can be saved and applied later
+/// without collecting dependencies again
+struct BundlePlan {
+    /// the app bundle to create, empty if none
+    Path appBundle;
+    std::vector<Path> dirs;
+    std::vector<std::string> thinArchs;
+    std::vector<FixupPlan> fixups;
+
+    Json::VluType toJson() const;
+    /// exits with a message if file can't be read as a plan
+    static BundlePlan load(PathRef file);
+    void save(PathRef file) const;
+    /// one line per action
+    void print(std::ostream& out) const;
+};
+
+#endif // PLAN_H
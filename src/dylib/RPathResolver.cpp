@@ -0,0 +1,152 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "RPathResolver.h"
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::string_view rpathPrefix = "@rpath/";
+    constexpr std::string_view loaderPrefix = "@loader_path";
+    constexpr std::string_view executablePrefix = "@executable_path";
+
+    /// the rest of path if it starts with the dir prefix, such as
+    /// "@loader_path", or false
+    bool
+    stripDir(std::string_view& path, std::string_view prefix)
+    {
+        if (path.substr(0, prefix.size()) != prefix)
+            return false;
+        auto rest = path.substr(prefix.size());
+        if (!rest.empty() && rest.front() != '/')
+            return false;
+        while (!rest.empty() && rest.front() == '/')
+            rest.remove_prefix(1);
+        path = rest;
+        return true;
+    }
+}
+
+RPathResolver::RPathResolver() :
+    m_rpaths{}, m_resolved{}, m_executable{}, m_lookups{0}
+{}
+
+void
+RPathResolver::addLoader(
+    PathRef loader, const std::vector<Path>& rpaths, bool isExecutable
+) {
+    if (isExecutable && m_executable.empty())
+        m_executable = loader;
+
+    auto& expanded = m_rpaths[loader.string()];
+    expanded.clear();
+    auto loaderDir = loader.parent_path();
+    for (const auto& rpath : rpaths)
+        expanded.push_back(expand(rpath.string(), loaderDir));
+}
+
+Path
+RPathResolver::resolve(PathRef installName, PathRef loader)
+{
+    auto k = key(installName, loader);
+    auto found = m_resolved.find(k);
+    if (found != m_resolved.end())
+        return found->second;
+
+    ++m_lookups;
+    const auto name = installName.string();
+    std::vector<Path> candidates;
+    if (name.compare(0, rpathPrefix.size(), rpathPrefix) == 0) {
+        auto rest = std::string_view(name).substr(rpathPrefix.size());
+        for (const auto& rpath : rpaths(loader))
+            candidates.push_back(rpath / rest);
+        // dyld also searches the rpaths of the executable loading it all
+        if (!m_executable.empty() && m_executable != loader) {
+            for (const auto& rpath : rpaths(m_executable))
+                candidates.push_back(rpath / rest);
+        }
+    } else {
+        candidates.push_back(expand(name, loader.parent_path()));
+    }
+
+    for (const auto& candidate : candidates) {
+        std::error_code err;
+        if (!fs::exists(candidate, err))
+            continue;
+        Path path = fs::canonical(candidate, err);
+        if (err)
+            path = candidate;
+        m_resolved.emplace(std::move(k), path);
+        return path;
+    }
+    return Path();
+}
+
+void
+RPathResolver::remember(PathRef installName, PathRef loader, PathRef path)
+{
+    m_resolved[key(installName, loader)] = path;
+}
+
+const std::vector<Path>&
+RPathResolver::rpaths(PathRef loader) const
+{
+    static const std::vector<Path> none;
+    auto found = m_rpaths.find(loader.string());
+    return found != m_rpaths.end() ? found->second : none;
+}
+
+std::string_view
+RPathResolver::suffix(std::string_view installName)
+{
+    if (installName.substr(0, rpathPrefix.size()) == rpathPrefix)
+        return installName.substr(rpathPrefix.size());
+    if (!stripDir(installName, loaderPrefix))
+        stripDir(installName, executablePrefix);
+    return installName;
+}
+
+Path
+RPathResolver::expand(std::string_view path, PathRef loaderDir) const
+{
+    auto rest = path;
+    if (stripDir(rest, loaderPrefix))
+        return (loaderDir / rest).lexically_normal();
+    if (stripDir(rest, executablePrefix)) {
+        if (m_executable.empty())
+            return Path(std::string(path)); // unknown yet, never exists
+        return (m_executable.parent_path() / rest).lexically_normal();
+    }
+    return Path(std::string(path));
+}
+
+std::string
+RPathResolver::key(PathRef installName, PathRef loader)
+{
+    std::string k = loader.string();
+    k += '\n';
+    k += installName.string();
+    return k;
+}
@@ -0,0 +1,73 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef RPATHRESOLVER_H
+#define RPATHRESOLVER_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Types.h"
+
+/// Resolves @rpath, @loader_path and @executable_path install names the
+/// way dyld would. Each loader's LC_RPATHs are expanded once when added
+/// and every resolution is remembered per loader.
+/// Not thread safe, the owner guards it.
+class RPathResolver
+{
+public:
+    RPathResolver();
+
+    /// @brief Remember the LC_RPATHs of loader, expanded against it
+    /// @param isExecutable The first executable added decides what
+    ///   @executable_path stands for
+    void addLoader(
+        PathRef loader, const std::vector<Path>& rpaths, bool isExecutable);
+    /// @brief Find the file installName refers to when loaded from loader
+    /// @return The canonical path, empty if no candidate exists
+    Path resolve(PathRef installName, PathRef loader);
+    /// @brief Use path for installName from loader from now on, for
+    ///   names found in some other way
+    void remember(PathRef installName, PathRef loader, PathRef path);
+    /// the expanded rpaths of loader
+    const std::vector<Path>& rpaths(PathRef loader) const;
+    /// number of resolutions that had to look on disk
+    size_t lookups() const { return m_lookups; }
+
+    /// installName without its leading @rpath/, @loader_path/ or
+    /// @executable_path/
+    static std::string_view suffix(std::string_view installName);
+
+private:
+    Path expand(std::string_view path, PathRef loaderDir) const;
+    static std::string key(PathRef installName, PathRef loader);
+
+    std::unordered_map<std::string, std::vector<Path>> m_rpaths;
+    std::unordered_map<std::string, Path> m_resolved;
+    Path m_executable;
+    size_t m_lookups;
+};
+
+#endif // RPATHRESOLVER_H
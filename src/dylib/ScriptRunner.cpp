@@ -27,17 +27,27 @@ THE SOFTWARE.
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include <array>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <cassert>
 #include <cstring>
 
 #include "ScriptRunner.h"
+#include "Common.h"
 #include "Utils.h"
-#include "ScriptRunner.h"
 #include "Settings.h"
 #include "DylibBundler.h"
+#include "ThreadPool.h"
 
 std::string handleSubProcessReq(const std::string& request);
 Json::VluType handleJsonReq(Json::VluType jsn);
@@ -51,7 +61,7 @@ public:
     {}
     ~File() {
         if (m_file)
-            close(fileno(m_file));
+            fclose(m_file);
     }
     constexpr FILE* &file() { return m_file; }
 private:
@@ -61,7 +71,7 @@ private:
 class Pipes {
 public:
     Pipes():
-        fds{-1},
+        fds{-1, -1, -1, -1},
         bakStdOut{dup(STDOUT_FILENO)},
         stdout{fdopen(bakStdOut, "w")}
     {}
@@ -69,10 +79,9 @@ public:
         closeAll();
     }
     void closeAll() {
-        for (const auto& fd : fds) {
-            if (fd > -1) ::close(fd);
-        }
-        fclose(this->stdout);
+        closeFds(fds);
+        if (this->stdout) fclose(this->stdout);
+        this->stdout = nullptr;
     }
     bool create() {
         for (std::size_t i = 0; i < fds.size(); i += 2) {
@@ -80,6 +89,10 @@ public:
                 std::cerr << "Failed to create pipes to process\n";
                 return false;
             }
+            // other scripts forked meanwhile must not inherit our ends,
+            // or we never see eof. dup2 clears it for the script itself
+            fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[i+1], F_SETFD, FD_CLOEXEC);
         }
         return true;
     }
@@ -88,9 +101,13 @@ public:
     constexpr int &parentIn() { return fds[0]; }
     constexpr int &parentOut() { return fds[3]; }
 
-    void closeFds(std::array<int, 2> closeFds) {
+    template<std::size_t N>
+    void closeFds(std::array<int, N> closeFds) {
         for(const auto& fd : closeFds) {
-           close(fd);
+            if (fd < 0) continue;
+            close(fd);
+            for (auto& mine : fds)
+                if (mine == fd) mine = -1;
         }
     }
     void asScript() {
@@ -99,6 +116,12 @@ public:
     void asParent() {
         closeFds(std::array<int, 2>{scriptIn(), scriptOut()});
     }
+    /// give away fd to ie. a File, we should no longer close it
+    int release(int &fd) {
+        int ret = fd;
+        fd = -1;
+        return ret;
+    }
     std::array<int, 4> fds;
     int bakStdOut;
     FILE* stdout;
@@ -112,7 +135,7 @@ bool scriptLogic(
     auto makeDup = [&](int fd, int fd2) {
         if (dup2(fd, fd2) < 0) {
             fprintf(pipes.stdout, "Failed to duplicate fd: %d\n", fd2);
-            exit(1);
+            _exit(127);
         }
     };
     makeDup(pipes.scriptIn(), STDIN_FILENO);
@@ -130,7 +153,9 @@ bool scriptLogic(
     fprintf(pipes.stdout,
             "Failed to run %s error: %s with error code: %d\n",
             script.data(), strerror(errno), res);
-    exit(1);
+    // a forked copy of a threaded process, running atexit handlers
+    // might deadlock on locks held by threads not copied
+    _exit(127);
 }
 
 bool parentRead(FILE *in, std::string& buf) {
@@ -143,13 +168,13 @@ bool parentRead(FILE *in, std::string& buf) {
     }
     auto siz = sz.u32native();
     //std::cout << "Read " << siz << " bytes from script. << \n";
-    auto b = std::make_unique<char[]>(siz+1);
-    if ((n = fread(b.get(), 1, siz, in)) != siz) {
+    // reuse buf's capacity between messages, no allocation per read
+    buf.resize(siz);
+    if ((n = fread(buf.data(), 1, siz, in)) != siz) {
         if (n != 0)
             std::cerr << "Failed to read " << siz << " bytes\n";
         return false;
     }
-    buf = b.get();
     return true;
 }
 
@@ -179,111 +204,513 @@ bool parentValueResponse(FILE *out, Json::VluType res) {
     return true;
 }
 
-bool parentLoop(Pipes& pipes) {
-    File in{pipes.parentIn(), "r"},
-         out{pipes.parentOut(), "w"};
+// A parsed request from script
+struct Request {
+    enum Encoding { TextReq, JsonReq, MsgPackReq };
+    Json::VluType jsn;
+    // set when the script tagged the request with an "id",
+    // it is then answered out of order, whenever it is done
+    Json::VluType id;
+    Encoding encoding = TextReq;
+};
 
-    for (std::string input; parentRead(in.file(), input); input.clear()) {
-        if (!input.size()) continue;
-        Json::VluType jsn;
-        bool resInJson = false;
-        if (input[0] == '{' || input[0] == '[') {
+bool parentParse(const std::string& input, Request& req) {
+    try {
+        if (Json::MsgPack::isMsgPack(input)) {
+            // binary fast path, respond in the same encoding
+            req.jsn = Json::MsgPack::unpack(input);
+            req.encoding = Request::MsgPackReq;
+        } else if (input[0] == '{' || input[0] == '[') {
             // support both json and normal commands
-            try {
-                jsn = Json::parse(input);
-                resInJson = true;
-                //std::cout << jsn->serialize(2).str() << "\n";
-            } catch (Json::Exception& e) {
-                std::cerr << e.what() << "\n";
-                return false;
-            } catch (...) {}
-        }
-        try {
-            if (!jsn)
-                jsn = Json::parse(std::string("[\"") + input + "\"]");
-
-            auto res = handleJsonReq(std::move(jsn));
-            if (resInJson) {
-                auto str = res->serialize().str();
-                if (!parentWrite(out.file(), str))
-                    return false;
-            } else if (!parentValueResponse(out.file(), std::move(res)))
-                return false;
-        } catch (Json::Exception& e) {
-            std::cerr << e.what() << "\n";
+            req.jsn = Json::parse(input);
+            req.encoding = Request::JsonReq;
+        } else
+            req.jsn = Json::parse(std::string("[\"") + input + "\"]");
+    } catch (Json::Exception& e) {
+        std::cerr << e.what() << "\n";
+        return false;
+    }
+
+    if (req.encoding != Request::TextReq && req.jsn->isObject()) {
+        auto obj = req.jsn->asObject();
+        if (obj->contains("id"))
+            req.id = obj->remove("id");
+    }
+    return true;
+}
+
+bool parentAnswer(FILE *out, std::mutex& writeMtx, Request& req) {
+    Json::VluType res;
+    std::string error;
+    try {
+        res = handleJsonReq(std::move(req.jsn));
+    } catch (std::exception& e) {
+        error = e.what(); // Json::Exception among them
+    } catch (std::string& e) {
+        error = e;
+    } catch (...) {
+        // would terminate us on the pool thread waiting for it
+        error = "Unknown error handling request";
+    }
+
+    if (!error.empty()) {
+        std::cerr << error << "\n";
+        // a pipelining script waits for every id, tell it what went wrong
+        if (!req.id) return false;
+        auto obj = std::make_unique<Json::Object>();
+        obj->set("error", std::make_unique<Json::String>(error));
+        res = std::move(obj);
+    }
+    if (req.id)
+        res->asObject()->set("id", std::move(req.id));
+
+    std::string output;
+    if (req.encoding == Request::MsgPackReq)
+        Json::MsgPack::pack(res.get(), output);
+    else if (req.encoding == Request::JsonReq)
+        output = res->serialize().str();
+
+    std::lock_guard<std::mutex> lock{writeMtx};
+    if (req.encoding == Request::TextReq)
+        return parentValueResponse(out, std::move(res));
+    return parentWrite(out, output);
+}
+
+/// serve requests until script closes its end.
+/// In a worker session exitStatus is set when script sends it
+bool parentLoop(int inFd, int outFd, int* exitStatus = nullptr) {
+    File in{inFd, "r"},
+         out{outFd, "w"};
+
+    std::mutex writeMtx;
+    std::vector<std::future<bool>> pending;
+    auto waitPending = [&]() {
+        bool ok = true;
+        for (auto& fut : pending)
+            ok = fut.get() && ok;
+        pending.clear();
+        return ok;
+    };
+
+    std::string input;
+    for (; parentRead(in.file(), input); input.clear()) {
+        if (!input.size()) continue;
+        auto req = std::make_shared<Request>();
+        if (!parentParse(input, *req)) {
+            waitPending();
             return false;
-        } catch (std::string e) {
-            std::cerr << e << "\n";
+        }
+
+        if (exitStatus && req->jsn->isObject() &&
+            req->jsn->asObject()->contains("exit_status"))
+        {
+            // worker session is over, script has returned
+            auto vlu = req->jsn->asObject()->get("exit_status");
+            *exitStatus = vlu->isNumber()
+                ? static_cast<int>(vlu->asNumber()->vlu()) : 1;
+            return waitPending();
+        }
+
+        if (req->id) {
+            // don't wait for it, keep reading while the pool works
+            pending.emplace_back(ThreadPool::shared().submit([&, req]() {
+                return parentAnswer(out.file(), writeMtx, *req);
+            }));
+            continue;
+        }
+
+        // untagged requests are answered in order,
+        // after all tagged requests sent before them
+        if (!waitPending() ||
+            !parentAnswer(out.file(), writeMtx, *req))
+        {
             return false;
         }
     }
-    return true;
+    return waitPending();
+}
+
+bool serveScriptRequests(int inFd, int outFd) {
+    return parentLoop(inFd, outFd);
 }
 
-bool parentLogic(Pipes& pipes, int pidScript, int pidTimeout) {
+// -------------------------------------------------------------------
+
+Script::Script(PathRef path,
+               const std::vector<std::string> args,
+               int timeoutMs
+):
+    m_path{path},
+    m_args{args},
+    m_after{},
+    m_parallel{false},
+    m_python{false},
+    m_succeeded{false},
+    m_exited{false},
+    m_killed{false},
+    m_timeoutMs{timeoutMs},
+    m_pid{-1},
+    m_status{0},
+    m_sock{-1},
+    m_started{},
+    m_pipes{},
+    m_server{},
+    m_serverDone{false},
+    m_serverOk{false}
+{
+    readHeader();
+}
 
-    bool res = parentLoop(pipes);
+Script::~Script()
+{
+    if (m_sock > -1) {
+        kill();
+        if (m_server.joinable())
+            m_server.join();
+        close(m_sock);
+    }
+    if (m_pid > 0) {
+        kill();
+        if (!m_exited)
+            waitpid(m_pid, &m_status, 0);
+    }
+    if (m_server.joinable())
+        m_server.join();
+}
 
-    kill(pidTimeout, SIGKILL);
-    kill(pidScript, SIGKILL);
-    waitpid(pidTimeout, nullptr, 0);
-    int wstatus;
-    waitpid(pidScript, &wstatus, 0);
-    if (WIFEXITED(wstatus)) {
-        return WEXITSTATUS(wstatus) == 0;
+void
+Script::readHeader()
+{
+    // ie: # dylibbundler: parallel after=qtdeploy.py timeout=60
+    std::ifstream file{m_path.string()};
+    std::string line;
+    m_python = m_path.extension() == ".py";
+    for (int i = 0; i < 30 && std::getline(file, line); ++i) {
+        if (i == 0 && line.rfind("#!", 0) == 0)
+            m_python = line.find("python") != line.npos;
+        auto pos = line.find("dylibbundler:");
+        if (line.empty() || line[0] != '#' || pos == line.npos)
+            continue;
+
+        for (const auto& tok : tokenize(line.substr(pos + 13), " \t")) {
+            if (tok == "parallel")
+                m_parallel = true;
+            else if (tok.rfind("after=", 0) == 0) {
+                for (const auto& name : tokenize(tok.substr(6), ","))
+                    m_after.push_back(name);
+            } else if (tok.rfind("timeout=", 0) == 0)
+                m_timeoutMs = std::atoi(tok.c_str() + 8) * 1000;
+            else
+                std::cerr << "* Unknown option '" << tok << "' in script "
+                          << m_path << "\n";
+        }
     }
-    return res;
 }
 
-bool runScript(
-    std::string_view script
-) {
-    Pipes pipes;
-    if (!pipes.create())
+bool
+Script::isNamed(std::string_view name) const
+{
+    return m_path.filename() == name || m_path.stem() == name;
+}
+
+int
+connectWorker(PathRef socketPath)
+{
+    sockaddr_un addr{};
+    auto str = socketPath.string();
+    if (str.size() >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, str.c_str(), sizeof(addr.sun_path) - 1);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0)
+        return -1;
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+bool
+Script::startSession(int notifyFd)
+{
+    // tell worker which script to run, then serve it as usual
+    auto run = std::make_unique<Json::Object>();
+    run->set("run", std::make_unique<Json::String>(
+        std::filesystem::absolute(m_path).string()));
+    auto args = std::make_unique<Json::Array>();
+    for (const auto& arg : m_args)
+        args->push(std::make_unique<Json::String>(arg));
+    run->set("args", std::move(args));
+
+    auto str = run->serialize().str();
+    bigendian_t sz{static_cast<uint32_t>(str.size())};
+    if (write(m_sock, sz.u32arr, 4) != 4 ||
+        write(m_sock, str.data(), str.size()) !=
+            static_cast<ssize_t>(str.size()))
+    {
+        std::cerr << "Failed to start session with script worker\n";
+        close(m_sock);
+        m_sock = -1;
         return false;
+    }
+
+    // parentLoop owns these, we keep m_sock to be able to shut it down
+    int inFd = dup(m_sock), outFd = dup(m_sock);
+    fcntl(inFd, F_SETFD, FD_CLOEXEC);
+    fcntl(outFd, F_SETFD, FD_CLOEXEC);
+    m_started = std::chrono::steady_clock::now();
+    m_server = std::thread([this, notifyFd, inFd, outFd]() {
+        int exitStatus = 1;
+        m_serverOk = parentLoop(inFd, outFd, &exitStatus) &&
+                     exitStatus == 0;
+        m_serverDone = true;
+        char c = 0;
+        if (write(notifyFd, &c, 1) < 0) {} // supervisor wakes on timeout
+    });
+    return true;
+}
 
-    int pidScript = fork();
-    if (pidScript < 0) {
+bool
+Script::start(int notifyFd)
+{
+    // worker is a python interpreter, it can't run anything else
+    if (!Settings::scriptWorker().empty() && m_python) {
+        m_sock = connectWorker(Settings::scriptWorker());
+        if (m_sock > -1)
+            return startSession(notifyFd);
+        std::cerr << "* Script worker at " << Settings::scriptWorker()
+                  << " not reachable, starting " << m_path
+                  << " directly\n";
+    }
+
+    m_pipes = std::make_unique<Pipes>();
+    if (!m_pipes->create())
+        return false;
+
+    // build argv before fork, the child of a threaded process
+    // should not allocate
+    std::vector<std::string> args{m_path.string()};
+    args.insert(args.end(), m_args.begin(), m_args.end());
+    std::vector<char*> argv;
+    for (auto& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    m_pid = fork();
+    if (m_pid < 0) {
         std::cerr << "Failed to fork to subprocess\n";
         return false;
-    } else if (pidScript == 0) {
-        // this is the child becomes script
-        pipes.asScript();
-        auto scriptBuf = std::make_unique<char[]>(script.size()+1);
-        strncpy(scriptBuf.get(), script.data(), script.size());
-
-        auto path = std::filesystem::absolute(
-            Settings::appBundlePath()).string();
-        auto pathBuf = std::make_unique<char[]>(path.size()+1);
-        strncpy(pathBuf.get(), path.data(), path.size());
-
-        char* const argv[3] = {
-            scriptBuf.get(),
-            pathBuf.get(),
-            nullptr
-        };
-        return scriptLogic(pipes, script, argv);
-    }
-
-    // we are the parent, now set up timeout
-    int pidTimeout = fork();
-    if (pidTimeout == -1) {
-        std::cerr << "Failed to fork timeout process\n";
+    } else if (m_pid == 0) {
+        // this is the child becomes script, in its own process group
+        // so a timeout kills anything it has started too
+        setpgid(0, 0);
+        m_pipes->asScript();
+        scriptLogic(*m_pipes, argv[0], argv.data());
+    }
+
+    setpgid(m_pid, m_pid);
+    m_pipes->asParent();
+    m_started = std::chrono::steady_clock::now();
+    m_server = std::thread([this, notifyFd]() {
+        m_serverOk = parentLoop(
+            m_pipes->release(m_pipes->parentIn()),
+            m_pipes->release(m_pipes->parentOut()));
+        m_serverDone = true;
+        char c = 0;
+        if (write(notifyFd, &c, 1) < 0) {} // supervisor wakes on timeout
+    });
+    return true;
+}
+
+bool
+Script::poll()
+{
+    if (m_sock > -1) {
+        // worker session, exit status comes through the protocol
+        if (!m_serverDone) return false;
+        m_server.join();
+        close(m_sock);
+        m_sock = -1;
+        m_succeeded = m_serverOk;
+        return true;
+    }
+    if (m_pid < 0) return true;
+    if (!m_exited && waitpid(m_pid, &m_status, WNOHANG) == m_pid)
+        m_exited = true;
+
+    // failed request, script will be stuck waiting for its answer
+    if (m_serverDone && !m_serverOk && !m_exited)
+        kill();
+
+    if (!m_exited || !m_serverDone)
         return false;
-    } else if (pidTimeout == 0) {
-        // timeout child process
-        pipes.closeAll();
-        sleep(20); // 20 sec timeout
-        std::cerr << "* Script timeout, killed script: "
-                  << script << "\n";
-        kill(pidScript, SIGKILL);
-        exit(0);
-    }
-
-    pipes.asParent();
-    return parentLogic(pipes, pidScript, pidTimeout);
+
+    m_server.join();
+    m_pid = -1;
+    m_succeeded = m_serverOk && WIFEXITED(m_status) &&
+                  WEXITSTATUS(m_status) == 0;
+    return true;
+}
+
+void
+Script::kill()
+{
+    if (m_sock > -1 && !m_killed) {
+        // worker ends the session when it sees eof
+        m_killed = true;
+        shutdown(m_sock, SHUT_RDWR);
+        return;
+    }
+    if (m_pid < 0 || m_killed) return;
+    m_killed = true;
+    ::kill(-m_pid, SIGKILL);
+    ::kill(m_pid, SIGKILL);
+}
+
+int
+Script::msLeft() const
+{
+    if ((m_pid < 0 && m_sock < 0) || m_killed || m_timeoutMs <= 0)
+        return -1;
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_started).count();
+    return std::max(0, m_timeoutMs - static_cast<int>(elapsed));
+}
+
+bool
+Script::settling() const
+{
+    return m_pid > 0 && (m_exited || m_serverDone);
 }
 
+// -------------------------------------------------------------------
+
+namespace {
+
+struct Prerequisite {
+    size_t idx;
+    bool required; // declared with after=, skip us if it fails
+};
+
+} // namespace
+
+bool superviseScripts(std::vector<std::unique_ptr<Script>>& scripts,
+                      unsigned jobs)
+{
+    enum State { Waiting, Running, Succeeded, Failed, Skipped };
+    const auto count = scripts.size();
+    std::vector<State> state(count, Waiting);
+    std::vector<std::vector<Prerequisite>> waitFor(count);
+
+    for (size_t i = 0; i < count; ++i) {
+        for (const auto& name : scripts[i]->after()) {
+            auto found = std::find_if(scripts.begin(), scripts.end(),
+                [&](const auto& sc) { return sc->isNamed(name); });
+            if (found == scripts.end())
+                std::cerr << "* Script " << scripts[i]->path()
+                          << " depends on unknown script " << name << "\n";
+            else if (found - scripts.begin() != static_cast<long>(i))
+                waitFor[i].push_back({size_t(found - scripts.begin()), true});
+        }
+        // non parallel scripts runs alone, in the order given
+        for (size_t j = 0; j < i; ++j) {
+            if (!scripts[i]->parallel() || !scripts[j]->parallel())
+                waitFor[i].push_back({j, false});
+        }
+    }
+
+    int notify[2];
+    if (pipe(notify) == -1) {
+        std::cerr << "Failed to create pipes to supervise scripts\n";
+        return false;
+    }
+    fcntl(notify[0], F_SETFD, FD_CLOEXEC);
+    fcntl(notify[1], F_SETFD, FD_CLOEXEC);
+    fcntl(notify[0], F_SETFL, O_NONBLOCK);
+
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    unsigned running = 0;
+    bool allOk = true;
+
+    for (;;) {
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] != Waiting) continue;
+            bool ready = true;
+            for (const auto& pre : waitFor[i]) {
+                auto preState = state[pre.idx];
+                if (preState == Waiting || preState == Running)
+                    ready = false;
+                else if (pre.required && preState != Succeeded) {
+                    std::cerr << "* Skipping script " << scripts[i]->path()
+                              << ", " << scripts[pre.idx]->path()
+                              << " did not succeed\n";
+                    state[i] = Skipped;
+                    break;
+                }
+            }
+            if (!ready || state[i] != Waiting || running >= jobs)
+                continue;
+
+            std::cout << "* Running script " << scripts[i]->path() << std::endl;
+            if (scripts[i]->start(notify[1])) {
+                state[i] = Running;
+                ++running;
+            } else
+                state[i] = Failed;
+        }
+
+        if (running == 0) break;
+
+        int timeout = -1;
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] != Running) continue;
+            auto left = scripts[i]->msLeft();
+            // only one of exit and eof seen, the other is close
+            if (scripts[i]->settling())
+                left = left < 0 ? 20 : std::min(left, 20);
+            if (left >= 0 && (timeout < 0 || left < timeout))
+                timeout = left;
+        }
+
+        pollfd pfd{notify[0], POLLIN, 0};
+        ::poll(&pfd, 1, timeout);
+        char buf[64];
+        while (read(notify[0], buf, sizeof(buf)) > 0) {}
+
+        for (size_t i = 0; i < count; ++i) {
+            if (state[i] != Running) continue;
+            auto& script = scripts[i];
+            if (script->poll()) {
+                --running;
+                state[i] = script->succeeded() ? Succeeded : Failed;
+                if (script->succeeded())
+                    std::cout << "Finished script " << script->path() << "\n";
+                else
+                    std::cerr << "* Script failed " << script->path() << "\n";
+            } else if (script->msLeft() == 0) {
+                std::cerr << "* Script timeout, killed script: "
+                          << script->path() << "\n";
+                script->kill();
+            }
+        }
+    }
+
+    close(notify[0]);
+    close(notify[1]);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (state[i] == Waiting)
+            std::cerr << "* Script " << scripts[i]->path()
+                      << " never ran, circular dependencies?\n";
+        allOk = allOk && state[i] == Succeeded;
+    }
+    return allOk;
+}
 
 void runPythonScripts_afterHook() {
     auto& scripts = Settings::appBundleScripts();
@@ -292,19 +719,18 @@ void runPythonScripts_afterHook() {
     std::cout << "\n* Running App bundle scripts on "
               << Settings::appBundlePath() << std::endl;
 
-    auto root = std::make_unique<Json::Object>();
-    root->set("settings", Settings::toJson());
+    auto path = std::filesystem::absolute(
+        Settings::appBundlePath()).string();
 
-    namespace fs = std::filesystem;
-
-    // run all executable python scripts i bundleScripts path
-    for (auto script : scripts) {
-        std::cout<<"* Running script " << script << std::endl;
-        if (runScript(script.c_str())) {
-            std::cout << "Finished script " << script << "\n";
-        }
+    std::vector<std::unique_ptr<Script>> toRun;
+    for (const auto& script : scripts) {
+        toRun.emplace_back(std::make_unique<Script>(
+            script, std::vector<std::string>{path},
+            static_cast<int>(Settings::scriptTimeout()) * 1000));
     }
 
+    superviseScripts(toRun, Settings::jobs());
+
     std::cout << "* Done running all appBundle scripts" << std::endl;
 }
 
@@ -317,8 +743,12 @@ struct ProtocolItem {
         const char* cmd, Json::Object* retObj, Json::VluBase* args)
     > cbType;
     cbType cb;
-    ProtocolItem(const char* name, const char* description, cbType cb):
-        name{name}, description{description}, cb{cb}
+    // may run concurrently with other parallel items,
+    // all others runs alone
+    bool parallel;
+    ProtocolItem(const char* name, const char* description, cbType cb,
+                 bool parallel = false):
+        name{name}, description{description}, cb{cb}, parallel{parallel}
     {}
 };
 
@@ -327,12 +757,23 @@ Json::VluType listProtocol();
 const ProtocolItem protocol[] {
     {
         "get_protocol",
-        "Gets info on all protocol commands a script can use",
+        "Gets info on all protocol commands a script can use. "
+        "A json request object with an \"id\" key is answered out of "
+        "order with that id, so many requests can be sent without waiting",
         [](const char *cmd, Json::Object* obj, Json::VluBase* args){
             (void)args;
             obj->set(cmd, listProtocol());
         }
     },
+    {
+        "binary_encoding",
+        "Name of the binary encoding this host understands. Requests sent "
+        "in that encoding are answered in it, ie: msgpack",
+        [](const char* cmd, Json::Object* obj, Json::VluBase* args){
+            (void)args;
+            obj->set(cmd, std::make_unique<Json::String>("msgpack"));
+        }
+    },
     {
         "all_settings",
         "Gets all settings in a complete bundle",
@@ -453,7 +894,8 @@ const ProtocolItem protocol[] {
             auto dylib = DylibBundler::instance();
             auto res = dylib->fixPathsInBinAndCodesign(args->asArray());
             obj->set(cmd, std::move(res));
-        }
+        },
+        true
     }
 };
 
@@ -475,7 +917,16 @@ void handleCmd(std::string_view cmd, Json::VluBase* params, Json::Object* retObj
     for (std::size_t i = 0; i < sizeof(protocol)/sizeof(protocol[0]); ++i) {
         const auto& prot = protocol[i];
         if (prot.name == cmd) {
-            prot.cb(cmd.data(), retObj, params);
+            // pipelined requests runs on the pool,
+            // only let the ones meant for it run side by side
+            static std::shared_mutex protocolMtx;
+            if (prot.parallel) {
+                std::shared_lock<std::shared_mutex> lock{protocolMtx};
+                prot.cb(cmd.data(), retObj, params);
+            } else {
+                std::unique_lock<std::shared_mutex> lock{protocolMtx};
+                prot.cb(cmd.data(), retObj, params);
+            }
             return;
         }
     }
@@ -530,11 +981,17 @@ std::string handleSubProcessReq(const std::string& request)
         if (!jsn || jsn->isNull())
             throw "Not a json Request";
         return handleJsonReq(std::move(jsn))->serialize().str();
-    } catch (Json::Exception& e) {
+    } catch (std::exception& e) {
         std::cerr << e.what() << "\n";
         return sendError(e.what());
     } catch (std::string& e) {
         std::cerr << e << "\n";
         return sendError(e.c_str());
+    } catch (const char* e) {
+        std::cerr << e << "\n";
+        return sendError(e);
+    } catch (...) {
+        std::cerr << "Unknown error handling request\n";
+        return sendError("Unknown error handling request");
     }
 }
\ No newline at end of file
@@ -27,22 +27,77 @@ THE SOFTWARE.
 
 #include <vector>
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "Types.h"
+
+class Pipes;
 
 void runPythonScripts_afterHook();
 
+/// Serve script requests read from inFd, answers go to outFd.
+/// Returns when inFd is closed, false on a broken request or pipe
+bool serveScriptRequests(int inFd, int outFd);
+
+/// A bundle script, run as a child process talking to us through pipes.
+/// Its header may hold a line such as:
+///   # dylibbundler: parallel after=qtdeploy.py timeout=60
+/// parallel: may run alongside other parallel scripts
+/// after: these scripts must succeed before this one starts
+/// timeout: seconds before it is killed, 0 is never
+/// When Settings::scriptWorker() is set the script is instead run as a
+/// session in that already running worker, see scripts/worker.py
 class Script {
 public:
-  Script(std::string_view path,
+  Script(PathRef path,
         const std::vector<std::string> args,
         int timeoutMs = 20000);
   ~Script();
+  /// @brief Fork and exec the script, its requests are served on a thread
+  /// @param notifyFd Written to when the script closes its pipes
+  bool start(int notifyFd);
+  /// Reap script if it has finished, true when done
+  bool poll();
+  /// Kill script and everything it has started
+  void kill();
+  /// Milliseconds until timeout, -1 if none
+  int msLeft() const;
+  /// Exited or closed its pipes, but not yet both
+  bool settling() const;
+  /// True if name is our filename or filename without extension
+  bool isNamed(std::string_view name) const;
+
+  PathRef path() const { return m_path; }
+  const std::vector<std::string>& after() const { return m_after; }
+  bool parallel() const { return m_parallel; }
+  bool succeeded() const { return m_succeeded; }
+
 private:
-  const std::string_view m_path;
+  void readHeader();
+  bool startSession(int notifyFd);
+
+  const Path m_path;
   const std::vector<std::string> m_args;
+  std::vector<std::string> m_after;
+  bool m_parallel, m_python, m_succeeded, m_exited, m_killed;
   int m_timeoutMs;
-  int m_pidScript, m_pidTimeout;
-  int m_fd[2];
+  int m_pid, m_status;
+  int m_sock; // worker session
+
+  std::chrono::steady_clock::time_point m_started;
+  std::unique_ptr<Pipes> m_pipes;
+  std::thread m_server;
+  std::atomic<bool> m_serverDone;
+  bool m_serverOk;
 };
 
+/// Run scripts, at most jobs at a time, each after its prerequisites.
+/// A single poll loop reaps them and kills the ones that times out.
+/// True if all succeeded, 0 jobs is one per cpu
+bool superviseScripts(std::vector<std::unique_ptr<Script>>& scripts,
+                      unsigned jobs);
+
 
 #endif // SCRIPT_RUNNER_H
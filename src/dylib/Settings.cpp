@@ -26,8 +26,12 @@ THE SOFTWARE.
 #include <filesystem>
 #include <iostream>
 #include <vector>
+#include <fstream>
+#include <map>
 #include <sstream>
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <regex>
 #include <unistd.h>
 #ifdef _WIN32
@@ -38,6 +42,7 @@ THE SOFTWARE.
 #include "Settings.h"
 #include "Common.h"
 #include "Utils.h"
+#include "PathTable.h"
 
 namespace fs = std::filesystem;
 
@@ -81,7 +86,7 @@ void initAppBundleScripts(int argc, const char* argv[]) {
         scPaths = pscPaths;
 
     auto paths = tokenize(scPaths, ":");
-    std::vector<std::string> skip{"__init__.py", "common.py"};
+    std::vector<std::string> skip{"__init__.py", "common.py", "worker.py"};
 
     for (auto &path : paths) {
         for (auto& entry : std::filesystem::directory_iterator(path)) {
@@ -318,6 +323,29 @@ bool shouldOnlyRunScripts() {
     return scriptsOnly;
 }
 
+unsigned toUnsigned(std::string_view vlu, const char* what)
+{
+    char* end = nullptr;
+    std::string str{vlu};
+    auto n = std::strtoul(str.c_str(), &end, 10);
+    if (str.empty() || *end != '\0' || n > UINT_MAX)
+        exitMsg(std::string("Expected a number for ") + what +
+                ", got '" + str + "'");
+    return static_cast<unsigned>(n);
+}
+
+unsigned script_timeout = 20;
+unsigned scriptTimeout() { return script_timeout; }
+void setScriptTimeout(std::string_view seconds) {
+    script_timeout = toUnsigned(seconds, "script timeout");
+}
+
+Path script_worker;
+PathRef scriptWorker() { return script_worker; }
+void setScriptWorker(std::string_view socketPath) {
+    script_worker = socketPath;
+}
+
 Path appBundleContentsDir() {
     return appBundlePath() / "Contents";
 }
@@ -339,6 +367,44 @@ bool mayAskUser = true;
 bool shouldAskUser() { return mayAskUser; }
 void preventAskUser() { mayAskUser = false; }
 
+Path resolve_map_file;
+std::map<std::string, Path> resolve_map;
+Path resolveMapFile() { return resolve_map_file; }
+void setResolveMap(std::string_view file) {
+    resolve_map_file = Path(file);
+    std::ifstream in{resolve_map_file.string()};
+    if (!in)
+        exitMsg("\nError : Could not read resolve map "
+                + resolve_map_file.string() + "\n");
+    std::string line;
+    for (int lineNr = 1; std::getline(in, line); ++lineNr) {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        auto nameEnd = line.find_first_of(" \t", first);
+        auto dirStart = nameEnd == std::string::npos
+                      ? nameEnd : line.find_first_not_of(" \t", nameEnd);
+        if (dirStart == std::string::npos) {
+            std::stringstream ss;
+            ss << "\nError : " << resolve_map_file << ":" << lineNr
+               << " expected '<library name> <dir>'\n";
+            exitMsg(ss.str());
+        }
+        auto dirEnd = line.find_last_not_of(" \t\r");
+        auto name = line.substr(first, nameEnd - first);
+        Path dir{line.substr(dirStart, dirEnd + 1 - dirStart)};
+        resolve_map[name] = dir;
+        // install names are looked up by their file name as well
+        resolve_map.emplace(Path(name).filename().string(), dir);
+    }
+}
+Path resolveMapping(std::string_view name) {
+    auto found = resolve_map.find(std::string(name));
+    if (found == resolve_map.end())
+        found = resolve_map.find(Path(name).filename().string());
+    return found != resolve_map.end() ? found->second : Path();
+}
+
 Path inside_path;
 Path inside_lib_path(){
     if (inside_path.empty()) {
@@ -368,13 +434,21 @@ void ignore_prefix(Path prefix)
     prefixes_to_ignore.push_back(prefix);
 }
 
-bool isSystemLibrary(PathRef prefix)
+namespace {
+bool isSystemId(PathTable::Id id)
 {
-    if(prefix.upto("lib") == Path("/usr/lib")) return true;
-    if(prefix.upto("Library") == Path("/System/Library")) return true;
+    auto& table = PathTable::shared();
+    if(table.upto(id, "lib") == "/usr/lib") return true;
+    if(table.upto(id, "Library") == "/System/Library") return true;
 
     return false;
 }
+} // namespace
+
+bool isSystemLibrary(PathRef prefix)
+{
+    return isSystemId(PathTable::shared().intern(prefix));
+}
 
 bool isPrefixIgnored(PathRef prefix)
 {
@@ -393,11 +467,13 @@ bool isPrefixIgnored(PathRef prefix)
 
 bool blacklistedPath(PathRef prefix)
 {
+    auto& table = PathTable::shared();
+    auto id = table.intern(prefix);
     if(!Settings::bundleFrameworks() &&
-        prefix.before(".framework") != prefix)
+        table.contains(id, ".framework"))
     { return true; }
-    if(prefix.before("@executable_path") == "") return true;
-    if(isSystemLibrary(prefix)) return true;
+    if(table.before(id, "@executable_path").empty()) return true;
+    if(isSystemId(id)) return true;
     if(isPrefixIgnored(prefix)) return true;
 
     return false;
@@ -415,6 +491,51 @@ bool is_verbose = false;
 void setVerbose(bool on) { is_verbose = on; }
 bool verbose() { return is_verbose; }
 
+bool prune_unused = false;
+bool pruneUnused() { return prune_unused; }
+void setPruneUnused(bool on) { prune_unused = on; }
+
+unsigned nr_jobs = 0;
+unsigned jobs() { return nr_jobs; }
+void setJobs(std::string_view jobs) { nr_jobs = toUnsigned(jobs, "jobs"); }
+
+std::vector<std::string> thin_archs;
+const std::vector<std::string>& thinArchs() { return thin_archs; }
+void setThinArchs(std::string_view archs) {
+    thin_archs.clear();
+    while (!archs.empty()) {
+        auto end = std::min(archs.find(','), archs.size());
+        if (end)
+            thin_archs.emplace_back(archs.substr(0, end));
+        archs.remove_prefix(std::min(end + 1, archs.size()));
+    }
+}
+
+Path store_dir;
+Path storeDir() { return store_dir; }
+void setStoreDir(std::string_view dir) { store_dir = Path(dir); }
+
+bool verify_bundle = false;
+bool verifyBundle() { return verify_bundle; }
+void setVerifyBundle(bool on) { verify_bundle = on; }
+
+Path graph_file;
+Path graphFile() { return graph_file; }
+void setGraphFile(std::string_view file) { graph_file = Path(file); }
+
+bool dry_run = false;
+Path dry_run_file;
+bool dryRun() { return dry_run; }
+Path dryRunFile() { return dry_run_file; }
+void setDryRun(std::string_view file) {
+    dry_run = true;
+    dry_run_file = Path(file);
+}
+
+Path apply_plan;
+Path applyPlan() { return apply_plan; }
+void setApplyPlan(std::string_view file) { apply_plan = Path(file); }
+
 bool bundle_frameworks = false;
 bool bundleFrameworks() { return bundle_frameworks; }
 void setBundleFrameworks(bool on) { bundle_frameworks = on; }
@@ -429,6 +550,9 @@ std::unique_ptr<Json::Object> toJson() {
     Array searchIn;
     for (const auto& path : searchPaths())
         searchIn.push(path.string());
+    Array thin;
+    for (const auto& arch : thinArchs())
+        thin.push(arch);
 
     auto obj = std::make_unique<Object>(ObjInitializer{
         {"can_overwrite_files", Bool(canOverwriteFiles())},
@@ -436,10 +560,20 @@ std::unique_ptr<Json::Object> toJson() {
         {"can_create_dir", Bool(canCreateDir())},
         {"can_codesign", Bool(canCodesign())},
         {"bundle_libs", Bool(bundleLibs())},
+        {"prune_unused", Bool(pruneUnused())},
         {"bundle_frameworks", Bool(bundleFrameworks())},
         {"framework_dir", String(frameworkDir().string())},
         {"create_app_bundle", Bool(createAppBundle())},
         {"verbose", Bool(verbose())},
+        {"jobs", Number(static_cast<int>(jobs()))},
+        {"thin_archs", thin},
+        {"store_dir", String(storeDir().string())},
+        {"verify_bundle", Bool(verifyBundle())},
+        {"graph_file", String(graphFile().string())},
+        {"dry_run", Bool(dryRun())},
+        {"apply_plan", String(applyPlan().string())},
+        {"resolve_map", String(resolveMapFile().string())},
+        {"script_timeout", Number(static_cast<int>(scriptTimeout()))},
         {"lib_folder", String(destFolder().string())},
         {"prefix_tools", String(prefixTools())},
         {"app_bundle_contents_dir", String(appBundleContentsDir().string())},
@@ -105,6 +105,12 @@ bool shouldPreventScripts();
 void setOnlyRunScripts();
 /// If we should only run scripts
 bool shouldOnlyRunScripts();
+/// Seconds before a script is killed, 0 is never
+unsigned scriptTimeout();
+void setScriptTimeout(std::string_view seconds);
+/// Unix socket of a running script worker, empty to fork each script
+PathRef scriptWorker();
+void setScriptWorker(std::string_view socketPath);
 /// Get the path to Contents directory in bundle
 ///  example: name.app/Contents
 Path appBundleContentsDir();
@@ -121,6 +127,12 @@ bool setInfoPlist(std::string_view plist);
 /// Prevent us from asking user for input
 bool shouldAskUser();
 void preventAskUser();
+/// File of '<library name> <dir>' lines that say where missing
+/// libraries are, used before asking or failing
+Path resolveMapFile();
+void setResolveMap(std::string_view file);
+/// the dir the resolve map gives for name or its filename, empty if none
+Path resolveMapping(std::string_view name);
 
 void addFileToFix(std::string_view path);
 std::vector<Files> srcFiles();
@@ -136,6 +148,40 @@ const std::vector<Path>& searchPaths();
 bool verbose();
 void setVerbose(bool on);
 
+/// Leave out dylibs no bundled binary imports a symbol from
+bool pruneUnused();
+void setPruneUnused(bool on);
+
+/// Number of parallel jobs, 0 means one per cpu
+unsigned jobs();
+void setJobs(std::string_view jobs);
+
+/// Architectures to keep in bundled binaries, empty keeps all
+const std::vector<std::string>& thinArchs();
+/// comma separated, ie "arm64" or "arm64,x86_64"
+void setThinArchs(std::string_view archs);
+
+/// Directory of the shared store of fixed up dylibs, empty when unused
+Path storeDir();
+void setStoreDir(std::string_view dir);
+
+/// Check that all bundled binaries resolve their dylibs within the bundle
+bool verifyBundle();
+void setVerifyBundle(bool on);
+
+/// Where to write the dependency graph, empty when not wanted
+Path graphFile();
+void setGraphFile(std::string_view file);
+
+/// Only plan, print the plan or save it to dryRunFile()
+bool dryRun();
+Path dryRunFile();
+void setDryRun(std::string_view file);
+
+/// A plan saved by a dry run to apply instead of collecting
+Path applyPlan();
+void setApplyPlan(std::string_view file);
+
 /// insert settings into rootObj
 std::unique_ptr<Json::Object> toJson();
 
@@ -23,9 +23,13 @@ THE SOFTWARE.
 */
 
 #include <iostream>
+#include <atomic>
+#include <exception>
 #include <stdlib.h>
 #include <filesystem>
 #include <regex>
+#include <map>
+#include <mutex>
 #if defined(_WIN32) && !defined(popen)
 # define popen = _popen;
 # define pclose = _pclose;
@@ -37,6 +41,57 @@ THE SOFTWARE.
 using namespace Tools;
 namespace fs = std::filesystem;
 
+namespace {
+
+struct BatchedBinary
+{
+  std::unique_ptr<MachO::MachOLoader> loader;
+  bool changed = false;
+};
+
+/// binaries with an open InstallName::Batch
+std::mutex batchMutex;
+std::map<std::string, BatchedBinary> batches;
+
+/// apply edit to every object in bin and write it back, or leave
+/// it for the batch to write. Slices in a fat binary are edited in parallel
+void
+editBinary(PathRef bin, const char* what,
+           const std::function<bool(MachO::mach_object&)>& edit)
+{
+  BatchedBinary own;
+  BatchedBinary* binary = &own;
+  {
+    std::lock_guard<std::mutex> lock{batchMutex};
+    auto found = batches.find(bin.string());
+    if (found != batches.end())
+      binary = &found->second;
+  }
+  if (!binary->loader)
+    binary->loader = std::make_unique<MachO::MachOLoader>(bin, false);
+
+  auto& loader = *binary->loader;
+  if (!loader.isFat() && !loader.isObject())
+    exitMsg(std::string("Failed to open ") + bin.string() +
+            " not a mach-o object\n");
+
+  std::atomic<bool> ok{true};
+  loader.forEachObject([&](MachO::mach_object& obj) {
+    // rather compact the load commands than fail for lack of padding
+    obj.setCompactLoadCommands(true);
+    if (!edit(obj))
+      ok = false;
+  });
+
+  if (!ok)
+    exitMsg(std::string("Could not ") + what + " on " + bin.string());
+  binary->changed = true;
+  if (binary == &own && !loader.write(bin, true))
+    exitMsg(std::string("Could not write ") + bin.string());
+}
+
+} // namespace
+
 
 // --------------------------------------------------
 
@@ -139,30 +194,9 @@ InstallName::add_rpath(PathRef rpath, PathRef bin) const
   if (!m_cmd.empty()) {
     addRPathExternal(rpath, bin);
   } else {
-    MachO::MachOLoader loader(bin);
-
-    auto change = [&](MachO::mach_object& obj)->void {
-      if (obj.addRPath(rpath))
-        exitMsg(std::string("Could not add rpath on ") + bin.string());
-    };
-
-    auto write = [&]()->void {
-      if (!loader.write(bin, true))
-        exitMsg(std::string("Could not add rpath on ") + bin.string());
-    };
-
-    if (loader.isFat()) {
-      for (auto& slice : loader.fatObject()->objects())
-        change(slice);
-      write();
-
-    } else if (loader.isObject()) {
-      change(*loader.object());
-      write();
-    } else {
-      exitMsg(std::string("Failed to open ") + bin.string() +
-              " not a mach-o object\n");
-    }
+    editBinary(bin, "add rpath", [&](MachO::mach_object& obj) {
+      return obj.addRPath(rpath);
+    });
   }
 }
 
@@ -187,30 +221,9 @@ InstallName::delete_rpath(PathRef rpath, PathRef bin) const
   if (!m_cmd.empty()) {
     deleteRpathExternal(rpath, bin);
   } else {
-    MachO::MachOLoader loader(bin);
-
-    auto change = [&](MachO::mach_object& obj)->void {
-      if (obj.removeRPath(rpath))
-        exitMsg(std::string("Could not delete_rpath on ") + bin.string());
-    };
-
-    auto write = [&]()->void {
-      if (!loader.write(bin, true))
-        exitMsg(std::string("Could not delete_rpath on ") + bin.string());
-    };
-
-    if (loader.isFat()) {
-      for (auto& slice : loader.fatObject()->objects())
-        change(slice);
-      write();
-
-    } else if (loader.isObject()) {
-      change(*loader.object());
-      write();
-    } else {
-      exitMsg(std::string("Failed to open ") + bin.string() +
-              " not a mach-o object\n");
-    }
+    editBinary(bin, "delete_rpath", [&](MachO::mach_object& obj) {
+      return obj.removeRPath(rpath);
+    });
   }
 }
 
@@ -239,30 +252,12 @@ InstallName::change(
     changeExternal(oldPath, newPath, bin);
 
   } else {
-    MachO::MachOLoader loader(bin);
-
-    auto change = [&](MachO::mach_object& obj)->void {
-      if (obj.changeDylibPaths(oldPath, newPath))
-        exitMsg(std::string("Could not change lib path on ") + bin.string());
-    };
-
-    auto write = [&]()->void {
-      if (!loader.write(bin, true))
-        exitMsg(std::string("Could not change lib path on ") + bin.string());
-    };
-
-    if (loader.isFat()) {
-      for (auto& slice : loader.fatObject()->objects())
-        change(slice);
-      write();
-
-    } else if (loader.isObject()) {
-      change(*loader.object());
-      write();
-    } else {
-      exitMsg(std::string("Failed to open ") + bin.string() +
-              " not a mach-o object\n");
-    }
+    // like install_name_tool, not finding oldPath is not an error,
+    // not having room for newPath is
+    editBinary(bin, "change lib path", [&](MachO::mach_object& obj) {
+      return obj.changeDylibPaths(oldPath, newPath) ||
+             obj.paddingShortfall() == 0;
+    });
   }
 }
 
@@ -294,30 +289,9 @@ InstallName::id(PathRef id, PathRef bin) const
      if (!m_cmd.empty()) {
       idExternal(id, bin);
     } else {
-      MachO::MachOLoader loader(bin);
-
-      auto change = [&](MachO::mach_object& obj)->void {
-        if (obj.changeId(id))
-          exitMsg(std::string("Could not change id on ") + bin.string());
-      };
-
-      auto write = [&]()->void {
-        if (!loader.write(bin, true))
-          exitMsg(std::string("Could not change id on ") + bin.string());
-      };
-
-      if (loader.isFat()) {
-        for (auto& slice : loader.fatObject()->objects())
-          change(slice);
-        write();
-
-      } else if (loader.isObject()) {
-        change(*loader.object());
-        write();
-      } else {
-        exitMsg(std::string("Failed to open ") + bin.string() +
-                " not a mach-o object\n");
-      }
+      editBinary(bin, "change id", [&](MachO::mach_object& obj) {
+        return obj.changeId(id);
+      });
     }
   }
 }
@@ -343,31 +317,76 @@ InstallName::rpath(PathRef from, PathRef to, PathRef bin) const
   if (!m_cmd.empty()) {
     rpathExternal(from, to, bin);
   } else {
-    MachO::MachOLoader loader(bin);
+    editBinary(bin, "change rpath", [&](MachO::mach_object& obj) {
+      return obj.changeRPath(from, to);
+    });
+  }
+}
 
-    auto change = [&](MachO::mach_object& obj)->void {
-      if (obj.changeRPath(from, to))
-        exitMsg(std::string("Could not change rpath on ") + bin.string());
-    };
+/// Make bin load paths weakly
+void
+InstallName::weaken(const std::vector<Path>& paths, PathRef bin) const
+{
+  // already weak or not loaded at all is fine
+  editBinary(bin, "weaken dylib", [&](MachO::mach_object& obj) {
+    for (const auto& path : paths) {
+      if (obj.weakenDylib(path) && m_verbose)
+        std::cout << "weakened load of " << path << " in " << bin << "\n";
+    }
+    return true;
+  });
+}
 
-    auto write = [&]()->void {
-      if (!loader.write(bin, true))
-        exitMsg(std::string("Could not change rpath on ") + bin.string());
-    };
+InstallName::Batch::Batch(PathRef bin):
+  m_uncaught{std::uncaught_exceptions()}
+{
+  if (!defaultCmd.empty())
+    return;
+  std::lock_guard<std::mutex> lock{batchMutex};
+  if (batches.emplace(bin.string(), BatchedBinary{}).second)
+    m_bin = bin.string();
+}
 
-    if (loader.isFat()) {
-      for (auto& slice : loader.fatObject()->objects())
-        change(slice);
-      write();
+InstallName::Batch::~Batch()
+{
+  if (m_bin.empty())
+    return;
+
+  // an edit failed half way, leave bin as it was
+  if (std::uncaught_exceptions() > m_uncaught) {
+    std::lock_guard<std::mutex> lock{batchMutex};
+    batches.erase(m_bin);
+    return;
+  }
+  auto bin = m_bin;
+  if (!finish())
+    std::cerr << "Could not write " << bin << std::endl;
+}
 
-    } else if (loader.isObject()) {
-      change(*loader.object());
-      write();
-    } else {
-      exitMsg(std::string("Failed to open ") + bin.string() +
-              " not a mach-o object\n");
-    }
+void
+InstallName::Batch::commit()
+{
+  auto bin = m_bin;
+  if (!finish())
+    exitMsg(std::string("Could not write ") + bin);
+}
+
+bool
+InstallName::Batch::finish()
+{
+  if (m_bin.empty())
+    return true;
+
+  BatchedBinary binary;
+  {
+    std::lock_guard<std::mutex> lock{batchMutex};
+    auto found = batches.find(m_bin);
+    binary = std::move(found->second);
+    batches.erase(found);
   }
+  Path bin{m_bin};
+  m_bin.clear();
+  return !binary.changed || binary.loader->write(bin, true);
 }
 
 void
@@ -436,7 +455,7 @@ OTool::scanBinary(PathRef bin)
       rpaths.emplace_back(Path(path));
   };
 
-  MachO::MachOLoader loader(bin);
+  MachO::MachOLoader loader(bin, false);
   if (loader.isFat()) {
     for (auto& slice : loader.fatObject()->objects())
       getFromObj(slice);
@@ -27,6 +27,7 @@ THE SOFTWARE.
 
 #include <string>
 #include <sstream>
+#include <vector>
 #include <functional>
 #include "Types.h"
 
@@ -75,6 +76,33 @@ public:
   void id(PathRef id, PathRef bin) const;
   /// Change rpath path name
   void rpath(PathRef from, PathRef to, PathRef bin) const;
+  /// Make bin load paths weakly, so it runs without them.
+  /// install_name_tool can't do this, always done natively
+  void weaken(const std::vector<Path>& paths, PathRef bin) const;
+
+  /// While a Batch for bin lives, native edits of bin are made to one
+  /// copy in memory, which is written back once by commit().
+  /// Does nothing when an external install_name_tool is used.
+  class Batch
+  {
+  public:
+    explicit Batch(PathRef bin);
+    /// writes what commit() didn't, unless an exception ends the batch
+    ~Batch();
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+
+    /// write the edits back, exits with a message if that fails
+    void commit();
+
+  private:
+    /// ends the batch, false if writing the edits failed
+    bool finish();
+
+    std::string m_bin;
+    int m_uncaught;
+  };
+
 private:
   void changeExternal(PathRef oldPath, PathRef newPath, PathRef bin) const;
   void rpathExternal(PathRef from, PathRef to, PathRef bin) const;
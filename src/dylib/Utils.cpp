@@ -26,6 +26,8 @@ THE SOFTWARE.
 #include "Utils.h"
 #include "Settings.h"
 #include "Common.h"
+#include "MachO.h"
+#include "ThreadPool.h"
 #include <cstdlib>
 #include <unistd.h>
 #include <iostream>
@@ -86,6 +88,239 @@ void copyFile(PathRef from, PathRef to)
     setWritable(to, true);
 }
 
+void copyFramework(PathRef from, PathRef to,
+                   const std::vector<std::string>& keep)
+{
+    std::vector<std::string> names{keep};
+    for (auto name : {"Resources", "Libraries", "Helpers"})
+        names.emplace_back(name);
+
+    std::vector<fs::path> dirs;
+    std::vector<std::pair<fs::path, fs::path>> links, files;
+    std::error_code err;
+
+    // sort out the tree at src, symlinks are never followed
+    const auto collect = [&](const fs::path& src, const fs::path& dest) {
+        auto status = fs::symlink_status(src, err);
+        if (err) return;
+        if (fs::is_symlink(status)) {
+            links.emplace_back(src, dest);
+        } else if (fs::is_directory(status)) {
+            dirs.push_back(dest);
+            for (auto it = fs::recursive_directory_iterator(src, err);
+                 !err && it != fs::recursive_directory_iterator();
+                 it.increment(err))
+            {
+                auto target = dest / it->path().lexically_relative(src);
+                if (it->is_symlink())
+                    links.emplace_back(it->path(), target);
+                else if (it->is_directory())
+                    dirs.push_back(target);
+                else
+                    files.emplace_back(it->path(), target);
+            }
+        } else {
+            files.emplace_back(src, dest);
+        }
+    };
+    // the entries of src that are named in names
+    const auto collectNamed = [&](const fs::path& src, const fs::path& dest) {
+        for (const auto& name : names) {
+            if (fs::exists(fs::symlink_status(src / name, err)))
+                collect(src / name, dest / name);
+        }
+    };
+
+    auto versions = from / "Versions";
+    if (fs::is_directory(fs::symlink_status(versions, err))) {
+        // only the current version, old ones would be removed anyway
+        std::string current{"Current"};
+        auto currentLink = versions / "Current";
+        if (fs::is_symlink(currentLink, err)) {
+            current = fs::read_symlink(currentLink, err).string();
+            links.emplace_back(currentLink, to / "Versions" / "Current");
+        }
+        dirs.push_back(to / "Versions" / current);
+        collectNamed(versions / current, to / "Versions" / current);
+    }
+    collectNamed(from, to);
+
+    for (const auto& dir : dirs) {
+        fs::create_directories(dir, err);
+        if (err)
+            exitMsg("\nFailed to create " + dir.string() + "\n", err);
+    }
+    for (const auto& [src, dest] : links) {
+        fs::remove(dest, err);
+        fs::copy_symlink(src, dest, err);
+        if (err)
+            exitMsg("\nFailed to copy symlink " + src.string() + "\n", err);
+    }
+    ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+        std::error_code err;
+        const auto& [src, dest] = files[i];
+        fs::copy_file(src, dest, fs::copy_options::update_existing, err);
+        if (err) {
+            std::stringstream ss;
+            ss << "\nFailed to copy " << src << " to: " << dest
+               << ", error: " << err.message() << "\n";
+            exitMsg(ss.str());
+        }
+    });
+}
+
+namespace {
+
+constexpr uint64_t fnvOffset = 14695981039346656037ull;
+constexpr uint64_t fnvPrime = 1099511628211ull;
+
+uint64_t fnv1a(const char* bytes, size_t size, uint64_t hash = fnvOffset)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(bytes[i]);
+        hash *= fnvPrime;
+    }
+    return hash;
+}
+
+std::string toHex(uint64_t hash)
+{
+    char buf[17] = {0};
+    snprintf(buf, sizeof(buf), "%016llx",
+             static_cast<unsigned long long>(hash));
+    return buf;
+}
+
+/// false only for a mach-o without any slice we thin to
+bool hasThinArch(PathRef file, const std::vector<std::string>& archs)
+{
+    MachO::MachOLoader loader{file, false};
+    std::vector<const MachO::mach_object*> objs;
+    if (loader.isFat()) {
+        for (const auto& obj : loader.fatObject()->objects())
+            objs.push_back(&obj);
+    } else if (loader.isObject()) {
+        objs.push_back(loader.object());
+    } else {
+        return true; // let thinning report it
+    }
+
+    return std::any_of(objs.begin(), objs.end(), [&](const auto obj) {
+        const auto hdr = obj->header32();
+        return std::any_of(archs.begin(), archs.end(), [&](const auto& arch) {
+            return MachO::archMatches(hdr->cputype(), hdr->cpusubtype(), arch);
+        });
+    });
+}
+
+} // namespace
+
+std::string contentKey(PathRef file)
+{
+    MachO::MachOLoader loader{file, false};
+    std::vector<MachO::mach_object*> objs;
+    if (loader.isFat()) {
+        for (auto& obj : loader.fatObject()->objects())
+            objs.push_back(&obj);
+    } else if (loader.isObject())
+        objs.push_back(loader.object());
+
+    // edited copies of one build keep its UUID, their load commands differ
+    std::string key;
+    for (const auto obj : objs) {
+        auto uuid = obj->uuid();
+        if (uuid.empty())
+            return fastHash(file);
+        uint64_t hash = fnvOffset;
+        for (const auto& cmd : obj->loadCommands()) {
+            uint32_t head[2] = {cmd.cmd(), cmd.cmdsize()};
+            hash = fnv1a(reinterpret_cast<const char*>(head),
+                         sizeof(head), hash);
+            if (cmd.bytes && cmd.cmdsize() > sizeof(MachO::load_command))
+                hash = fnv1a(cmd.bytes.get(),
+                             cmd.cmdsize() - sizeof(MachO::load_command),
+                             hash);
+        }
+        key += uuid + ":" + toHex(hash) + "\n";
+    }
+    return key.empty() ? fastHash(file) : key;
+}
+
+std::string fastHash(PathRef file)
+{
+    std::ifstream in{file.string(), std::ios::binary};
+    std::vector<char> buf(1 << 16);
+    uint64_t hash = fnvOffset;
+    while (in) {
+        in.read(buf.data(), buf.size());
+        hash = fnv1a(buf.data(), in.gcount(), hash);
+    }
+    return toHex(hash);
+}
+
+std::string fastHash(std::string_view text)
+{
+    return toHex(fnv1a(text.data(), text.size()));
+}
+
+void linkOrCopy(PathRef from, PathRef to)
+{
+    // link beside `to` first, renaming it in place can't be seen half done
+    std::error_code err;
+    fs::create_directories(to.parent_path(), err);
+    std::string tmpl = to.string() + ".XXXXXX";
+    int fd = mkstemp(tmpl.data());
+    if (fd >= 0) {
+        close(fd);
+        fs::remove(tmpl, err);
+        fs::create_hard_link(from, tmpl, err);
+        if (err) // not on the same device
+            fs::copy_file(from, tmpl, err);
+        if (!err)
+            fs::rename(tmpl, to, err);
+    }
+    if (fd < 0 || err) {
+        std::error_code ignore;
+        fs::remove(tmpl, ignore);
+        std::stringstream ss;
+        ss << "\n\nError : Could not link " << from << " to " << to;
+        if (err)
+            ss << " err: " << err.message();
+        exitMsg(ss.str() + "\n");
+    }
+}
+
+void thinFile(PathRef from, PathRef to,
+              const std::vector<std::string>& archs)
+{
+    std::stringstream ss;
+    if (from != to && !Settings::canOverwriteFiles() && fs::exists(to)) {
+        ss << "\n\nError : File " << to <<" already exists. "
+           << "Remove it or enable overwriting.";
+        exitMsg(ss.str());
+    }
+
+    // a universal tool or plugin for another arch still has to run
+    if (!hasThinArch(from, archs)) {
+        std::cerr << "\n/!\\ WARNING : " << from << " has none of the "
+                  << "architectures to thin to, keeping it as is\n";
+        if (from != to)
+            copyFile(from, to);
+        setWritable(to, true);
+        return;
+    }
+
+    std::error_code err;
+    fs::create_directories(to.parent_path(), err);
+    if (err || !MachO::mach_fat_object::thin(from, to, archs)) {
+        ss << "\n\nError : An error occurred while trying to thin "
+           << "file " << from << " to " << to << "\n";
+        exitMsg(ss.str());
+    }
+
+    setWritable(to, true);
+}
+
 std::string system_get_output(std::string_view cmd)
 {
     FILE * command_output = nullptr;
@@ -148,12 +383,23 @@ Path getUserInputDirForFile(PathRef filename)
         }
     }
 
-    if (!Settings::shouldAskUser()) {
-        std::stringstream msg;
-        msg << "/!\\ ERROR file " << filename << " was'nt found.\n";
-        exitMsg(msg.str());
+    auto mapped = Settings::resolveMapping(filename.string());
+    if (!mapped.empty()) {
+        if (fs::exists(mapped / filename)) {
+            if (Settings::verbose())
+                std::cout << "  * Resolved " << filename << " to " << mapped
+                          << " from the resolve map" << std::endl;
+            Settings::addSearchPath(mapped);
+            return mapped;
+        }
+        std::cerr << "/!\\ WARNING : resolve map gives " << mapped
+                  << " for " << filename << ", but it isn't there\n";
     }
 
+    // collected and reported together once every binary is scanned
+    if (!Settings::shouldAskUser())
+        return Path();
+
     int i = 10;
     while (i--)
     {
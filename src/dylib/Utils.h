@@ -39,12 +39,37 @@ class Library;
 
 void setWritable(PathRef file, bool writable);
 void copyFile(PathRef from, PathRef to);
+/// @brief Copy the parts of a framework bundle that are bundled: the
+///   current version's binary, Resources, Libraries and Helpers, and the
+///   symlinks to them. Symlinks are recreated, files copied in parallel.
+/// @param keep Top level names to copy besides those above, such as the
+///   framework's binary
+void copyFramework(PathRef from, PathRef to,
+                   const std::vector<std::string>& keep);
+/// copy from to to with only the archs slices,
+/// from and to may be the same file
+void thinFile(PathRef from, PathRef to,
+              const std::vector<std::string>& archs);
+
+/// Identifies what a binary contains: the LC_UUIDs and load commands
+/// of its slices, or a hash of the whole file when a slice has no UUID
+std::string contentKey(PathRef file);
+/// 64 bit FNV-1a of the file's bytes, as 16 hex digits
+std::string fastHash(PathRef file);
+/// 64 bit FNV-1a of text, as 16 hex digits
+std::string fastHash(std::string_view text);
+/// Atomically make `to` the same file as `from`,
+/// a hardlink when possible, otherwise a copy
+void linkOrCopy(PathRef from, PathRef to);
 
 /// executes a command in the native shell and returns output in string
 std::string system_get_output(std::string_view cmd);
 
 /// like 'system', runs a command on the system shell, but also prints the command to stdout.
 int systemp(std::string_view cmd);
+/// @brief The dir where file is, from the search paths, the resolve map
+///   or the user
+/// @return empty if not found and the user may not be asked
 Path getUserInputDirForFile(PathRef file);
 
 /// try to create a folder
@@ -29,6 +29,8 @@ THE SOFTWARE.
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <cstring>
+#include <climits>
 #include "Json.h"
 
 using namespace Json;
@@ -233,6 +235,7 @@ VluBase::shallowCopy(VluBase *to, const VluBase& other) const
     if (!to->m_vlu.objVlu) to->m_vlu.objVlu = std::make_unique<ObjType>();
     else to->m_vlu.objVlu->clear();
 
+    to->m_vlu.objVlu->reserve(other.m_vlu.objVlu->size());
     for (const auto& entry : *other.m_vlu.objVlu) {
       VluType subItm = copyCreate(*entry.second);
       subItm->setParent(to);
@@ -268,7 +271,7 @@ VluBase::copyCreate(const VluBase& vlu) const
   }
   case ObjectType: {
     auto itm = std::make_unique<Object>(vlu.m_parent);
-
+    itm->m_vlu.objVlu->reserve(vlu.m_vlu.objVlu->size());
     for (const auto& entry : *vlu.m_vlu.objVlu) {
       VluType subItem = copyCreate(*entry.second);
       subItem->setParent(itm.get());
@@ -809,6 +812,7 @@ Object::Object(ObjInitializer args) :
   VluBase(ObjectType, nullptr)
 {
   m_vlu.objVlu = std::make_unique<ObjType>();
+  m_vlu.objVlu->reserve(args.size());
   for (const auto& entry : args) {
     auto itm = copyCreate(entry.second);
     itm->setParent(this);
@@ -883,7 +887,7 @@ Object::set(const char* key, std::unique_ptr<VluBase> vlu)
 {
   if (isChildOf(vlu.get())) throw Exception("Cyclic dependency");
   vlu->setParent(this);
-  m_vlu.objVlu->insert_or_assign(std::string(key), std::move(vlu));
+  m_vlu.objVlu->insert_or_assign(key, std::move(vlu));
 }
 
 VluBase*
@@ -1020,8 +1024,8 @@ Parser::parseNumber() {
   while ((ch = get()) != -1) {
     if (ch <= '9' && ch > '0')
       baseBuf += ch;
-    else if (ch == '0' && (prev != 0 || peek() == '.'))
-      baseBuf += ch;
+    else if (ch == '0' && (prev != 0 || !isdigit(peek())))
+      baseBuf += ch; // no leading zeros, but a lone 0 is fine
     else if (ch == '.' && !hasDot) {
       baseBuf += ch;
       hasDot = true;
@@ -1247,3 +1251,209 @@ Json::serialize(const VluBase* jsonVlu, int indent)
 {
   return jsonVlu->serialize(indent).str();
 }
+
+// --------------------------------------------------------------------
+
+namespace {
+
+void
+packBE(std::string& out, uint8_t marker, uint64_t vlu, size_t len)
+{
+  out += static_cast<char>(marker);
+  for (size_t i = len; i > 0; --i)
+    out += static_cast<char>((vlu >> ((i - 1) * 8)) & 0xFF);
+}
+
+void
+packLen(std::string& out, size_t len, uint8_t fixMarker, size_t fixMax,
+        uint8_t marker8, uint8_t marker16, uint8_t marker32)
+{
+  if (len <= fixMax)
+    out += static_cast<char>(fixMarker | len);
+  else if (marker8 && len <= 0xFF)
+    packBE(out, marker8, len, 1);
+  else if (len <= 0xFFFF)
+    packBE(out, marker16, len, 2);
+  else if (len <= 0xFFFFFFFF)
+    packBE(out, marker32, len, 4);
+  else
+    throw Exception("To large value to pack");
+}
+
+} // namespace
+
+void
+MsgPack::pack(const VluBase* jsonVlu, std::string& out)
+{
+  switch (jsonVlu->type()) {
+  case VluBase::NullType:
+    out += static_cast<char>(0xc0);
+    break;
+  case VluBase::BoolType:
+    out += static_cast<char>(jsonVlu->asBool()->vlu() ? 0xc3 : 0xc2);
+    break;
+  case VluBase::NumberType: {
+    float num = jsonVlu->asNumber()->vlu();
+    bool inRange = num >= INT32_MIN && num < INT32_MAX;
+    int32_t intVlu = inRange ? static_cast<int32_t>(num) : 0;
+    if (inRange && intVlu == num) {
+      if (intVlu >= 0 && intVlu < 0x80)
+        out += static_cast<char>(intVlu);        // positive fixint
+      else if (intVlu < 0 && intVlu >= -32)
+        out += static_cast<char>(intVlu);        // negative fixint
+      else
+        packBE(out, 0xd2, static_cast<uint32_t>(intVlu), 4);
+    } else {
+      uint32_t bits;
+      memcpy(&bits, &num, sizeof(bits));
+      packBE(out, 0xca, bits, 4);
+    }
+  } break;
+  case VluBase::StringType: {
+    const auto& str = *jsonVlu->asString();
+    packLen(out, str.length(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+    out += str.vlu();
+  } break;
+  case VluBase::ArrayType: {
+    auto arr = jsonVlu->asArray();
+    packLen(out, arr->length(), 0x90, 15, 0, 0xdc, 0xdd);
+    for (const auto& itm : *arr)
+      pack(itm.get(), out);
+  } break;
+  case VluBase::ObjectType: {
+    auto obj = jsonVlu->asObject();
+    packLen(out, obj->length(), 0x80, 15, 0, 0xde, 0xdf);
+    for (const auto& entry : *obj) {
+      packLen(out, entry.first.size(), 0xa0, 31, 0xd9, 0xda, 0xdb);
+      out += entry.first;
+      pack(entry.second.get(), out);
+    }
+  } break;
+  default: assert(false && "unhandled type");
+  }
+}
+
+std::string
+MsgPack::pack(const VluBase* jsonVlu)
+{
+  std::string out;
+  pack(jsonVlu, out);
+  return out;
+}
+
+VluType
+MsgPack::unpack(std::string_view src)
+{
+  MsgPack unpacker{src};
+  auto vlu = unpacker.unpackValue();
+  if (unpacker.m_pos != src.size())
+    throw ParseException("Trailing bytes after MsgPack value");
+  return vlu;
+}
+
+MsgPack::MsgPack(std::string_view src) :
+  m_src{src}, m_pos{0}, m_depth{0}
+{}
+
+std::string_view
+MsgPack::take(size_t len)
+{
+  if (m_pos + len > m_src.size())
+    throw ParseException("Unexpected end of MsgPack data");
+  auto view = m_src.substr(m_pos, len);
+  m_pos += len;
+  return view;
+}
+
+uint64_t
+MsgPack::readBE(size_t len)
+{
+  uint64_t vlu = 0;
+  for (auto ch : take(len))
+    vlu = (vlu << 8) | static_cast<uint8_t>(ch);
+  return vlu;
+}
+
+VluType
+MsgPack::unpackValue()
+{
+  uint8_t marker = static_cast<uint8_t>(take(1)[0]);
+
+  auto str = [&](size_t len) -> VluType {
+    return std::make_unique<String>(std::string(take(len)));
+  };
+  auto num = [](auto vlu) -> VluType {
+    return std::make_unique<Number>(static_cast<float>(vlu));
+  };
+
+  if (marker < 0x80) return num(marker);
+  if (marker >= 0xe0) return num(static_cast<int8_t>(marker));
+  if ((marker & 0xf0) == 0x80) return unpackObject(marker & 0x0f);
+  if ((marker & 0xf0) == 0x90) return unpackArray(marker & 0x0f);
+  if ((marker & 0xe0) == 0xa0) return str(marker & 0x1f);
+
+  switch (marker) {
+  case 0xc0: return std::make_unique<Null>();
+  case 0xc2: return std::make_unique<Bool>(false);
+  case 0xc3: return std::make_unique<Bool>(true);
+  case 0xca: {
+    uint32_t bits = static_cast<uint32_t>(readBE(4));
+    float f; memcpy(&f, &bits, sizeof(f));
+    return num(f);
+  }
+  case 0xcb: {
+    uint64_t bits = readBE(8);
+    double d; memcpy(&d, &bits, sizeof(d));
+    return num(d);
+  }
+  case 0xcc: return num(readBE(1));
+  case 0xcd: return num(readBE(2));
+  case 0xce: return num(readBE(4));
+  case 0xcf: return num(readBE(8));
+  case 0xd0: return num(static_cast<int8_t>(readBE(1)));
+  case 0xd1: return num(static_cast<int16_t>(readBE(2)));
+  case 0xd2: return num(static_cast<int32_t>(readBE(4)));
+  case 0xd3: return num(static_cast<int64_t>(readBE(8)));
+  case 0xd9: return str(readBE(1));
+  case 0xda: return str(readBE(2));
+  case 0xdb: return str(readBE(4));
+  case 0xdc: return unpackArray(readBE(2));
+  case 0xdd: return unpackArray(readBE(4));
+  case 0xde: return unpackObject(readBE(2));
+  case 0xdf: return unpackObject(readBE(4));
+  default: {
+    std::stringstream msg;
+    msg << "Unsupported MsgPack type 0x" << std::hex << (int)marker
+        << " at pos " << std::dec << m_pos - 1;
+    throw ParseException(msg.str());
+  }
+  }
+}
+
+VluType
+MsgPack::unpackArray(size_t len)
+{
+  if (++m_depth > maxDepth)
+    throw ParseException("MsgPack nested too deep");
+  auto arr = std::make_unique<Array>();
+  for (size_t i = 0; i < len; ++i)
+    arr->push(unpackValue());
+  --m_depth;
+  return arr;
+}
+
+VluType
+MsgPack::unpackObject(size_t len)
+{
+  if (++m_depth > maxDepth)
+    throw ParseException("MsgPack nested too deep");
+  auto obj = std::make_unique<Object>();
+  for (size_t i = 0; i < len; ++i) {
+    auto key = unpackValue();
+    if (!key->isString())
+      throw ParseException("MsgPack map key must be a string");
+    obj->set(*key->asString(), unpackValue());
+  }
+  --m_depth;
+  return obj;
+}
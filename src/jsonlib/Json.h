@@ -30,9 +30,10 @@ THE SOFTWARE.
 #include <string>
 #include <sstream>
 #include <vector>
-#include <map>
 #include <memory>
 #include <exception>
+#include <algorithm>
+#include <string_view>
 
 /*
 Valid Json types
@@ -57,7 +58,68 @@ class Object;
 typedef std::unique_ptr<VluBase> VluType;
 typedef std::unique_ptr<std::string> StrType;
 typedef std::vector<VluType> ArrType;
-typedef std::map<const std::string, Json::VluType> ObjType;
+
+/**
+ * Storage for Object, a flat vector of key/value pairs kept sorted
+ * by key. Our objects are small (a handful of keys), so a binary search
+ * over contiguous memory beats a node based std::map.
+ * Iteration order is by key name, same as std::map was.
+ */
+class ObjMap {
+public:
+  using value_type = std::pair<std::string, VluType>;
+  using iterator = std::vector<value_type>::iterator;
+  using const_iterator = std::vector<value_type>::const_iterator;
+
+  iterator begin() { return m_items.begin(); }
+  iterator end() { return m_items.end(); }
+  const_iterator begin() const { return m_items.begin(); }
+  const_iterator end() const { return m_items.end(); }
+  size_t size() const { return m_items.size(); }
+  bool empty() const { return m_items.empty(); }
+  void clear() { m_items.clear(); }
+  void reserve(size_t n) { m_items.reserve(n); }
+
+  iterator find(std::string_view key) {
+    auto it = lowerBound(key);
+    return it != m_items.end() && it->first == key ? it : m_items.end();
+  }
+  const_iterator find(std::string_view key) const {
+    return const_cast<ObjMap*>(this)->find(key);
+  }
+  /// insert or replace vlu at key
+  iterator insert_or_assign(std::string_view key, VluType vlu) {
+    auto it = lowerBound(key);
+    if (it != m_items.end() && it->first == key) {
+      it->second = std::move(vlu);
+      return it;
+    }
+    return m_items.emplace(it, std::string(key), std::move(vlu));
+  }
+  /// insert only if key is not already present, like std::map::insert
+  bool insert(value_type&& item) {
+    auto it = lowerBound(item.first);
+    if (it != m_items.end() && it->first == item.first)
+      return false;
+    m_items.emplace(it, std::move(item));
+    return true;
+  }
+  iterator erase(iterator it) { return m_items.erase(it); }
+
+private:
+  iterator lowerBound(std::string_view key) {
+    // appending already sorted keys is the common case, ie: when parsing
+    if (m_items.empty() || m_items.back().first < key)
+      return m_items.end();
+    return std::lower_bound(m_items.begin(), m_items.end(), key,
+      [](const value_type& itm, std::string_view k) {
+        return itm.first < k;
+      });
+  }
+
+  std::vector<value_type> m_items;
+};
+typedef ObjMap ObjType;
 
 class Parser;
 
@@ -271,7 +333,7 @@ public:
   std::vector<VluBase*> values() const;
   size_t length() const { return m_vlu.objVlu->size(); }
 
-  using iterator=std::map<const std::string, Json::VluType>::iterator;
+  using iterator=ObjType::iterator;
   using const_iterator=ObjType::const_iterator;
   iterator begin() { return m_vlu.objVlu->begin(); }
   iterator end() { return m_vlu.objVlu->end(); }
@@ -314,6 +376,45 @@ private:
 VluType parse(std::string_view jsnStr);
 std::string serialize(const VluBase* jsonVlu, int indent = 0);
 
+/**
+ * Compact binary encoding of json values, a subset of MessagePack.
+ * Used as a fast path in the script protocol where parse and
+ * serialize of large json texts is to costly.
+ * Encodes to nil, bool, int32/float32, str, array and map.
+ * Decodes all the MessagePack int/float widths as well,
+ * throws ParseException on ext, bin or malformed data.
+ */
+class MsgPack {
+public:
+  /// appends the encoded jsonVlu to out
+  static void pack(const VluBase* jsonVlu, std::string& out);
+  static std::string pack(const VluBase* jsonVlu);
+  static VluType unpack(std::string_view src);
+  /// true if buf starts with a MsgPack map or array marker, a byte
+  /// that neither starts a json text nor a UTF-8 encoded one
+  static bool isMsgPack(std::string_view buf) {
+    if (buf.empty())
+      return false;
+    auto marker = static_cast<uint8_t>(buf[0]);
+    return (marker >= 0x80 && marker <= 0x9f) ||
+           (marker >= 0xdc && marker <= 0xdf);
+  }
+  /// arrays and maps nested deeper than this throw ParseException
+  static constexpr size_t maxDepth = 256;
+
+private:
+  MsgPack(std::string_view src);
+  VluType unpackValue();
+  VluType unpackArray(size_t len);
+  VluType unpackObject(size_t len);
+  std::string_view take(size_t len);
+  uint64_t readBE(size_t len);
+
+  std::string_view m_src;
+  size_t m_pos;
+  size_t m_depth;
+};
+
 }; // namespace Json
 
 #endif // JSON_H
@@ -28,8 +28,16 @@ THE SOFTWARE.
 #include <cstring>
 #include <cassert>
 #include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#ifdef __APPLE__
+#include <copyfile.h>
+#endif
 #include "MachO.h"
 #include "Types.h"
+#include "ThreadPool.h"
 
 
 static uint32_t readMagic(std::ifstream& file)
@@ -41,6 +49,112 @@ static uint32_t readMagic(std::ifstream& file)
   return magic;
 }
 
+/// stream size bytes from offset in from to the current position in to
+static bool copyRange(std::ifstream& from, std::ofstream& to,
+                      uint64_t offset, uint64_t size)
+{
+  std::vector<char> buf(std::min<uint64_t>(size, 1 << 20));
+  from.seekg(offset);
+  while (size && from && to) {
+    from.read(buf.data(), std::min<uint64_t>(size, buf.size()));
+    to.write(buf.data(), from.gcount());
+    size -= from.gcount();
+  }
+  return !size && to.good();
+}
+
+/// copy size bytes at offset in from to the same offset in to
+static bool copyFileRange(int from, int to, uint64_t offset, uint64_t size)
+{
+  off_t inPos = offset, outPos = offset;
+#ifdef __linux__
+  // let the kernel move it, falls back below when it can't
+  while (size) {
+    auto n = copy_file_range(from, &inPos, to, &outPos, size, 0);
+    if (n <= 0)
+      break;
+    size -= n;
+  }
+#endif
+  std::vector<char> buf(std::min<uint64_t>(size, 1 << 20));
+  while (size) {
+    auto n = pread(from, buf.data(), std::min<uint64_t>(size, buf.size()),
+                   inPos);
+    if (n <= 0 || pwrite(to, buf.data(), n, outPos) != n)
+      return false;
+    inPos += n;
+    outPos += n;
+    size -= n;
+  }
+  return true;
+}
+
+/// copy extended attributes such as quarantine flags, best effort
+static void copyXattrs(int from, int to)
+{
+#ifdef __APPLE__
+  auto list = [&](char* buf, size_t sz) { return flistxattr(from, buf, sz, 0); };
+  auto get = [&](const char* name, void* buf, size_t sz) {
+    return fgetxattr(from, name, buf, sz, 0, 0); };
+  auto set = [&](const char* name, const void* vlu, size_t sz) {
+    return fsetxattr(to, name, vlu, sz, 0, 0); };
+#else
+  auto list = [&](char* buf, size_t sz) { return flistxattr(from, buf, sz); };
+  auto get = [&](const char* name, void* buf, size_t sz) {
+    return fgetxattr(from, name, buf, sz); };
+  auto set = [&](const char* name, const void* vlu, size_t sz) {
+    return fsetxattr(to, name, vlu, sz, 0); };
+#endif
+  auto sz = list(nullptr, 0);
+  if (sz <= 0)
+    return;
+  std::vector<char> names(sz);
+  sz = list(names.data(), names.size());
+  for (ssize_t i = 0; i < sz; i += strlen(&names[i]) + 1) {
+    const char* name = &names[i];
+    auto vsz = get(name, nullptr, 0);
+    if (vsz < 0)
+      continue;
+    std::vector<char> value(vsz);
+    if (get(name, value.data(), value.size()) == vsz)
+      set(name, value.data(), value.size());
+  }
+}
+
+/// Move the finished tmp over dest, with mode and xattrs of like.
+/// tmp is synced before the rename and its directory after, so a crash
+/// leaves either the old dest or the new one, never half of it
+static bool replaceFile(PathRef tmp, PathRef dest, PathRef like)
+{
+  int out = open(tmp.c_str(), O_RDWR);
+  if (out < 0)
+    return false;
+  int in = open(like.c_str(), O_RDONLY);
+  if (in >= 0) {
+    struct stat st;
+    if (fstat(in, &st) == 0)
+      fchmod(out, st.st_mode & 07777);
+    copyXattrs(in, out);
+    close(in);
+  }
+  bool ok = fsync(out) == 0;
+  ok = close(out) == 0 && ok;
+
+  std::error_code err;
+  if (ok)
+    std::filesystem::rename(tmp, dest, err);
+  if (!ok || err)
+    return false;
+
+  auto dir = dest.parent_path();
+  int dirFd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+  if (dirFd >= 0) {
+    fsync(dirFd);
+    close(dirFd);
+  }
+  return true;
+}
+
 
 
 // -----------------------------------------------------------
@@ -63,7 +177,7 @@ MachO::FiletypeStr(FileType type)
   case MH_DSYM:         return "MH_DSYM";
   case MH_KEXT_BUNDLE:  return "MH_KEXT_BUNDLE";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "MH_FILETYPE_UNKNOWN (%2x)", (uint32_t)type);
   return buf;
 }
@@ -100,7 +214,7 @@ MachO::FlagsStr(Flags flag)
   case MH_NO_HEAP_EXECUTION:        return "MH_NO_HEAP_EXECUTION";
   case MH_APP_EXTENSION_SAFE:       return "MH_APP_EXTENSION_SAFE";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "MH_FLAG_UNKOWN (%2x)", (uint32_t)flag);
   return buf;
 }
@@ -118,17 +232,84 @@ MachO::CpuTypeStr(CpuType type)
   case MH_HPPA:      return "MH_HPPA";
   case MH_ARM:       return "MH_ARM";
   case MH_ARM64:     return "MH_ARM64";
+  case MH_ARM64_32:  return "MH_ARM64_32";
   case MH_MC88000:   return "MH_MC88000";
   case MH_SPARC:     return "MH_SPARC";
   case MH_I860:      return "MH_I860";
   case MH_POWERPC:   return "MH_POWERPC";
   case MH_POWERPC64: return "MH_POWERPC64";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "MH_CPU_UNKOWN (%2x)", (uint32_t)type);
   return buf;
 }
 
+namespace {
+const cpu_subtype_t AnySubtype = ~0u;
+
+/// specific subtypes first, the first match names a slice
+struct ArchEntry {
+  const char* name;
+  MachO::CpuType type;
+  cpu_subtype_t subtype;
+};
+constexpr ArchEntry archTable[] = {
+  {"i386",     MachO::MH_X86,       AnySubtype},
+  {"x86_64h",  MachO::MH_X86_64,    8},
+  {"x86_64",   MachO::MH_X86_64,    AnySubtype},
+  {"armv6",    MachO::MH_ARM,       6},
+  {"armv7",    MachO::MH_ARM,       9},
+  {"armv7s",   MachO::MH_ARM,       11},
+  {"armv7k",   MachO::MH_ARM,       12},
+  {"arm",      MachO::MH_ARM,       AnySubtype},
+  {"arm64e",   MachO::MH_ARM64,     2},
+  {"arm64",    MachO::MH_ARM64,     AnySubtype},
+  {"arm64_32", MachO::MH_ARM64_32,  AnySubtype},
+  {"ppc",      MachO::MH_POWERPC,   AnySubtype},
+  {"ppc64",    MachO::MH_POWERPC64, AnySubtype},
+};
+
+/// names this tool took before, as CpuTypeStr without MH_
+constexpr std::pair<const char*, const char*> archAliases[] = {
+  {"x86", "i386"}, {"powerpc", "ppc"}, {"powerpc64", "ppc64"}
+};
+
+bool
+sameName(std::string_view a, std::string_view b)
+{
+  return a.size() == b.size() &&
+    std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+      return tolower(x) == tolower(y);
+    });
+}
+} // namespace
+
+std::string
+MachO::archName(CpuType type, cpu_subtype_t subtype)
+{
+  subtype &= ~CPU_SUBTYPE_MASK;
+  for (const auto& entry : archTable) {
+    if (entry.type == type &&
+        (entry.subtype == AnySubtype || entry.subtype == subtype))
+      return entry.name;
+  }
+  char buf[40];
+  snprintf(buf, sizeof(buf), "cpu%x.%x", (uint32_t)type, subtype);
+  return buf;
+}
+
+bool
+MachO::archMatches(CpuType type, cpu_subtype_t subtype, std::string_view arch)
+{
+  auto name = archName(type, subtype);
+  if (sameName(name, arch))
+    return true;
+  for (const auto& [alias, canonical] : archAliases) {
+    if (sameName(alias, arch) && name == canonical)
+      return true;
+  }
+  return false;
+}
 
 const char*
 MachO::LoadCmdStr(LoadCmds cmd)
@@ -185,8 +366,11 @@ MachO::LoadCmdStr(LoadCmds cmd)
   case LC_VERSION_MIN_WATCHOS:       return "LC_VERSION_MIN_WATCHOS";
   case LC_NOTE:                      return "LC_NOTE";
   case LC_BUILD_VERSION:             return "LC_BUILD_VERSION";
+  case LC_DYLD_EXPORTS_TRIE:         return "LC_DYLD_EXPORTS_TRIE";
+  case LC_DYLD_CHAINED_FIXUPS:       return "LC_DYLD_CHAINED_FIXUPS";
+  case LC_FILESET_ENTRY:             return "LC_FILESET_ENTRY";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "LC_UNKNOWN (0x%x)", cmd);
   return buf;
 }
@@ -199,7 +383,7 @@ MachO::ToolsStr(Tools tool)
   case TOOL_SWIFT: return "TOOL_SWIFT";
   case TOOL_LD:    return "TOOL_LD";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "UNKNOWN TOOL (%2x)", (uint32_t)tool);
   return buf;
 }
@@ -213,7 +397,7 @@ MachO::PlatformsStr(Platforms platform)
   case PLATFORM_TVOS: return "PLATFORM_TVOS";
   case PLATFORM_WATCH: return "PLATFORM_WATCH";
   }
-  static char buf[40] = {0};
+  thread_local char buf[40] = {0};
   snprintf(buf, 40, "UNKNOWN PLATFORM (%2x)", (uint32_t)platform);
   return buf;
 }
@@ -264,13 +448,22 @@ fat_header::nfat_arch() const
     return isBigEndian() ? reverseEndian(m_nfat_arch) : m_nfat_arch;
 }
 
+void
+fat_header::setNfatArch(uint32_t nfat_arch)
+{
+  // swapping is symetric, same as when read
+  if constexpr(hostIsBigEndian)
+    m_nfat_arch = isBigEndian() ? nfat_arch : reverseEndian(nfat_arch);
+  else
+    m_nfat_arch = isBigEndian() ? reverseEndian(nfat_arch) : nfat_arch;
+}
+
 bool
 fat_header::write(std::ofstream& file, const mach_fat_object* fat)
 {
-  fat_header cpy{*this};
-  m_nfat_arch = fat->endian(cpy.m_nfat_arch);
+  (void)fat; // we are stored as read, in file endianess
   const size_t sz = sizeof(fat_header);
-  file.write((char*)&cpy, sz);
+  file.write((char*)this, sz);
   if (file.bad())
     return false;
   return true;
@@ -298,11 +491,12 @@ fat_arch::fat_arch(std::ifstream& file, const mach_fat_object& fat)
 bool
 fat_arch::write(std::ofstream& file, const mach_fat_object* fat)
 {
-  fat_arch cpy;
-  char* me = (char*)this;
+  fat_arch cpy{*this};
+  // five 32bit values, back to file endianess
+  uint32_t *buf = (uint32_t*)&cpy.m_cputype;
+  for (size_t i = 0; i < 5; ++i)
+    buf[i] = fat->endian(buf[i]);
   char *pCpy = (char*)&cpy;
-  for (size_t i = 0; i < 4; ++i)
-    pCpy[i] = fat->endian(me[i]);
 
   file.write(pCpy, sizeof(fat_arch));
   if (!file)
@@ -562,7 +756,7 @@ mach_object::mach_object()
   , m_data_segments{}
 {}
 
-mach_object::mach_object(std::ifstream& file)
+mach_object::mach_object(std::ifstream& file, bool loadData)
   : m_start_pos{static_cast<size_t>(file.tellg())}
   , m_hdr{}
   , m_load_cmds{}
@@ -577,7 +771,7 @@ mach_object::mach_object(std::ifstream& file)
   if (!file)
     fail();
   else
-    readData(file);
+    readData(file, loadData);
 
   if (!file)
     fail();
@@ -621,6 +815,7 @@ mach_object::fail()
 {
   m_hdr.release();
   m_load_cmds.clear();
+  m_cmd_index.clear();
   m_data_segments.clear();
 }
 
@@ -667,21 +862,31 @@ mach_object::readCmds(std::ifstream& file)
       return;
     }
   }
+
+  indexCmds();
+}
+
+void
+mach_object::indexCmds()
+{
+  m_cmd_index.clear();
+  for (size_t i = 0; i < m_load_cmds.size(); ++i)
+    m_cmd_index[m_load_cmds[i].cmd()].push_back(i);
 }
 
 void
-mach_object::readData(std::ifstream& file)
+mach_object::readData(std::ifstream& file, bool loadData)
 {
   for (const auto& cmd : m_load_cmds) {
     switch (cmd.cmd()) {
     case LC_SEGMENT: {
       auto seg = std::make_unique<data_segment>();
-      seg->asSegment<segment_command>(file, cmd, *this);
+      seg->asSegment<segment_command>(file, cmd, *this, loadData);
       m_data_segments.emplace_back(std::move(seg));
     } break;
     case LC_SEGMENT_64:{
       auto seg = std::make_unique<data_segment>();
-      seg->asSegment<segment_command_64>(file, cmd, *this);
+      seg->asSegment<segment_command_64>(file, cmd, *this, loadData);
       m_data_segments.emplace_back(std::move(seg));
     } break;
     default:; // nothing in data sections
@@ -699,13 +904,9 @@ std::vector<Path>
 mach_object::rpaths() const
 {
   std::vector<Path> rpaths;
-  for (const auto& loadCmd : m_load_cmds) {
-    if (loadCmd.cmd() == LC_RPATH) {
-      lc_str lc(loadCmd.bytes.get(), *this);
-      auto str = &loadCmd.bytes.get()
-        [lc.offset - sizeof(load_command)];
-      rpaths.emplace_back((char*)str);
-    }
+  for (const auto loadCmd : filterCmds(LC_RPATH)) {
+    lc_str lc(loadCmd->bytes.get(), *this);
+    rpaths.emplace_back(lc.str(loadCmd->bytes.get()));
   }
   return rpaths;
 }
@@ -738,6 +939,25 @@ mach_object::dataSegments() const
   return vec;
 }
 
+const char*
+mach_object::bytesAt(uint64_t fileoff, uint64_t size) const
+{
+  for (const auto& seg : m_data_segments) {
+    if (seg->bytes() && fileoff >= seg->fileoff() &&
+        fileoff + size <= seg->fileoff() + seg->filesize())
+    {
+      return seg->bytes() + (fileoff - seg->fileoff());
+    }
+  }
+  return nullptr;
+}
+
+symbol_table
+mach_object::symbols() const
+{
+  return symbol_table{*this};
+}
+
 const std::vector<load_command_bytes>&
 mach_object::loadCommands() const
 {
@@ -747,24 +967,28 @@ mach_object::loadCommands() const
 std::vector<load_command_bytes*>
 mach_object::filterCmds(std::vector<LoadCmds> match) const
 {
-  std::vector<load_command_bytes*> cmds;
-  for (auto& cmd : m_load_cmds) {
-    for (const auto& m : match){
-      if (cmd.cmd() == m) {
-        auto pcmd = const_cast<load_command_bytes*>(&cmd);
-        cmds.emplace_back(pcmd);
-        break;
-      }
-    }
+  std::vector<size_t> positions;
+  for (const auto& m : match) {
+    auto found = m_cmd_index.find(m);
+    if (found != m_cmd_index.end())
+      positions.insert(positions.end(),
+                       found->second.begin(), found->second.end());
   }
+  // keep file order when several types are asked for
+  if (match.size() > 1)
+    std::sort(positions.begin(), positions.end());
+
+  std::vector<load_command_bytes*> cmds;
+  cmds.reserve(positions.size());
+  for (auto i : positions)
+    cmds.emplace_back(const_cast<load_command_bytes*>(&m_load_cmds[i]));
   return cmds;
 }
 
 std::vector<load_command_bytes*>
 mach_object::filterCmds(LoadCmds command) const
 {
-  std::vector<LoadCmds> cmds{command};
-  return filterCmds(cmds);
+  return filterCmds(std::vector<LoadCmds>{command});
 }
 
 bool
@@ -776,18 +1000,57 @@ mach_object::hasBeenSigned() const
 std::vector<Path>
 mach_object::searchForDylibs(LoadCmds type) const
 {
+  // the name is the first field after cmdsize in a dylib_command
   std::vector<Path> loadDylibs;
-  for (const auto& loadCmd : m_load_cmds) {
-    if (loadCmd.cmd() == type) {
-      dylib_command dy{loadCmd, *this};
-      auto b = loadCmd.bytes.get();
-      auto str = &b[dy.name().offset - sizeof(load_command)];
-      loadDylibs.emplace_back((char*)str);
-    }
+  for (const auto loadCmd : filterCmds(type)) {
+    lc_str name{loadCmd->bytes.get(), *this};
+    loadDylibs.emplace_back(name.str(loadCmd->bytes.get()));
   }
   return loadDylibs;
 }
 
+std::string
+mach_object::uuid() const
+{
+  auto cmds = filterCmds(LC_UUID);
+  if (cmds.empty() || cmds[0]->cmdsize() < sizeof(load_command) + 16)
+    return {};
+
+  char buf[33] = {0};
+  auto bytes = cmds[0]->bytes.get();
+  for (size_t i = 0; i < 16; ++i)
+    snprintf(&buf[i * 2], 3, "%02X", bytes[i] & 0xFF);
+  return buf;
+}
+
+std::vector<Path>
+mach_object::dylibsByOrdinal() const
+{
+  std::vector<Path> dylibs;
+  for (const auto loadCmd : filterCmds({
+        LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB,
+        LC_LOAD_UPWARD_DYLIB, LC_LAZY_LOAD_DYLIB}))
+  {
+    lc_str name{loadCmd->bytes.get(), *this};
+    dylibs.emplace_back(name.str(loadCmd->bytes.get()));
+  }
+  return dylibs;
+}
+
+bool
+mach_object::weakenDylib(PathRef path)
+{
+  for (auto loadCmd : filterCmds(LC_LOAD_DYLIB)) {
+    lc_str name{loadCmd->bytes.get(), *this};
+    if (path == Path(name.str(loadCmd->bytes.get()))) {
+      loadCmd->setCmd(LC_LOAD_WEAK_DYLIB);
+      indexCmds();
+      return true;
+    }
+  }
+  return false;
+}
+
 size_t
 mach_object::dataBegins() const
 {
@@ -799,75 +1062,275 @@ mach_object::dataBegins() const
   return -1;
 }
 
+uint64_t
+mach_object::firstDataOffset() const
+{
+  // the first section with file contents,
+  // or the first mapped segment if there are none
+  if (!m_first_data) {
+    uint64_t firstData = UINT64_MAX;
+    auto lowest = [&](uint64_t offset) {
+      if (offset > 0 && offset < firstData)
+        firstData = offset;
+    };
+
+    for (const auto cmd : filterCmds({LC_SEGMENT, LC_SEGMENT_64})) {
+      if (cmd->cmd() == LC_SEGMENT_64) {
+        segment_command_64 seg{*cmd, *this};
+        if (seg.filesize() > 0)
+          lowest(seg.fileoff());
+        auto sect = &cmd->bytes.get()[
+          sizeof(segment_command_64) - sizeof(load_command)];
+        for (uint32_t i = 0; i < seg.nsects(); ++i)
+          lowest(section_64{&sect[i * sizeof(section_64)], *this}.offset());
+      } else {
+        segment_command seg{*cmd, *this};
+        if (seg.filesize() > 0)
+          lowest(seg.fileoff());
+        auto sect = &cmd->bytes.get()[
+          sizeof(segment_command) - sizeof(load_command)];
+        for (uint32_t i = 0; i < seg.nsects(); ++i)
+          lowest(section{&sect[i * sizeof(section)], *this}.offset());
+      }
+    }
+    m_first_data = firstData;
+  }
+
+  if (*m_first_data == UINT64_MAX)
+    return dataBegins() - m_start_pos;
+  return *m_first_data;
+}
+
+size_t
+mach_object::headerPadding() const
+{
+  // the load commands may grow into the gap before the first data
+  auto firstData = firstDataOffset();
+  if (*m_first_data == UINT64_MAX)
+    return SIZE_MAX;
+
+  size_t used = (is64bits() ? sizeof(mach_header_64) : sizeof(mach_header_32))
+              + loadCommandsSize();
+  return firstData > used ? firstData - used : 0;
+}
+
+namespace {
+/// true for every LC_RPATH repeating one seen before
+class RPathDuplicates {
+public:
+  RPathDuplicates(const mach_object& obj): m_obj{obj} {}
+  bool operator()(const load_command_bytes& cmd) {
+    if (cmd.cmd() != LC_RPATH)
+      return false;
+    lc_str lc{cmd.bytes.get(), m_obj};
+    std::string path = lc.str(cmd.bytes.get());
+    if (std::find(m_seen.begin(), m_seen.end(), path) == m_seen.end()) {
+      m_seen.push_back(path);
+      return false;
+    }
+    return true;
+  }
+private:
+  const mach_object& m_obj;
+  std::vector<std::string> m_seen;
+};
+} // namespace
+
+size_t
+mach_object::duplicateRPathsSize() const
+{
+  RPathDuplicates isDup{*this};
+  size_t size = 0;
+  for (const auto& cmd : m_load_cmds) {
+    if (isDup(cmd))
+      size += cmd.cmdsize();
+  }
+  return size;
+}
+
+size_t
+mach_object::dropDuplicateRPaths()
+{
+  RPathDuplicates isDup{*this};
+  size_t freed = 0;
+  auto dup = [&](const load_command_bytes& cmd) -> bool {
+    if (!isDup(cmd))
+      return false;
+    freed += cmd.cmdsize();
+    return true;
+  };
+
+  m_load_cmds.erase(
+    std::remove_if(m_load_cmds.begin(), m_load_cmds.end(), dup),
+    m_load_cmds.end());
+  if (freed > 0)
+    indexCmds();
+  return freed;
+}
+
+size_t
+mach_object::loadCommandsSize() const
+{
+  size_t size = 0;
+  for (const auto& cmd : m_load_cmds)
+    size += cmd.cmdsize();
+  return size;
+}
+
+size_t
+mach_object::lcStrCmdSize(uint32_t offset, size_t strLen) const
+{
+  // any bytes must align to 4 or 8 bytes, also makes room for null char
+  size_t mod = is64bits() ? 8 : 4;
+  size_t newSz = offset - sizeof(load_command) + strLen;
+  newSz += mod - (newSz % mod);
+  return newSz + sizeof(load_command);
+}
+
+bool
+mach_object::makeRoom(size_t oldCmdSize, size_t newCmdSize)
+{
+  m_shortfall = 0;
+  if (newCmdSize <= oldCmdSize)
+    return true;
+
+  size_t grow = newCmdSize - oldCmdSize;
+  size_t padding = headerPadding();
+  if (grow <= padding)
+    return true;
+
+  // only drop them if that makes the edit fit, a failed edit changes nothing
+  size_t freed = m_compact ? duplicateRPathsSize() : 0;
+  if (grow <= padding + freed) {
+    dropDuplicateRPaths();
+    return true;
+  }
+
+  m_shortfall = grow - padding - freed;
+  return false;
+}
+
+void
+mach_object::reportShortfall() const
+{
+  if (m_shortfall > 0)
+    std::cerr << "Not enough header padding, load commands need "
+              << m_shortfall << " more bytes, relink with "
+              << "-headerpad_max_install_names\n";
+}
+
+std::string
+mach_object::viaRPath(const std::string& path) const
+{
+  // the longest LC_RPATH that path lives under gives the shortest name
+  std::string best;
+  for (const auto& rpath : rpaths()) {
+    auto prefix = rpath.string();
+    if (!prefix.empty() && prefix.back() != '/')
+      prefix += '/';
+    if (prefix.size() > best.size() && path.size() > prefix.size() &&
+        path.compare(0, prefix.size(), prefix) == 0)
+    {
+      best = prefix;
+    }
+  }
+
+  if (best.empty())
+    return {};
+  return "@rpath/" + path.substr(best.size());
+}
+
 size_t
 mach_object::replaceLcStr(load_command_bytes& cmd, uint32_t offset, std::string_view newStr)
 {
-  // any bytes must align to 4bits
   auto strOffset = offset - sizeof(load_command);
-  auto oldBytes = cmd.bytes.get();
-  auto newStrLen = newStr.size();
-  size_t mod = is64bits() ? 8 : 4;
-  size_t newSz = strOffset + newStrLen;
-  newSz += mod - (newSz %  mod); // also takes care of null char
+  size_t newSz = lcStrCmdSize(offset, newStr.size()) - sizeof(load_command);
 
-  // create a new buffer
+  // create a new buffer, zeroed so the padding is too
   auto newBytes = std::make_unique<char[]>(newSz);
   memset((void*)newBytes.get(), 0, newSz);
 
   // copy data up to this string
-  memcpy((void*)newBytes.get(), (char*)oldBytes, strOffset);
+  memcpy((void*)newBytes.get(), cmd.bytes.get(), strOffset);
   memcpy((void*)&newBytes.get()[strOffset], (void*)newStr.data(), newStr.size());
 
   // replace buffer
-  cmd.bytes.release();
   cmd.bytes = std::move(newBytes);
   cmd.setCmdSize(newSz + sizeof(load_command));
-  std::cout <<"changed to "<< &cmd.bytes.get()[4] << "\n";
   return newSz;
 }
 
+bool
+mach_object::changeLcStr(
+  const std::function<load_command_bytes*()>& find,
+  std::string_view newStr
+) {
+  m_shortfall = 0; // not from an earlier edit
+  auto cmd = find();
+  if (!cmd)
+    return false;
+
+  lc_str lc{cmd->bytes.get(), *this};
+  if (!makeRoom(cmd->cmdsize(), lcStrCmdSize(lc.offset, newStr.size())))
+    return false;
+
+  // compacting might have moved the command
+  cmd = find();
+  return replaceLcStr(*cmd, lc.offset, newStr) > 0;
+}
+
 bool
 mach_object::changeRPath(PathRef oldPath, PathRef newPath)
 {
-  auto pathCmds = filterCmds(LC_RPATH);
-  for (auto& cmd : pathCmds) {
-    lc_str lc{cmd->bytes.get(), *this};
-    auto pth = &cmd->bytes.get()[lc.offset-sizeof(load_command)];
-    if (pth == oldPath)
-      return replaceLcStr(*cmd, lc.offset, newPath.string()) > 0;
-  }
+  auto find = [&]() -> load_command_bytes* {
+    for (auto& cmd : filterCmds(LC_RPATH)) {
+      lc_str lc{cmd->bytes.get(), *this};
+      if (lc.str(cmd->bytes.get()) == oldPath)
+        return cmd;
+    }
+    return nullptr;
+  };
 
-  return false;
+  bool res = changeLcStr(find, newPath.string());
+  reportShortfall();
+  return res;
 }
 
 bool
 mach_object::changeDylibPaths(PathRef oldPath, PathRef newPath)
 {
-  auto pathCmds = filterCmds({
-    LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB});
-
-  for (auto& cmd : pathCmds) {
-    dylib_command dylib{*cmd, *this};
-    auto pth = &cmd->bytes.get()[dylib.name().offset-sizeof(load_command)];
-    if (pth == oldPath) {
-      return replaceLcStr(*cmd, dylib.name().offset, newPath.string()) > 0;
+  auto find = [&]() -> load_command_bytes* {
+    for (auto& cmd : filterCmds({
+          LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB}))
+    {
+      lc_str name{cmd->bytes.get(), *this};
+      if (name.str(cmd->bytes.get()) == oldPath)
+        return cmd;
     }
-  }
+    return nullptr;
+  };
 
-  return false;
+  bool res = changeLcStr(find, newPath.string());
+  if (!res && m_shortfall > 0 && m_compact) {
+    auto shorter = viaRPath(newPath.string());
+    if (!shorter.empty())
+      res = changeLcStr(find, shorter);
+  }
+  reportShortfall();
+  return res;
 }
 
 bool
 mach_object::changeId(PathRef id)
 {
-  auto idCmd = filterCmds(LC_ID_DYLIB);
-  if (idCmd.empty())
-    return false;
-
-  auto cmd = idCmd[0];
+  auto find = [&]() -> load_command_bytes* {
+    auto idCmd = filterCmds(LC_ID_DYLIB);
+    return idCmd.empty() ? nullptr : idCmd[0];
+  };
 
-  dylib_command dylib{*cmd, *this};
-  return replaceLcStr(*cmd, dylib.name().offset, id.string()) > 0;
+  bool res = changeLcStr(find, id.string());
+  reportShortfall();
+  return res;
 }
 
 bool
@@ -886,6 +1349,7 @@ mach_object::removeRPath(PathRef rpath)
 
   if (found != m_load_cmds.end()) {
     m_load_cmds.erase(found);
+    indexCmds();
     return true;
   }
 
@@ -896,18 +1360,17 @@ bool
 mach_object::addRPath(PathRef rpath)
 {
   auto str = rpath.string();
-  const size_t bytesSz = lc_str::lc_STR_OFFSET + str.size();
-  uint32_t cmdsize = sizeof(load_command) + bytesSz;
-  load_command_bytes cmd{LC_RPATH, cmdsize};
-
-  cmd.bytes = std::make_unique<char[]>(bytesSz);
+  const uint32_t offset = sizeof(load_command) + lc_str::lc_STR_OFFSET;
+  if (!makeRoom(0, lcStrCmdSize(offset, str.size()))) {
+    reportShortfall();
+    return false;
+  }
 
-  lc_str lc; lc.offset = endian(
-    sizeof(load_command) + lc_str::lc_STR_OFFSET);
-  // copy the offset and string into bytes array
-  memcpy((void*)cmd.bytes.get(), &lc.offset, bytesSz);
-  memcpy((void*)&cmd.bytes.get()[lc_str::lc_STR_OFFSET],
-         &lc.offset, bytesSz);
+  load_command_bytes cmd{LC_RPATH, offset};
+  cmd.bytes = std::make_unique<char[]>(lc_str::lc_STR_OFFSET);
+  uint32_t lcOffset = endian(offset);
+  memcpy((void*)cmd.bytes.get(), &lcOffset, sizeof(lcOffset));
+  replaceLcStr(cmd, offset, str);
 
   auto place = [&](const LoadCmds id) -> bool {
     LoadCmds prev = LC_SEGMENT; // init to not LC_RPATH
@@ -918,32 +1381,60 @@ mach_object::addRPath(PathRef rpath)
         m_load_cmds.emplace(it, std::move(cmd));
         return true;
       }
+      prev = it->cmd();
+    }
+    if (prev == id) {
+      m_load_cmds.emplace_back(std::move(cmd));
+      return true;
     }
     return false;
   };
 
   // place it after one of these
-  if (place(LC_RPATH))
-    return true;
-  if (place(LC_LOAD_DYLIB))
-    return true;
-  if (place(LC_SEGMENT_64))
-    return true;
-  if (place(LC_SEGMENT))
+  if (place(LC_RPATH) || place(LC_LOAD_DYLIB) ||
+      place(LC_SEGMENT_64) || place(LC_SEGMENT))
+  {
+    indexCmds();
     return true;
+  }
 
   return false;
 }
 
 bool
 mach_object::write(std::ofstream& file) const
+{
+  if (!writeCmds(file))
+    return false;
+
+  // each segment seeks to its own file offset
+  for (const auto& data : m_data_segments) {
+    if (!data->write(file, *this)) {
+      file.setstate(std::ios::failbit);
+      return false;
+    }
+  }
+
+  // segments overlapping the header brought back the old padding
+  auto padding = headerPadding();
+  if (padding != SIZE_MAX && padding > 0) {
+    std::vector<char> zeros(padding, 0);
+    file.seekp(dataBegins());
+    file.write(zeros.data(), zeros.size());
+  }
+
+  return file.good();
+}
+
+bool
+mach_object::writeCmds(std::ofstream& file) const
 {
   //calculate new m_hdr->sizeofcmds
-  uint32_t sizeOfCmds = 0;
-  for (const auto& cmd : m_load_cmds)
-    sizeOfCmds += cmd.cmdsize();
+  m_hdr->setSizeofcmds(loadCommandsSize());
+  m_hdr->setNcmds(m_load_cmds.size());
 
-  m_hdr->setSizeofcmds(sizeOfCmds);
+  // we might be a slice in a fat file
+  file.seekp(m_start_pos);
 
   // write header
   bool res;
@@ -955,56 +1446,23 @@ mach_object::write(std::ofstream& file) const
     file.setstate(std::ios::failbit);
     return false;
   }
-  file.flush();
-  //auto afterHdr = file.tellp();
-
-  auto pos = file.tellp();
 
   // write cmds
-  uint32_t firstSegment = UINT32_MAX;
   for (const auto& cmd : m_load_cmds) {
-    res = cmd.write(file, *this);
-    if (!res) {
+    if (!cmd.write(file, *this)) {
       file.setstate(std::ios::badbit);
       return false;
     }
-    file.flush();
-    pos = file.tellp();
-
-    switch (cmd.cmd()) {
-    case LC_SEGMENT: {
-      segment_command seg{cmd, *this};
-      if (firstSegment > seg.fileoff())
-        firstSegment = seg.fileoff();
-    } break;
-    case LC_SEGMENT_64: {
-      segment_command_64 seg{cmd, *this};
-      if (firstSegment > seg.fileoff())
-        firstSegment = seg.fileoff();
-    } break;
-    default:;
-    }
   }
-  //auto afterCmds = file.tellp();
 
-  // we should now be at segments
-  file.seekp(dataBegins() + firstSegment);
-  pos = file.tellp();
-  auto p2 = pos;
-  for (const auto& data : m_data_segments) {
-    file.seekp(dataBegins() + data->fileoff());
-    p2 = file.tellp();
-    res = data->write(file, *this);
-    if (!res) {
-      file.setstate(std::ios::failbit);
-      return false;
-    }
-
-    file.flush();
-    pos = file.tellp();
+  // padding must be zero, commands that shrunk would leave stale bytes
+  auto padding = headerPadding();
+  if (padding != SIZE_MAX && padding > 0) {
+    std::vector<char> zeros(padding, 0);
+    file.write(zeros.data(), zeros.size());
   }
 
-  return true;
+  return file.good();
 }
 
 // -----------------------------------------------------------
@@ -1059,7 +1517,7 @@ dysymtab_command::dysymtab_command(
                           - sizeof(load_command);
   memcpy((void*)&m_ilocalsym, cmd.bytes.get(), mysize);
   uint32_t *buf = &m_ilocalsym;
-  for (size_t i = 0; i < mysize; ++i)
+  for (size_t i = 0; i < mysize / sizeof(uint32_t); ++i)
     buf[i] = obj.endian(buf[i]);
 }
 
@@ -1145,7 +1603,7 @@ dyld_info_command::dyld_info_command(
   uint32_t *buf = (uint32_t*)cmd.bytes.get();
   uint32_t *me = &m_rebase_off;
   for (size_t i = 0; i < 10; ++i)
-    me[i] = buf[i];
+    me[i] = obj.endian(buf[i]);
 }
 
 // -----------------------------------------------------------
@@ -1231,6 +1689,9 @@ data_segment::write(std::ofstream& file, const mach_object& obj) const
 {
   // the very first page is loaded including header and load commands
   // we don't want to overwrite these so we special case them
+  if (!m_bytes && m_filesize)
+    return false; // loaded without data
+
   auto begin = obj.dataBegins();
   auto startPos = obj.startPos();
   auto fileoff = m_fileoff;
@@ -1243,7 +1704,7 @@ data_segment::write(std::ofstream& file, const mach_object& obj) const
     idx = begin - startPos;
   }
 
-  file.seekp(fileoff);
+  file.seekp(startPos + fileoff);
   file.write(&m_bytes.get()[idx], filesize);
   return file.good();
 }
@@ -1251,38 +1712,533 @@ data_segment::write(std::ofstream& file, const mach_object& obj) const
 
 // -----------------------------------------------------------
 
-mach_fat_object::mach_fat_object()
-  : m_hdr{nullptr}
-  , m_fat_arch{}
-  , m_objects{}
-{}
+symbol_table::symbol::symbol(const char* entry, const symbol_table& table)
+{
+  // n_strx, n_type, n_sect, n_desc then a 32 or 64 bit n_value
+  const auto& obj = table.m_obj;
+  uint32_t strx;
+  memcpy(&strx, entry, sizeof(strx));
+  strx = obj.endian(strx);
+  m_type = static_cast<uint8_t>(entry[4]);
+  m_sect = static_cast<uint8_t>(entry[5]);
+  memcpy(&m_desc, &entry[6], sizeof(m_desc));
+  m_desc = obj.endian(m_desc);
+  if (table.m_entrySize == 16) {
+    memcpy(&m_value, &entry[8], sizeof(m_value));
+    m_value = obj.endian(m_value);
+  } else {
+    uint32_t vlu;
+    memcpy(&vlu, &entry[8], sizeof(vlu));
+    m_value = obj.endian(vlu);
+  }
 
-mach_fat_object::mach_fat_object(std::ifstream& file)
-  : m_hdr{nullptr}
-  , m_fat_arch{}
-  , m_objects{}
-{
-  auto hdr = std::make_unique<fat_header>(file);
-  if (!file || hdr->magic() != FatMagic)
-    return;
+  if (strx < table.m_strsize) {
+    const char* str = table.m_strs + strx;
+    m_name = std::string_view(str, strnlen(str, table.m_strsize - strx));
+  }
+}
 
-  m_hdr = std::move(hdr);
+bool
+symbol_table::symbol::isUndefined() const
+{
+  return isExternal() && (m_type & N_TYPE) == N_UNDF;
+}
 
-  // load architecture
-  for (size_t i = 0, end = m_hdr->nfat_arch(); i < end; ++i) {
-    fat_arch arch{file, *this};
-    if (!file || !arch.size()) {
-      fail();
-      return;
-    }
+bool
+symbol_table::symbol::isExported() const
+{
+  return isExternal() && !(m_type & N_PEXT) &&
+         (m_type & N_TYPE) != N_UNDF;
+}
 
-    m_fat_arch.emplace_back(std::move(arch));
-  }
+symbol_table::symbol_table(const mach_object& obj)
+  : m_obj{obj}
+  , m_syms{nullptr}
+  , m_strs{nullptr}
+  , m_nsyms{0}
+  , m_strsize{0}
+  , m_entrySize{obj.is64bits() ? 16u : 12u}
+  , m_iextsym{0}, m_nextsym{0}, m_iundefsym{0}, m_nundefsym{0}
+  , m_hasDysymtab{false}
+  , m_index{}
+{
+  auto symtabs = obj.filterCmds(LC_SYMTAB);
+  if (symtabs.empty())
+    return;
 
-  if (!file) {
-    fail();
+  symtab_command symtab{*symtabs.front(), obj};
+  m_syms = obj.bytesAt(symtab.symoff(),
+                       uint64_t(symtab.syms()) * m_entrySize);
+  m_strs = obj.bytesAt(symtab.stroff(), symtab.strsize());
+  if (!m_syms || !m_strs) {
+    m_syms = m_strs = nullptr;
     return;
   }
+  m_nsyms = symtab.syms();
+  m_strsize = symtab.strsize();
+
+  auto dysymtabs = obj.filterCmds(LC_DYSYMTAB);
+  if (!dysymtabs.empty()) {
+    dysymtab_command dysymtab{*dysymtabs.front(), obj};
+    m_iextsym = dysymtab.iextsym();
+    m_nextsym = dysymtab.nextsym();
+    m_iundefsym = dysymtab.iundefsym();
+    m_nundefsym = dysymtab.nundefsym();
+    m_hasDysymtab = uint64_t(m_iextsym) + m_nextsym <= m_nsyms &&
+                    uint64_t(m_iundefsym) + m_nundefsym <= m_nsyms;
+  }
+}
+
+bool
+symbol_table::failure() const
+{
+  return !m_syms;
+}
+
+symbol_table::symbol
+symbol_table::at(size_t idx) const
+{
+  assert(idx < m_nsyms && "symbol index out of range");
+  return symbol{m_syms + idx * m_entrySize, *this};
+}
+
+std::optional<symbol_table::symbol>
+symbol_table::find(std::string_view name) const
+{
+  if (m_index.empty() && m_nsyms) {
+    m_index.reserve(m_nsyms);
+    for (size_t i = 0; i < m_nsyms; ++i) {
+      auto sym = at(i);
+      if (!sym.isDebug() && !sym.name().empty())
+        m_index.emplace(sym.name(), static_cast<uint32_t>(i));
+    }
+  }
+
+  auto found = m_index.find(name);
+  if (found == m_index.end())
+    return std::nullopt;
+  return at(found->second);
+}
+
+std::vector<symbol_table::symbol>
+symbol_table::undefined() const
+{
+  // dysymtab groups them, no need to look at the others
+  if (m_hasDysymtab)
+    return range(m_iundefsym, m_nundefsym, &symbol::isUndefined);
+  return range(0, m_nsyms, &symbol::isUndefined);
+}
+
+std::vector<symbol_table::symbol>
+symbol_table::exports() const
+{
+  if (m_hasDysymtab)
+    return range(m_iextsym, m_nextsym, &symbol::isExported);
+  return range(0, m_nsyms, &symbol::isExported);
+}
+
+std::vector<symbol_table::symbol>
+symbol_table::range(size_t first, size_t count,
+                    bool (symbol::*pred)() const) const
+{
+  std::vector<symbol> syms;
+  for (size_t i = first; i < first + count; ++i) {
+    auto sym = at(i);
+    if ((sym.*pred)())
+      syms.push_back(sym);
+  }
+  return syms;
+}
+
+// -----------------------------------------------------------
+
+leb128_reader::leb128_reader(const char* begin, const char* end)
+  : m_begin{begin}
+  , m_pos{begin}
+  , m_end{end}
+  , m_failed{false}
+{}
+
+uint64_t
+leb128_reader::uleb()
+{
+  uint64_t vlu = 0;
+  unsigned shift = 0;
+  uint8_t b;
+  do {
+    if (m_pos >= m_end || shift > 63) {
+      m_failed = true;
+      return 0;
+    }
+    b = static_cast<uint8_t>(*m_pos++);
+    vlu |= uint64_t(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return vlu;
+}
+
+int64_t
+leb128_reader::sleb()
+{
+  int64_t vlu = 0;
+  unsigned shift = 0;
+  uint8_t b;
+  do {
+    if (m_pos >= m_end || shift > 63) {
+      m_failed = true;
+      return 0;
+    }
+    b = static_cast<uint8_t>(*m_pos++);
+    vlu |= int64_t(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  // sign extend
+  if ((b & 0x40) && shift < 64)
+    vlu |= -(int64_t(1) << shift);
+  return vlu;
+}
+
+uint8_t
+leb128_reader::byte()
+{
+  if (m_pos >= m_end) {
+    m_failed = true;
+    return 0;
+  }
+  return static_cast<uint8_t>(*m_pos++);
+}
+
+std::string_view
+leb128_reader::cstr()
+{
+  auto end = m_pos < m_end
+    ? static_cast<const char*>(memchr(m_pos, 0, m_end - m_pos)) : nullptr;
+  if (!end) {
+    m_failed = true;
+    return {};
+  }
+  std::string_view str(m_pos, end - m_pos);
+  m_pos = end + 1;
+  return str;
+}
+
+void
+leb128_reader::seek(size_t offset)
+{
+  if (offset > size_t(m_end - m_begin))
+    m_failed = true;
+  else
+    m_pos = m_begin + offset;
+}
+
+// -----------------------------------------------------------
+
+dyld_info::dyld_info(const mach_object& obj)
+  : m_obj{obj}
+  , m_exports{}
+  , m_fixups{}
+  , m_bind{}
+  , m_lazyBind{}
+{
+  for (const auto& cmd : obj.loadCommands()) {
+    switch (cmd.cmd()) {
+    case LC_DYLD_INFO:
+    case LC_DYLD_INFO_ONLY: {
+      dyld_info_command info{cmd, obj};
+      m_bind = linkedit(info.bind_off(), info.bind_size());
+      m_lazyBind = linkedit(info.lazy_bind_off(), info.lazy_bind_size());
+      if (!m_exports.first)
+        m_exports = linkedit(info.export_off(), info.export_size());
+    } break;
+    case LC_DYLD_EXPORTS_TRIE: {
+      linkedit_data_command link{cmd, obj};
+      m_exports = linkedit(link.dataoff(), link.datasize());
+    } break;
+    case LC_DYLD_CHAINED_FIXUPS: {
+      linkedit_data_command link{cmd, obj};
+      m_fixups = linkedit(link.dataoff(), link.datasize());
+    } break;
+    default: ;
+    }
+  }
+}
+
+dyld_info::range
+dyld_info::linkedit(uint32_t offset, uint32_t size) const
+{
+  auto bytes = size ? m_obj.bytesAt(offset, size) : nullptr;
+  if (!bytes)
+    return {nullptr, nullptr};
+  return {bytes, bytes + size};
+}
+
+bool
+dyld_info::forEachExport(
+  const std::function<void(const dyld_export&)>& fn) const
+{
+  if (!m_exports.first)
+    return true;
+
+  // depth first, each node is a terminal (maybe empty) followed by
+  // edges to its children, the edge strings make up the name
+  struct node { size_t offset, parentLen; std::string_view edge; };
+  const size_t size = m_exports.second - m_exports.first;
+  leb128_reader trie{m_exports.first, m_exports.second};
+  std::string name;
+  std::vector<node> stack{{0, 0, {}}}, children;
+  size_t visited = 0;
+
+  while (!stack.empty()) {
+    auto cur = stack.back();
+    stack.pop_back();
+    if (++visited > size) // loops in a malformed trie
+      return false;
+
+    name.resize(cur.parentLen);
+    name += cur.edge;
+
+    trie.seek(cur.offset);
+    auto terminalSize = trie.uleb();
+    auto childrenAt = trie.pos() + terminalSize;
+    if (terminalSize) {
+      dyld_export exp{name, trie.uleb(), 0, 0, {}};
+      if (exp.isReexport()) {
+        exp.reexportOrdinal = static_cast<int>(trie.uleb());
+        exp.importName = trie.cstr();
+      } else {
+        exp.address = trie.uleb();
+        if (exp.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER)
+          trie.uleb(); // resolver
+      }
+      if (trie.failure())
+        return false;
+      fn(exp);
+    }
+
+    trie.seek(childrenAt);
+    children.clear();
+    for (uint8_t i = 0, cnt = trie.byte(); i < cnt; ++i) {
+      auto edge = trie.cstr();
+      auto offset = trie.uleb();
+      if (offset >= size)
+        return false;
+      children.push_back({offset, name.size(), edge});
+    }
+    if (trie.failure())
+      return false;
+    // reversed to visit them in trie order
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+  return true;
+}
+
+bool
+dyld_info::forEachImport(
+  const std::function<void(const dyld_import&)>& fn) const
+{
+  if (m_fixups.first)
+    return chainedImports(fn);
+  return bindImports(m_bind, false, fn) && bindImports(m_lazyBind, true, fn);
+}
+
+std::vector<std::string>
+dyld_info::exportedNames() const
+{
+  std::vector<std::string> names;
+  forEachExport([&](const dyld_export& exp) {
+    names.emplace_back(exp.name);
+  });
+  return names;
+}
+
+std::vector<dyld_import>
+dyld_info::imports() const
+{
+  std::vector<dyld_import> imps;
+  std::unordered_map<std::string_view, int> seen;
+  forEachImport([&](const dyld_import& imp) {
+    auto it = seen.find(imp.name);
+    if (it == seen.end() || it->second != imp.libraryOrdinal) {
+      seen[imp.name] = imp.libraryOrdinal;
+      imps.push_back(imp);
+    }
+  });
+  return imps;
+}
+
+bool
+dyld_info::bindImports(
+  range opcodes, bool lazy,
+  const std::function<void(const dyld_import&)>& fn) const
+{
+  if (!opcodes.first)
+    return true;
+
+  enum {
+    BIND_OPCODE_DONE = 0x00,
+    BIND_OPCODE_SET_DYLIB_ORDINAL_IMM = 0x10,
+    BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB = 0x20,
+    BIND_OPCODE_SET_DYLIB_SPECIAL_IMM = 0x30,
+    BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM = 0x40,
+    BIND_OPCODE_SET_TYPE_IMM = 0x50,
+    BIND_OPCODE_SET_ADDEND_SLEB = 0x60,
+    BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB = 0x70,
+    BIND_OPCODE_ADD_ADDR_ULEB = 0x80,
+    BIND_OPCODE_DO_BIND = 0x90,
+    BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB = 0xA0,
+    BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED = 0xB0,
+    BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB = 0xC0,
+    BIND_OPCODE_THREADED = 0xD0,
+    BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB = 0x00,
+    BIND_SYMBOL_FLAGS_WEAK_IMPORT = 0x1,
+  };
+
+  leb128_reader rd{opcodes.first, opcodes.second};
+  dyld_import imp{{}, 0, false};
+  bool reported = true;
+  auto bind = [&]() {
+    // the same symbol is often bound to many addresses
+    if (!reported && !imp.name.empty())
+      fn(imp);
+    reported = true;
+  };
+  auto setOrdinal = [&](int ordinal) {
+    reported = reported && ordinal == imp.libraryOrdinal;
+    imp.libraryOrdinal = ordinal;
+  };
+
+  while (!rd.atEnd() && !rd.failure()) {
+    uint8_t op = rd.byte();
+    uint8_t imm = op & 0x0f;
+    switch (op & 0xf0) {
+    case BIND_OPCODE_DONE:
+      // lazy binds are separate entries, each ending with done
+      if (!lazy)
+        return true;
+      break;
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_IMM:
+      setOrdinal(imm); break;
+    case BIND_OPCODE_SET_DYLIB_ORDINAL_ULEB:
+      setOrdinal(static_cast<int>(rd.uleb())); break;
+    case BIND_OPCODE_SET_DYLIB_SPECIAL_IMM:
+      setOrdinal(imm ? static_cast<int8_t>(0xf0 | imm) : 0); break;
+    case BIND_OPCODE_SET_SYMBOL_TRAILING_FLAGS_IMM:
+      imp.name = rd.cstr();
+      imp.weak = imm & BIND_SYMBOL_FLAGS_WEAK_IMPORT;
+      reported = false;
+      break;
+    case BIND_OPCODE_SET_TYPE_IMM: break;
+    case BIND_OPCODE_SET_ADDEND_SLEB:
+      rd.sleb(); break;
+    case BIND_OPCODE_SET_SEGMENT_AND_OFFSET_ULEB:
+    case BIND_OPCODE_ADD_ADDR_ULEB:
+      rd.uleb(); break;
+    case BIND_OPCODE_DO_BIND:
+    case BIND_OPCODE_DO_BIND_ADD_ADDR_IMM_SCALED:
+      bind(); break;
+    case BIND_OPCODE_DO_BIND_ADD_ADDR_ULEB:
+      bind(); rd.uleb(); break;
+    case BIND_OPCODE_DO_BIND_ULEB_TIMES_SKIPPING_ULEB:
+      bind(); rd.uleb(); rd.uleb(); break;
+    case BIND_OPCODE_THREADED:
+      if (imm == BIND_SUBOPCODE_THREADED_SET_BIND_ORDINAL_TABLE_SIZE_ULEB)
+        rd.uleb();
+      break;
+    default:
+      return false;
+    }
+  }
+  return !rd.failure();
+}
+
+bool
+dyld_info::chainedImports(
+  const std::function<void(const dyld_import&)>& fn) const
+{
+  enum {
+    DYLD_CHAINED_IMPORT = 1,
+    DYLD_CHAINED_IMPORT_ADDEND = 2,
+    DYLD_CHAINED_IMPORT_ADDEND64 = 3,
+  };
+
+  // dyld_chained_fixups_header
+  struct {
+    uint32_t fixups_version, starts_offset, imports_offset,
+             symbols_offset, imports_count, imports_format,
+             symbols_format;
+  } hdr;
+  const size_t size = m_fixups.second - m_fixups.first;
+  if (size < sizeof(hdr))
+    return false;
+  memcpy(&hdr, m_fixups.first, sizeof(hdr));
+  uint32_t* buf = &hdr.fixups_version;
+  for (size_t i = 0; i < sizeof(hdr) / sizeof(uint32_t); ++i)
+    buf[i] = m_obj.endian(buf[i]);
+
+  size_t stride = hdr.imports_format == DYLD_CHAINED_IMPORT ? 4
+                : hdr.imports_format == DYLD_CHAINED_IMPORT_ADDEND ? 8
+                : hdr.imports_format == DYLD_CHAINED_IMPORT_ADDEND64 ? 16 : 0;
+  // symbols_format 1 is zlib compressed, not used by ld64
+  if (!stride || hdr.symbols_format != 0 ||
+      hdr.imports_offset + uint64_t(hdr.imports_count) * stride > size ||
+      hdr.symbols_offset > size)
+  {
+    return false;
+  }
+
+  const char* imports = m_fixups.first + hdr.imports_offset;
+  const char* symbols = m_fixups.first + hdr.symbols_offset;
+  const size_t symbolsSize = size - hdr.symbols_offset;
+  for (size_t i = 0; i < hdr.imports_count; ++i) {
+    const char* entry = imports + i * stride;
+    uint64_t nameOffset;
+    int ordinal;
+    bool weak;
+    if (hdr.imports_format == DYLD_CHAINED_IMPORT_ADDEND64) {
+      // lib_ordinal:16, weak_import:1, reserved:15, name_offset:32
+      uint64_t raw;
+      memcpy(&raw, entry, sizeof(raw));
+      raw = m_obj.endian(raw);
+      uint16_t ord = raw & 0xffff;
+      ordinal = ord > 0xfff0 ? static_cast<int16_t>(ord) : ord;
+      weak = (raw >> 16) & 1;
+      nameOffset = raw >> 32;
+    } else {
+      // lib_ordinal:8, weak_import:1, name_offset:23
+      uint32_t raw;
+      memcpy(&raw, entry, sizeof(raw));
+      raw = m_obj.endian(raw);
+      uint8_t ord = raw & 0xff;
+      ordinal = ord > 0xf0 ? static_cast<int8_t>(ord) : ord;
+      weak = (raw >> 8) & 1;
+      nameOffset = raw >> 9;
+    }
+
+    if (nameOffset >= symbolsSize)
+      return false;
+    const char* name = symbols + nameOffset;
+    fn(dyld_import{
+      std::string_view(name, strnlen(name, symbolsSize - nameOffset)),
+      ordinal, weak});
+  }
+  return true;
+}
+
+// -----------------------------------------------------------
+
+mach_fat_object::mach_fat_object()
+  : m_hdr{nullptr}
+  , m_fat_arch{}
+  , m_objects{}
+{}
+
+mach_fat_object::mach_fat_object(std::ifstream& file)
+  : m_hdr{nullptr}
+  , m_fat_arch{}
+  , m_objects{}
+{
+  if (!readArchs(file))
+    return;
 
   // load objects from within this fat object
   for (const auto& arch : m_fat_arch) {
@@ -1302,6 +2258,57 @@ mach_fat_object::mach_fat_object(std::ifstream& file)
   }
 }
 
+mach_fat_object::mach_fat_object(PathRef path, bool loadData)
+  : m_hdr{nullptr}
+  , m_fat_arch{}
+  , m_objects{}
+{
+  std::ifstream file{path.string(), std::ios::binary};
+  if (!readArchs(file))
+    return;
+
+  // each slice is its own byte range, parse them side by side
+  std::vector<std::unique_ptr<mach_object>> objs(m_fat_arch.size());
+  ThreadPool::shared().parallelFor(objs.size(), [&](size_t i) {
+    std::ifstream slice{path.string(), std::ios::binary};
+    slice.seekg(m_fat_arch[i].offset());
+    auto obj = std::make_unique<mach_object>(slice, loadData);
+    if (slice)
+      objs[i] = std::move(obj);
+  });
+
+  for (auto& obj : objs) {
+    if (!obj) {
+      fail();
+      return;
+    }
+    m_objects.emplace_back(std::move(*obj));
+  }
+}
+
+bool
+mach_fat_object::readArchs(std::ifstream& file)
+{
+  auto hdr = std::make_unique<fat_header>(file);
+  if (!file || hdr->magic() != FatMagic)
+    return false;
+
+  m_hdr = std::move(hdr);
+
+  // load architecture
+  for (size_t i = 0, end = m_hdr->nfat_arch(); i < end; ++i) {
+    fat_arch arch{file, *this};
+    if (!file || !arch.size()) {
+      fail();
+      return false;
+    }
+
+    m_fat_arch.emplace_back(std::move(arch));
+  }
+
+  return true;
+}
+
 bool
 mach_fat_object::isBigEndian() const
 {
@@ -1315,7 +2322,7 @@ mach_fat_object::failure() const
 }
 
 bool
-mach_fat_object::write(std::ofstream& file)
+mach_fat_object::writeArchs(std::ofstream& file)
 {
   if (failure()) return false;
 
@@ -1326,19 +2333,140 @@ mach_fat_object::write(std::ofstream& file)
     if (!arch.write(file, this))
       return false;
   }
+  return true;
+}
 
-  auto pos = file.tellp();
-  auto alignPos = pos + (8 - pos % 8);
-  file.seekp(alignPos);
+bool
+mach_fat_object::write(std::ofstream& file)
+{
+  if (!writeArchs(file))
+    return false;
 
+  // objects knows their own position in file
   for (auto& obj : m_objects) {
-    if (obj.write(file))
+    if (!obj.write(file))
       return false;
   }
 
   return true;
 }
 
+bool
+mach_fat_object::write(PathRef path)
+{
+  {
+    std::ofstream file{path.string(), std::ios::binary | std::ios::trunc};
+    if (!file || !writeArchs(file))
+      return false;
+  }
+
+  // slices don't overlap, each gets its own stream into the same file
+  std::vector<char> ok(m_objects.size(), false);
+  ThreadPool::shared().parallelFor(m_objects.size(), [&](size_t i) {
+    std::ofstream file{path.string(),
+                       std::ios::binary | std::ios::in | std::ios::out};
+    ok[i] = file && m_objects[i].write(file);
+  });
+
+  return std::all_of(ok.begin(), ok.end(), [](char v) { return v; });
+}
+
+// static
+bool
+mach_fat_object::thin(PathRef src, PathRef dest,
+                      const std::vector<std::string>& keepArchs)
+{
+  auto wanted = [&](CpuType type, cpu_subtype_t subtype) {
+    return std::any_of(keepArchs.begin(), keepArchs.end(),
+      [&](const std::string& arch) {
+        return archMatches(type, subtype, arch);
+      });
+  };
+
+  std::ifstream file{src.string(), std::ios::binary};
+  mach_fat_object fat;
+  std::vector<fat_arch> keep;
+  uint64_t wholeSize = 0;
+  if (fat.readArchs(file)) {
+    for (const auto& arch : fat.m_fat_arch)
+      if (wanted(arch.cputype(), arch.cpusubtype()))
+        keep.push_back(arch);
+  } else {
+    // already thin, keep it if it is the right one
+    file.clear();
+    file.seekg(0);
+    Magic magic = static_cast<Magic>(readMagic(file));
+    uint32_t cputype = 0, cpusubtype = 0;
+    readInto(file, &cputype);
+    readInto(file, &cpusubtype);
+    if (magic == Cigam32 || magic == Cigam64) {
+      cputype = reverseEndian(cputype);
+      cpusubtype = reverseEndian(cpusubtype);
+    }
+    if (!file || (magic != Magic32 && magic != Magic64 &&
+                  magic != Cigam32 && magic != Cigam64))
+    {
+      std::cerr << "Not a mach-o file " << src << "\n";
+      return false;
+    }
+    if (wanted(static_cast<CpuType>(cputype), cpusubtype))
+      wholeSize = std::filesystem::file_size(src);
+  }
+
+  if (keep.empty() && !wholeSize) {
+    std::cerr << "No requested architecture in " << src << "\n";
+    return false;
+  }
+
+  bool keepAll = wholeSize || keep.size() == fat.m_fat_arch.size();
+  if (keepAll && src == dest)
+    return true;
+
+  // write beside dest then move it in place, src might be dest
+  std::string tmpl = dest.string() + ".XXXXXX";
+  int fd = mkstemp(tmpl.data());
+  if (fd < 0)
+    return false;
+  close(fd);
+  Path tmp{tmpl};
+  std::ofstream out{tmp.string(), std::ios::binary | std::ios::trunc};
+  bool ok = out.good();
+  if (ok && wholeSize) {
+    ok = copyRange(file, out, 0, wholeSize);
+  } else if (ok && keep.size() == 1) {
+    ok = copyRange(file, out, keep[0].offset(), keep[0].size());
+  } else if (ok) {
+    // lay out the kept slices again, each at its own alignment
+    std::vector<uint32_t> from;
+    uint64_t pos = sizeof(fat_header) + keep.size() * sizeof(fat_arch);
+    for (auto& arch : keep) {
+      uint64_t align = 1ull << arch.align();
+      pos = (pos + align - 1) & ~(align - 1);
+      from.push_back(arch.offset());
+      arch.setOffset(static_cast<uint32_t>(pos));
+      pos += arch.size();
+    }
+
+    fat.m_hdr->setNfatArch(static_cast<uint32_t>(keep.size()));
+    ok = fat.m_hdr->write(out, &fat);
+    for (size_t i = 0; ok && i < keep.size(); ++i)
+      ok = keep[i].write(out, &fat);
+    for (size_t i = 0; ok && i < keep.size(); ++i) {
+      out.seekp(keep[i].offset());
+      ok = copyRange(file, out, from[i], keep[i].size());
+    }
+  }
+  out.close();
+
+  if (ok && !out.fail() && replaceFile(tmp, dest, src))
+    return true;
+
+  std::cerr << "Failed to thin " << src << " into " << dest << "\n";
+  std::error_code err;
+  std::filesystem::remove(tmp, err);
+  return false;
+}
+
 std::vector<mach_object>&
 mach_fat_object::objects()
 {
@@ -1354,13 +2482,235 @@ mach_fat_object::architectures() const
 void
 mach_fat_object::fail()
 {
-  m_hdr.release();
+  m_hdr.reset();
   m_fat_arch.clear();
   m_objects.clear();
 }
 
 // -----------------------------------------------------------
 
+introspect_writer::introspect_writer(std::ostream& out, Format format)
+  : m_out{out}
+  , m_format{format}
+  , m_depth{0}
+  , m_first{true}
+  , m_titled{false}
+{}
+
+introspect_writer::Format
+introspect_writer::format() const
+{
+  return m_format;
+}
+
+void
+introspect_writer::beginRecord(const char* title, int index)
+{
+  m_titled = title != nullptr;
+  m_depth = 1;
+  m_first = true;
+  if (m_format == NDJson) {
+    m_out << '{';
+    if (index > -1)
+      field("index", index);
+  } else if (m_titled) {
+    m_out << title;
+    if (index > -1)
+      m_out << ' ' << index;
+    m_out << '\n';
+  }
+}
+
+void
+introspect_writer::endRecord()
+{
+  if (m_format == NDJson)
+    m_out << "}\n";
+  else if (m_titled)
+    m_out << "-----------------------------------------------\n";
+  m_depth = 0;
+}
+
+void
+introspect_writer::field(std::string_view key, std::string_view vlu)
+{
+  this->key(key);
+  if (m_format == NDJson)
+    string(vlu);
+  else
+    m_out << vlu << '\n';
+}
+
+void
+introspect_writer::field(std::string_view key, const char* vlu)
+{
+  field(key, std::string_view{vlu});
+}
+
+void
+introspect_writer::field(std::string_view key, bool vlu)
+{
+  number(key, vlu ? "true" : "false");
+}
+
+void
+introspect_writer::bytes(
+  std::string_view key, const char* buf, size_t nBytes
+) {
+  static const char digits[] = "0123456789abcdef";
+  this->key(key);
+  if (m_format == NDJson) {
+    m_out << '"';
+    for (size_t i = 0; i < nBytes; ++i)
+      m_out << digits[(buf[i] >> 4) & 0xF] << digits[buf[i] & 0xF];
+    m_out << '"';
+    return;
+  }
+
+  m_out << '\n';
+  char line[16 * 5 + 16];
+  for (size_t i = 0; i < nBytes; i += 16) {
+    size_t len = std::min<size_t>(16, nBytes - i);
+    char* ptr = line + snprintf(line, sizeof(line), "%08zx", i);
+    for (size_t j = 0; j < len; ++j) {
+      *ptr++ = ' ';
+      *ptr++ = digits[(buf[i+j] >> 4) & 0xF];
+      *ptr++ = digits[buf[i+j] & 0xF];
+    }
+    *ptr++ = ' ';
+    for (size_t j = 0; j < len; ++j) {
+      *ptr++ = ' ';
+      *ptr++ = buf[i+j] >= ' ' ? buf[i+j] : '.';
+    }
+    indent();
+    m_out.write(line, ptr - line) << '\n';
+  }
+}
+
+void
+introspect_writer::beginList(std::string_view key)
+{
+  if (m_format == NDJson) {
+    this->key(key);
+    m_out << '[';
+    m_first = true;
+  } else {
+    indent();
+    m_out << key << ":\n";
+  }
+  ++m_depth;
+}
+
+void
+introspect_writer::endList()
+{
+  if (m_format == NDJson) {
+    m_out << ']';
+    m_first = false;
+  }
+  --m_depth;
+}
+
+void
+introspect_writer::value(std::string_view vlu)
+{
+  if (m_format == NDJson) {
+    separate();
+    string(vlu);
+  } else {
+    indent();
+    m_out << vlu << '\n';
+  }
+}
+
+void
+introspect_writer::beginItem(std::string_view title)
+{
+  if (m_format == NDJson) {
+    separate();
+    m_out << '{';
+    m_first = true;
+  } else {
+    indent();
+    m_out << title << " -------------------\n";
+  }
+  ++m_depth;
+}
+
+void
+introspect_writer::endItem()
+{
+  if (m_format == NDJson) {
+    m_out << '}';
+    m_first = false;
+  }
+  --m_depth;
+}
+
+void
+introspect_writer::key(std::string_view key)
+{
+  if (m_format == NDJson) {
+    separate();
+    string(key);
+    m_out << ':';
+  } else {
+    indent();
+    m_out << key << ' ';
+  }
+}
+
+void
+introspect_writer::separate()
+{
+  if (!m_first)
+    m_out << ',';
+  m_first = false;
+}
+
+void
+introspect_writer::indent()
+{
+  for (int i = 0; i < m_depth; ++i)
+    m_out << "  ";
+}
+
+void
+introspect_writer::string(std::string_view vlu)
+{
+  static const char digits[] = "0123456789abcdef";
+  m_out << '"';
+  size_t from = 0;
+  for (size_t i = 0; i < vlu.size(); ++i) {
+    unsigned char ch = vlu[i];
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+    m_out.write(vlu.data() + from, i - from);
+    from = i + 1;
+    switch (ch) {
+    case '"':  m_out << "\\\""; break;
+    case '\\': m_out << "\\\\"; break;
+    case '\n': m_out << "\\n"; break;
+    case '\t': m_out << "\\t"; break;
+    default:
+      m_out << "\\u00" << digits[ch >> 4] << digits[ch & 0xF];
+    }
+  }
+  m_out.write(vlu.data() + from, vlu.size() - from);
+  m_out << '"';
+}
+
+void
+introspect_writer::number(std::string_view key, const std::string& vlu)
+{
+  this->key(key);
+  m_out << vlu;
+  if (m_format == Text)
+    m_out << '\n';
+}
+
+// -----------------------------------------------------------
+
 introspect_object::introspect_object(const mach_object* obj)
   : m_obj{obj}
 {}
@@ -1368,298 +2718,288 @@ introspect_object::introspect_object(const mach_object* obj)
 std::string
 introspect_object::loadCmds() const
 {
+  std::stringstream ss;
+  loadCmds(ss, introspect_writer::Text);
+  return ss.str();
+}
+
+void
+introspect_object::loadCmds(
+  std::ostream& os, introspect_writer::Format format
+) const {
   auto getStr = [&](const lc_str lc, const load_command_bytes& cmd){
     return &cmd.bytes.get()[lc.offset - sizeof(load_command)];
   };
 
-  std::stringstream ss;
+  introspect_writer out{os, format};
   int cmdNr = 0;
   for (const auto& cmd : m_obj->loadCommands()) {
-    ss << std::setw(9) << std::right
-       << "Load command " << cmdNr++ << "\n"
-       << " cmd " << LoadCmdStr(cmd.cmd()) << "\n"
-       << "  cmdsize " << cmd.cmdsize() << "\n";
+    out.beginRecord("Load command", cmdNr++);
+    out.field("cmd", LoadCmdStr(cmd.cmd()));
+    out.field("cmdsize", cmd.cmdsize());
 
     switch (cmd.cmd()) {
     case LC_SUB_FRAMEWORK: {
       lc_str lc{cmd.bytes.get(), *m_obj};
-      ss << "  umbrella " << getStr(lc, cmd) << "\n";
+      out.field("umbrella", getStr(lc, cmd));
     } break;
     case LC_SUB_CLIENT:{
       lc_str lc{cmd.bytes.get(), *m_obj};
-      ss << "  sub_umbrella " << getStr(lc, cmd) << "\n";
+      out.field("sub_umbrella", getStr(lc, cmd));
     } break;
     case LC_SUB_LIBRARY:{
       lc_str lc{cmd.bytes.get(), *m_obj};
-      ss << "  sub_library " << getStr(lc, cmd) << "\n";
+      out.field("sub_library", getStr(lc, cmd));
     } break;
     case LC_ID_DYLINKER:
     case LC_LOAD_DYLINKER:
 		case LC_DYLD_ENVIRONMENT:{
       lc_str lc{cmd.bytes.get(), *m_obj};
-      ss << "  name " << getStr(lc, cmd) << "\n";
+      out.field("name", getStr(lc, cmd));
     } break;
     case LC_PREBOUND_DYLIB: {
       prebound_dylib_command pre{cmd, *m_obj};
-      ss << "  name " << getStr(pre.name(), cmd) << "\n"
-         << "  nmodules " << pre.nmodules() << "\n"
-         << "  linked_modules " << getStr(pre.linked_modules(), cmd)
-         << "\n";
+      out.field("name", getStr(pre.name(), cmd));
+      out.field("nmodules", pre.nmodules());
+      out.field("linked_modules", getStr(pre.linked_modules(), cmd));
     } break;
     case LC_ROUTINES: {
       routines_command rout{cmd, *m_obj};
-      ss << "  init_address " << rout.init_address() << "\n"
-         << "  init_module " << rout.init_module() << "\n"
-         << "  reserved1 " << rout.reserved1() << "\n"
-         << "  reserved2 " << rout.reserved2() << "\n"
-         << "  reserved3 " << rout.reserved3() << "\n"
-         << "  reserved4 " << rout.reserved4() << "\n"
-         << "  reserved5 " << rout.reserved5() << "\n"
-         << "  reserved6 " << rout.reserved6() << "\n";
-
+      out.field("init_address", rout.init_address());
+      out.field("init_module", rout.init_module());
+      out.field("reserved1", rout.reserved1());
+      out.field("reserved2", rout.reserved2());
+      out.field("reserved3", rout.reserved3());
+      out.field("reserved4", rout.reserved4());
+      out.field("reserved5", rout.reserved5());
+      out.field("reserved6", rout.reserved6());
     } break;
     case LC_ROUTINES_64: {
       routines_command_64 rout{cmd, *m_obj};
-      ss << "  init_address " << rout.init_address() << "\n"
-         << "  init_module " << rout.init_module() << "\n"
-         << "  reserved1 " << rout.reserved1() << "\n"
-         << "  reserved2 " << rout.reserved2() << "\n"
-         << "  reserved3 " << rout.reserved3() << "\n"
-         << "  reserved4 " << rout.reserved4() << "\n"
-         << "  reserved5 " << rout.reserved5() << "\n"
-         << "  reserved6 " << rout.reserved6() << "\n";
-
+      out.field("init_address", rout.init_address());
+      out.field("init_module", rout.init_module());
+      out.field("reserved1", rout.reserved1());
+      out.field("reserved2", rout.reserved2());
+      out.field("reserved3", rout.reserved3());
+      out.field("reserved4", rout.reserved4());
+      out.field("reserved5", rout.reserved5());
+      out.field("reserved6", rout.reserved6());
     } break;
     case LC_SYMTAB: {
       symtab_command sym{cmd, *m_obj};
-      ss << "  symoff " << sym.symoff() << "\n"
-         << "  syms " << sym.syms() << "\n"
-         << "  stroff " << sym.stroff() << "\n"
-         << "  strsize " << sym.strsize() << "\n";
+      out.field("symoff", sym.symoff());
+      out.field("syms", sym.syms());
+      out.field("stroff", sym.stroff());
+      out.field("strsize", sym.strsize());
     } break;
     case LC_DYSYMTAB: {
       dysymtab_command dsym{cmd, *m_obj};
-      ss << "  ilocalsym " << dsym.ilocalsym() << "\n"
-         << "  nlocalsym " << dsym.nlocalsym() << "\n"
-         << "  iextsym "  << dsym.iextsym() << "\n"
-         << "  nextsym " << dsym.nextsym() << "\n"
-         << "  iundefsym " << dsym.iundefsym() << "\n"
-         << "  nundefsym " << dsym.nundefsym() << "\n"
-         << "  tocoff " << dsym.tocoff() << "\n"
-         << "  ntoc " << dsym.ntoc() << "\n"
-         << "  modtaboff " << dsym.modtaboff() << "\n"
-         << "  nmodtab " << dsym.nmodtab() << "\n"
-         << "  extrefsymoff " << dsym.extrefsymoff() << "\n"
-         << "  nextrefsyms " << dsym.nextrefsyms() << "\n"
-         << "  indirectsymsoff " << dsym.indirectsymsoff() << "\n"
-         << "  nindrectsyms " << dsym.nindrectsyms() << "\n"
-         << "  extreloff " << dsym.extreloff() << "\n"
-         << "  nextrel " << dsym.nextrel() << "\n"
-         << "  locreloff " << dsym.locreloff() << "\n"
-         << "  locrel " << dsym.locrel() << "\n";
+      out.field("ilocalsym", dsym.ilocalsym());
+      out.field("nlocalsym", dsym.nlocalsym());
+      out.field("iextsym", dsym.iextsym());
+      out.field("nextsym", dsym.nextsym());
+      out.field("iundefsym", dsym.iundefsym());
+      out.field("nundefsym", dsym.nundefsym());
+      out.field("tocoff", dsym.tocoff());
+      out.field("ntoc", dsym.ntoc());
+      out.field("modtaboff", dsym.modtaboff());
+      out.field("nmodtab", dsym.nmodtab());
+      out.field("extrefsymoff", dsym.extrefsymoff());
+      out.field("nextrefsyms", dsym.nextrefsyms());
+      out.field("indirectsymsoff", dsym.indirectsymsoff());
+      out.field("nindrectsyms", dsym.nindrectsyms());
+      out.field("extreloff", dsym.extreloff());
+      out.field("nextrel", dsym.nextrel());
+      out.field("locreloff", dsym.locreloff());
+      out.field("locrel", dsym.locrel());
     } break;
     case LC_DYLD_INFO:
     case LC_DYLD_INFO_ONLY: {
       dyld_info_command dinfo{cmd, *m_obj};
-      ss << "  rebase_off " << dinfo.rebase_off() << "\n"
-         << "  rebase_size " << dinfo.rebase_size() << "\n"
-         << "  bind_off " << dinfo.bind_off() << "\n"
-         << "  bind_size " << dinfo.bind_size() << "\n"
-         << "  weak_bind_off " << dinfo.weak_bind_off() << "\n"
-         << "  weak_bind_size " << dinfo.weak_bind_size() << "\n"
-         << "  lazy_bind_off " << dinfo.lazy_bind_off() << "\n"
-         << "  lazy_bind_size " << dinfo.lazy_bind_size() << "\n"
-         << "  export_off " << dinfo.export_off() << "\n"
-         << "  export_size " << dinfo.export_size() << "\n";
-
+      out.field("rebase_off", dinfo.rebase_off());
+      out.field("rebase_size", dinfo.rebase_size());
+      out.field("bind_off", dinfo.bind_off());
+      out.field("bind_size", dinfo.bind_size());
+      out.field("weak_bind_off", dinfo.weak_bind_off());
+      out.field("weak_bind_size", dinfo.weak_bind_size());
+      out.field("lazy_bind_off", dinfo.lazy_bind_off());
+      out.field("lazy_bind_size", dinfo.lazy_bind_size());
+      out.field("export_off", dinfo.export_off());
+      out.field("export_size", dinfo.export_size());
     } break;
     case LC_TWOLEVEL_HINTS: {
       twolevel_hints_command lvl{cmd, *m_obj};
-      ss << "  offset " << lvl.offset() << "\n"
-         << "  nhints " << lvl.nhints() << "\n";
-      if (lvl.nhints())
-        ss << "Hints ----------------------------------\n";
+      out.field("offset", lvl.offset());
+      out.field("nhints", lvl.nhints());
+      out.beginList("hints");
       for (size_t i = 0; i < lvl.nhints(); ++i) {
         size_t offset = sizeof(twolevel_hints_command) - sizeof(load_command);
         offset += sizeof(twolevel_hint) * i;
         twolevel_hint hint{&cmd.bytes.get()[offset], *m_obj};
-        ss << "    isubimage " << hint.isubimage() << "\n"
-           << "    itoc " << hint.itoc() << "\n";
+        out.beginItem("Hint");
+        out.field("isubimage", hint.isubimage());
+        out.field("itoc", hint.itoc());
+        out.endItem();
       }
+      out.endList();
     } break;
     case LC_SOURCE_VERSION: {
       source_version_command src{cmd, *m_obj};
-      ss << "  version " << sourceVersionStr(src.version()) << "\n";
-
+      out.field("version", sourceVersionStr(src.version()));
     } break;
     case LC_VERSION_MIN_MACOSX:
 		case LC_VERSION_MIN_IPHONEOS:
 		case LC_VERSION_MIN_WATCHOS:
 		case LC_VERSION_MIN_TVOS: {
       version_min_command ver{cmd, *m_obj};
-      ss << "  version " << versionStr(ver.version()) << "\n"
-         << "  sdk " << versionStr(ver.sdk()) << "\n";
+      out.field("version", versionStr(ver.version()));
+      out.field("sdk", versionStr(ver.sdk()));
     } break;
     case LC_BUILD_VERSION:
-      ss << buildVersionToStr(cmd);
+      buildVersion(out, cmd);
       break;
     case LC_IDFVMLIB:
     case LC_LOADFVMLIB: {
       fwlib_command fwlib{cmd, *m_obj};
-      ss << "  name " << getStr(fwlib.name(), cmd) << "\n"
-         << "  minor_version " << fwlib.minor_version() << "\n";
+      out.field("name", getStr(fwlib.name(), cmd));
+      out.field("minor_version", fwlib.minor_version());
     } break;
     case LC_PREBIND_CKSUM: {
       prebind_checksum_command pre{cmd, *m_obj};
-      ss << "  chksum " << toChkSumStr(pre.chksum()) << "\n";
+      out.field("chksum", toChkSumStr(pre.chksum()));
     } break;
     case LC_UUID:
       // should always be stored as bigendian
-      ss << "  uuid " << toUUID(cmd.bytes.get()) << "\n";
+      out.field("uuid", toUUID(cmd.bytes.get()));
       break;
     case LC_SEGMENT:
-      ss << segmentToStr<segment_command, section>(cmd);
+      segment<segment_command, section>(out, cmd);
       break;
     case LC_SEGMENT_64:
-      ss << segmentToStr<segment_command_64, section_64>(cmd);
+      segment<segment_command_64, section_64>(out, cmd);
       break;
     case LC_ID_DYLIB:
     case LC_LOAD_DYLIB:
     case LC_LOAD_WEAK_DYLIB:
     case LC_REEXPORT_DYLIB: {
       dylib_command dylib{cmd, *m_obj};
-      ss << "  name " << getStr(dylib.name(), cmd) << "\n"
-         << "  timestamp " <<
-          timestampStr(dylib.timestamp()) << "\n"
-         << "  current_version " <<
-          versionStr(dylib.current_version()) << "\n"
-         << "  compatibility_version " <<
-          versionStr(dylib.compatibility_version()) << "\n";
+      out.field("name", getStr(dylib.name(), cmd));
+      out.field("timestamp", timestampStr(dylib.timestamp()));
+      out.field("current_version", versionStr(dylib.current_version()));
+      out.field("compatibility_version",
+                versionStr(dylib.compatibility_version()));
     } break;
     case LC_RPATH: {
       lc_str lc{cmd.bytes.get(), *m_obj};
-      ss << "  path " << getStr(lc, cmd) << "\n";
+      out.field("path", getStr(lc, cmd));
     } break;
     case LC_CODE_SIGNATURE:
     case LC_SEGMENT_SPLIT_INFO:
     case LC_FUNCTION_STARTS:
     case LC_DATA_IN_CODE:
 		case LC_DYLIB_CODE_SIGN_DRS:
-    case LC_LINKER_OPTIMIZATION_HINT: {
+    case LC_LINKER_OPTIMIZATION_HINT:
+    case LC_DYLD_EXPORTS_TRIE:
+    case LC_DYLD_CHAINED_FIXUPS: {
       linkedit_data_command link{cmd, *m_obj};
-      ss << "  dataoff " << link.dataoff() << "\n"
-            "  datasize " << link.datasize() << "\n";
+      out.field("dataoff", link.dataoff());
+      out.field("datasize", link.datasize());
     } break;
     case LC_LINKER_OPTION: {
       linker_option_command opt{cmd, *m_obj};
-      ss << "  count " << opt.count() << "\n";
-      if (opt.count())
-        ss << "Options ---------------------------\n";
-      for (size_t i = 0, len = 0; i < opt.count(); ++i) {
-        size_t offset = sizeof(linker_option_command);
-        offset += len;
-        len = strnlen(&cmd.bytes.get()[offset], cmd.cmdsize());
-        ss << "    " << &cmd.bytes.get()[offset] << "\n";
+      out.field("count", opt.count());
+      out.beginList("options");
+      size_t offset = sizeof(linker_option_command) - sizeof(load_command);
+      for (size_t i = 0; i < opt.count() && offset < cmd.cmdsize(); ++i) {
+        const char* str = &cmd.bytes.get()[offset];
+        size_t len = strnlen(str, cmd.cmdsize() - offset);
+        out.value(std::string_view{str, len});
+        offset += len + 1;
       }
+      out.endList();
     } break;
     case LC_ENCRYPTION_INFO:
     case LC_ENCRYPTION_INFO_64: {
       encryption_info_command enc{cmd, *m_obj};
-      ss << "  cryptoff " << enc.cryptoff() << "\n"
-         << "  cryptsize " << enc.cryptsize() << "\n"
-         << "  cryptid" << enc.cryptid() << "\n";
+      out.field("cryptoff", enc.cryptoff());
+      out.field("cryptsize", enc.cryptsize());
+      out.field("cryptid", enc.cryptid());
     } break;
     case LC_MAIN: {
       entry_point_command ent{cmd, *m_obj};
-      ss << "  entryoff " << ent.entryoff() << "\n"
-         << "  stacksize " << ent.stacksize() << "\n";
+      out.field("entryoff", ent.entryoff());
+      out.field("stacksize", ent.stacksize());
     } break;
     case LC_FVMFILE: {
       fvmfile_command fvm{cmd, *m_obj};
-      ss << "  name " << getStr(fvm.name(), cmd) << "\n";
-      ss << "  header_addr " << std::setfill('0')
-         << std::setw(8)  << std::hex << fvm.header_addr();
-    } break;
-    default:{
-      hexdump(ss, cmd.bytes.get(),
-        cmd.cmdsize() - sizeof(load_command));
+      out.field("name", getStr(fvm.name(), cmd));
+      out.field("header_addr", hexString(fvm.header_addr()));
     } break;
+    default:
+      out.bytes("bits", cmd.bytes.get(),
+                cmd.cmdsize() - sizeof(load_command));
+      break;
     }
 
-    ss << "-----------------------------------------------\n";
+    out.endRecord();
   }
-  return ss.str();
 }
 
 std::string
 introspect_object::targetInfo() const
 {
+  std::stringstream ss;
+  targetInfo(ss, introspect_writer::Text);
+  return ss.str();
+}
+
+void
+introspect_object::targetInfo(
+  std::ostream& os, introspect_writer::Format format
+) const {
   auto cmds = m_obj->filterCmds(LC_BUILD_VERSION);
+  if (cmds.empty() && format == introspect_writer::Text) {
+    os << "Target info not found!\n";
+    return;
+  }
+
+  introspect_writer out{os, format};
+  out.beginRecord();
   if (cmds.size())
-    return buildVersionToStr(*cmds[0]);
-  return "Target info not found!\n";
+    buildVersion(out, *cmds[0]);
+  out.endRecord();
 }
 
-std::string
-introspect_object::buildVersionToStr(
-  const load_command_bytes& cmd
+void
+introspect_object::buildVersion(
+  introspect_writer& out, const load_command_bytes& cmd
 ) const {
-  std::stringstream ss;
   build_version_command bver{cmd, *m_obj};
-  ss << "  platform " << PlatformsStr(bver.platform()) << "\n"
-      << "  minos " << versionStr(bver.minos()) << "\n"
-      << "  sdk " << versionStr(bver.sdk()) << "\n"
-      << "  tools " << ToolsStr(bver.tools()) << "\n";
-      if (bver.tools())
-        ss << "Tools ------------------------------\n   tool:\n";
+  out.field("platform", PlatformsStr(bver.platform()));
+  out.field("minos", versionStr(bver.minos()));
+  out.field("sdk", versionStr(bver.sdk()));
+  out.field("ntools", static_cast<uint32_t>(bver.tools()));
+  out.beginList("tools");
   for (size_t i = 0; i < bver.tools(); ++i) {
     size_t offset = sizeof(build_version_command) - sizeof(load_command);
     offset += sizeof(build_tool_version) * i;
     build_tool_version tver{&cmd.bytes.get()[offset], *m_obj};
-    ss << "    tool " << ToolsStr(tver.tool()) << "\n"
-        << "    version " << versionStr(tver.version()) << "\n";
+    out.beginItem("Tool");
+    out.field("tool", ToolsStr(tver.tool()));
+    out.field("version", versionStr(tver.version()));
+    out.endItem();
   }
-
-  return ss.str();
+  out.endList();
 }
 
-std::stringstream&
-introspect_object::hexdump(
-  std::stringstream& ss, const char* buf, size_t nBytes
-) const {
-  ss << "  bits:\n";
-  for (size_t i = 0; i < nBytes; i += 16) {
-    ss << "  " << std::setfill('0') << std::setw(8)
-        << std::hex << i << std::setw(2);
-
-    for (size_t j = 0; j < 16; ++j) {
-      auto byte = buf[i+j];
-      ss << " " << std::right << std::setfill('0')
-          << std::setw(2) << std::hex
-          << ((uint16_t)byte & 0x00FF);
-    }
-
-    ss << "  " << std::setw(0);
-    for ( size_t j = 0; j < 16; ++j) {
-      auto byte = buf[i+j];
-      ss << (byte >= ' ' ? byte : '.') << ' ';
-    }
-    ss << '\n';
-  }
-  ss << std::dec;
-  return ss;
-}
-
-
 std::string
 introspect_object::versionStr(uint32_t version) const
 {
-  std::stringstream ss;
-  uint32_t major = ((version >> 16) & 0xFFFF),
-           minor = ((version >> 8) & 0xFF),
-           micro = (version & 0xFF);
-  ss << major << "." << minor << "." << micro;
-  return ss.str();
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%u.%u.%u",
+           (version >> 16) & 0xFFFF, (version >> 8) & 0xFF,
+           version & 0xFF);
+  return buf;
 }
 
 std::string
@@ -1667,9 +3007,9 @@ introspect_object::timestampStr(uint32_t timestamp) const
 {
   time_t temp = timestamp;
   std::tm* t = std::gmtime(&temp);
-  std::stringstream ss; // or if you're going to print, just input directly into the output stream
-  ss << std::put_time(t, "%Y-%m-%d %I:%M:%S %p");
-  return ss.str();
+  char buf[32] = {0};
+  strftime(buf, sizeof(buf), "%Y-%m-%d %I:%M:%S %p", t);
+  return buf;
 }
 
 std::string
@@ -1721,8 +3061,128 @@ introspect_object::sourceVersionStr(uint64_t version) const
 }
 // -----------------------------------------------------------
 
-MachOLoader::MachOLoader(PathRef binPath)
+bool
+path_rewriter::addRule(std::string_view line)
+{
+  std::vector<std::string> fields;
+  std::istringstream ss{std::string(line)};
+  for (std::string field; ss >> field;)
+    fields.push_back(field);
+
+  if (fields.empty() || fields[0][0] == '#')
+    return true;
+
+  auto bad = [&](const std::string& why) {
+    std::cerr << "Bad rewrite rule '" << line << "', " << why << "\n";
+    return false;
+  };
+  if (fields.size() != 4)
+    return bad("expected: <targets> <prefix|regex> <match> <replacement>");
+
+  rule r{0, fields[2], fields[3], std::nullopt};
+  std::istringstream targets{fields[0]};
+  for (std::string target; std::getline(targets, target, ',');) {
+    if (target == "all")        r.targets |= All;
+    else if (target == "load")  r.targets |= Load;
+    else if (target == "id")    r.targets |= Id;
+    else if (target == "rpath") r.targets |= RPath;
+    else
+      return bad("unknown target " + target);
+  }
+
+  if (fields[1] == "regex") {
+    try {
+      r.regex.emplace(r.match, std::regex::ECMAScript | std::regex::optimize);
+    } catch (const std::regex_error& e) {
+      return bad(e.what());
+    }
+  } else if (fields[1] != "prefix") {
+    return bad("unknown kind " + fields[1]);
+  }
+
+  m_rules.push_back(std::move(r));
+  return true;
+}
+
+bool
+path_rewriter::readRules(PathRef path)
+{
+  std::ifstream file{path.string()};
+  if (!file) {
+    std::cerr << "Failed to read rules from " << path << "\n";
+    return false;
+  }
+
+  bool ok = true;
+  for (std::string line; std::getline(file, line);) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    ok = addRule(line) && ok;
+  }
+  return ok;
+}
+
+std::optional<std::string>
+path_rewriter::rewrite(std::string_view path, Targets target) const
+{
+  for (const auto& r : m_rules) {
+    if (!(r.targets & target))
+      continue;
+    if (r.regex) {
+      std::match_results<std::string_view::const_iterator> match;
+      if (std::regex_match(path.begin(), path.end(), match, *r.regex))
+        return match.format(r.replacement);
+    } else if (path.substr(0, r.match.size()) == r.match) {
+      return r.replacement + std::string(path.substr(r.match.size()));
+    }
+  }
+  return std::nullopt;
+}
+
+bool
+path_rewriter::apply(mach_object& obj, size_t& changed) const
+{
+  // copy the names first, edits replace the command buffers
+  auto names = [&](std::vector<LoadCmds> types) {
+    std::vector<std::string> strs;
+    for (const auto cmd : obj.filterCmds(types)) {
+      lc_str lc{cmd->bytes.get(), obj};
+      strs.emplace_back(lc.str(cmd->bytes.get()));
+    }
+    return strs;
+  };
+
+  bool ok = true;
+  auto edit = [&](const std::vector<std::string>& paths, Targets target,
+                  const std::function<bool(PathRef, PathRef)>& change)
+  {
+    for (const auto& path : paths) {
+      auto to = rewrite(path, target);
+      if (!to || *to == path)
+        continue;
+      if (change(Path(path), Path(*to)))
+        ++changed;
+      else
+        ok = false;
+    }
+  };
+
+  edit(names({LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB}), Load,
+       [&](PathRef from, PathRef to) {
+         return obj.changeDylibPaths(from, to);
+       });
+  edit(names({LC_ID_DYLIB}), Id,
+       [&](PathRef, PathRef to) { return obj.changeId(to); });
+  edit(names({LC_RPATH}), RPath,
+       [&](PathRef from, PathRef to) { return obj.changeRPath(from, to); });
+  return ok;
+}
+
+// -----------------------------------------------------------
+
+MachOLoader::MachOLoader(PathRef binPath, bool loadData)
   : m_binPath{binPath}
+  , m_hasMagic{true}
 {
   std::ifstream file;
   file.open(binPath.string(), std::ios::binary);
@@ -1731,21 +3191,23 @@ MachOLoader::MachOLoader(PathRef binPath)
 
   switch (magic) {
   case FatMagic: case FatCigam:
-    m_fat = std::make_unique<mach_fat_object>(file);
-    if (!file) {
-      m_fat.release();
+    file.close();
+    m_fat = std::make_unique<mach_fat_object>(binPath, loadData);
+    if (m_fat->failure()) {
+      m_fat.reset();
       std::cerr << "A failure occurred reading fat object\n";
     }
     break;
   case Magic32: case Cigam32:
   case Magic64: case Cigam64:
-    m_object = std::make_unique<mach_object>(file);
+    m_object = std::make_unique<mach_object>(file, loadData);
     if (!file) {
-      m_object.release();
+      m_object.reset();
       std::cerr << "A failure occurred\n";
     }
     break;
-  default: return;
+  default:
+    m_hasMagic = false;
   }
 }
 
@@ -1762,21 +3224,72 @@ MachOLoader::isObject() const
 }
 
 bool
-MachOLoader::write(PathRef path, bool overwrite)
+MachOLoader::hasMagic() const
 {
-  if (!overwrite && std::filesystem::exists(path))
-    return false;
+  return m_hasMagic;
+}
 
-  std::ofstream file;
-  file.open(path.string(), std::ios::binary);
-  if (!file)
+bool
+MachOLoader::write(PathRef path, bool overwrite)
+{
+  if ((!overwrite && std::filesystem::exists(path)) || (!m_fat && !m_object))
     return false;
 
+  std::vector<mach_object*> objs;
+  std::vector<uint64_t> ends;
   if (m_fat) {
-    m_fat->write(file);
-  } else if (m_object) {
-    return m_object->write(file);
+    for (size_t i = 0; i < m_fat->objects().size(); ++i) {
+      const auto& arch = m_fat->architectures()[i];
+      objs.push_back(&m_fat->objects()[i]);
+      ends.push_back(uint64_t(arch.offset()) + arch.size());
+    }
+  } else {
+    objs.push_back(m_object.get());
+    ends.push_back(std::filesystem::file_size(m_binPath));
   }
+
+  std::string tmpl = path.string() + ".XXXXXX";
+  int out = mkstemp(tmpl.data());
+  if (out < 0)
+    return false;
+  Path tmp{tmpl};
+  int in = open(m_binPath.c_str(), O_RDONLY);
+  bool ok = in >= 0, dataCopied = false;
+#ifdef __APPLE__
+  // no copy_file_range, copy it all in one call, headers go on top below
+  dataCopied = ok && fcopyfile(in, out, nullptr, COPYFILE_DATA) == 0;
+#endif
+
+  // headers and load commands are small, they come from memory
+  std::ofstream file{tmp.string(), std::ios::binary | std::ios::in | std::ios::out};
+  ok = ok && file && (!m_fat || m_fat->writeArchs(file));
+  for (size_t i = 0; ok && i < objs.size(); ++i)
+    ok = objs[i]->writeCmds(file);
+  file.close();
+  ok = ok && !file.fail();
+
+  // the rest is unchanged, have it copied at the same offsets
+  ok = ok && (dataCopied ||
+              ftruncate(out, std::filesystem::file_size(m_binPath)) == 0);
+  if (ok && !dataCopied) {
+    std::vector<char> copied(objs.size(), false);
+    ThreadPool::shared().parallelFor(objs.size(), [&](size_t i) {
+      uint64_t from = objs[i]->startPos() + objs[i]->firstDataOffset();
+      copied[i] = from > ends[i] ||
+                  copyFileRange(in, out, from, ends[i] - from);
+    });
+    ok = std::all_of(copied.begin(), copied.end(), [](char v) { return v; });
+  }
+  if (in >= 0)
+    close(in);
+  ok = close(out) == 0 && ok;
+
+  if (ok && replaceFile(tmp, path, m_binPath))
+    return true;
+
+  std::cerr << "Failed to write " << path << "\n";
+  std::error_code err;
+  std::filesystem::remove(tmp, err);
   return false;
 }
 
@@ -1792,3 +3305,14 @@ MachOLoader::object()
   return m_object.get();
 }
 
+void
+MachOLoader::forEachObject(const std::function<void(mach_object&)>& fn)
+{
+  if (m_fat) {
+    auto& objs = m_fat->objects();
+    ThreadPool::shared().parallelFor(objs.size(), [&](size_t i) {
+      fn(objs[i]);
+    });
+  } else if (m_object)
+    fn(*m_object);
+}
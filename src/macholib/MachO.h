@@ -28,6 +28,12 @@ THE SOFTWARE.
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <regex>
+#include <string_view>
+#include <unordered_map>
 #include <stdint.h>
 #include "Common.h"
 #include "Types.h"
@@ -82,6 +88,8 @@ using cpu_subtype_t = uint32_t;
 using vm_prot_t = int;
 const cpu_type_t CPU_ARCH_MASK = 0xff000000;		/* mask for architecture bits */
 const cpu_type_t CPU_ARCH_ABI64	= 0x01000000;		/* 64 bit ABI */
+const cpu_type_t CPU_ARCH_ABI64_32 = 0x02000000;	/* 64 bit hw, 32 bit pointers */
+const cpu_subtype_t CPU_SUBTYPE_MASK = 0xff000000;	/* mask for feature flags */
 
 
 enum Magic: uint32_t {
@@ -225,6 +233,7 @@ enum CpuType: uint32_t {
   MH_HPPA     = ((cpu_type_t) 11),
   MH_ARM      = ((cpu_type_t) 12),
   MH_ARM64    = (cpu_type_t) (12 | CPU_ARCH_ABI64),
+  MH_ARM64_32 = (cpu_type_t) (12 | CPU_ARCH_ABI64_32),
   MH_MC88000  = ((cpu_type_t) 13),
   MH_SPARC    = ((cpu_type_t) 14),
   MH_I860     = ((cpu_type_t) 15),
@@ -235,6 +244,10 @@ enum CpuType: uint32_t {
 };
 
 const char* CpuTypeStr(CpuType type);
+/// the name lipo gives type and subtype, ie "arm64e" or "i386"
+std::string archName(CpuType type, cpu_subtype_t subtype);
+/// true if arch, ie "arm64" or "x86_64", names type and subtype
+bool archMatches(CpuType type, cpu_subtype_t subtype, std::string_view arch);
 
 
 /* Constants for the cmd field of all load commands, the type */
@@ -298,7 +311,10 @@ enum LoadCmds: uint32_t {
     LC_VERSION_MIN_TVOS = 0x2F,  /* build for AppleTV min OS version */
     LC_VERSION_MIN_WATCHOS = 0x30,  /* build for Watch min OS version */
     LC_NOTE = 0x31,  /* arbitrary data included within a Mach-O file */
-    LC_BUILD_VERSION =  0x32 /* build for platform min OS version */
+    LC_BUILD_VERSION =  0x32, /* build for platform min OS version */
+    LC_DYLD_EXPORTS_TRIE = (0x33 | LC_REQ_DYLD), /* used with linkedit_data_command, payload is trie */
+    LC_DYLD_CHAINED_FIXUPS = (0x34 | LC_REQ_DYLD), /* used with linkedit_data_command */
+    LC_FILESET_ENTRY = (0x35 | LC_REQ_DYLD) /* used with fileset_entry_command */
 };
 
 
@@ -327,6 +343,7 @@ class mach_object;
 class mach_fat_object;
 class load_command_bytes;
 class data_segment;
+class symbol_table;
 
 template<typename T>
 std::ifstream& readInto(std::ifstream& file, T* dest)
@@ -358,6 +375,7 @@ public:
   bool isBigEndian() const;
   /* number of structs that follow */
   uint32_t nfat_arch() const;
+  void setNfatArch(uint32_t nfat_arch);
 
   bool write(std::ofstream& file, const mach_fat_object* fat);
 
@@ -380,6 +398,7 @@ public:
   uint32_t size() const { return m_size; }
   /* alignment as a power of 2 */
   uint32_t align() const { return m_align; }
+  void setOffset(uint32_t offset) { m_offset = offset; }
 
   bool write(std::ofstream& file, const mach_fat_object* fat);
 
@@ -414,6 +433,7 @@ public:
   bool is64bits() const;
   bool write(std::ofstream& file, const mach_object& obj) const;
   void setSizeofcmds(uint32_t sz) { m_sizeofcmds = sz; }
+  void setNcmds(uint32_t ncmds) { m_ncmds = ncmds; }
 
 protected:
   uint32_t convertEndian(uint32_t) const;
@@ -444,7 +464,9 @@ private:
 class mach_object {
 public:
   mach_object();
-  mach_object(std::ifstream& file);
+  /// without loadData only the load commands are kept in memory,
+  /// enough to edit them and write through MachOLoader::write
+  mach_object(std::ifstream& file, bool loadData = true);
   bool isBigEndian() const;
   bool is64bits() const;
   const mach_header_32* header32() const;
@@ -453,7 +475,15 @@ public:
   std::vector<Path> loadDylibPaths() const;
   std::vector<Path> reexportDylibPaths() const;
   std::vector<Path> weakLoadDylib() const;
+  /// LC_UUID as 32 hex digits, empty if there is none
+  std::string uuid() const;
+  /// paths of all dylib loading commands, in library ordinal order
+  std::vector<Path> dylibsByOrdinal() const;
   std::vector<const data_segment*> dataSegments() const;
+  /// bytes at fileoff within this object, nullptr if not all loaded
+  const char* bytesAt(uint64_t fileoff, uint64_t size) const;
+  /// symbols in LC_SYMTAB, the table refers into this object
+  symbol_table symbols() const;
   const std::vector<load_command_bytes>& loadCommands() const;
   bool hasBeenSigned() const;
   bool changeRPath(PathRef oldPath, PathRef newPath);
@@ -461,7 +491,26 @@ public:
   bool changeId(PathRef id);
   bool removeRPath(PathRef rpath);
   bool addRPath(PathRef rpath);
+  /// make the LC_LOAD_DYLIB of path a LC_LOAD_WEAK_DYLIB, so this
+  /// loads even if path is missing, ordinals are unchanged
+  bool weakenDylib(PathRef path);
+  /// bytes the load commands may grow before they reach the first section
+  size_t headerPadding() const;
+  /// bytes the last path edit lacked in header padding, 0 if it fitted
+  size_t paddingShortfall() const { return m_shortfall; }
+  /// let path edits that overflow the header padding first drop duplicate
+  /// LC_RPATHs and then load new dylib paths through a matching LC_RPATH
+  void setCompactLoadCommands(bool compact) { m_compact = compact; }
+  /// remove repeated LC_RPATHs, returns the number of bytes freed
+  size_t dropDuplicateRPaths();
+  /// the bytes dropDuplicateRPaths would free
+  size_t duplicateRPathsSize() const;
   bool write(std::ofstream& file) const;
+  /// write header and load commands and zero the padding after them,
+  /// everything from firstDataOffset() on is left as is
+  bool writeCmds(std::ofstream& file) const;
+  /// offset in this object where bytes no longer depend on load commands
+  uint64_t firstDataOffset() const;
   bool failure() const;
   size_t startPos() const { return m_start_pos; }
   std::vector<load_command_bytes*> filterCmds(
@@ -482,16 +531,29 @@ private:
   void fail();
   void readHdr(std::ifstream& file);
   void readCmds(std::ifstream& file);
-  void readData(std::ifstream& file);
+  void readData(std::ifstream& file, bool loadData);
   std::vector<Path> searchForDylibs(LoadCmds type) const;
+  void indexCmds();
   // must only be used when command has a single path at end, no other additional data
   size_t replaceLcStr(load_command_bytes& cmd, uint32_t offset, std::string_view newStr);
-
+  size_t lcStrCmdSize(uint32_t offset, size_t strLen) const;
+  size_t loadCommandsSize() const;
+  bool makeRoom(size_t oldCmdSize, size_t newCmdSize);
+  bool changeLcStr(const std::function<load_command_bytes*()>& find,
+                   std::string_view newStr);
+  std::string viaRPath(const std::string& path) const;
+  void reportShortfall() const;
 
   const size_t m_start_pos;
   std::unique_ptr<mach_header_32> m_hdr;
   std::vector<load_command_bytes> m_load_cmds;
+  // positions in m_load_cmds for each command type, in file order
+  std::unordered_map<LoadCmds, std::vector<size_t>> m_cmd_index;
+  // file offset of first section, decoded on demand as segments stay put
+  mutable std::optional<uint64_t> m_first_data;
   std::vector<std::unique_ptr<data_segment>> m_data_segments;
+  size_t m_shortfall = 0;
+  bool m_compact = false;
 };
 
 //--------------------------------------------------------
@@ -553,6 +615,7 @@ public:
   load_command_bytes(uint32_t cmd, uint32_t cmdsize);
   load_command_bytes(std::ifstream& file, mach_object& owner);
   void setCmdSize(uint32_t size) { m_cmdsize = size; }
+  void setCmd(LoadCmds cmd) { m_cmd = cmd; }
   std::unique_ptr<char[]> bytes;
   bool write(std::ofstream& file, const mach_object& obj) const;
 };
@@ -1074,14 +1137,16 @@ public:
   void asSegment(
     std::ifstream& file,
     const load_command_bytes& cmd,
-    const mach_object& obj
+    const mach_object& obj,
+    bool loadData = true
   ) {
     A cls{cmd, obj};
     memcpy((void*)this->m_segname, (void*)cls.segname(), sizeof(m_segname));
     m_fileoff = cls.fileoff();
     m_filesize = cls.filesize();
 
-    read_into(file, obj);
+    if (loadData)
+      read_into(file, obj);
   }
 
   void asLinkEdit(
@@ -1092,6 +1157,7 @@ public:
   const char* segname() const { return m_segname; }
   uint64_t filesize() const { return m_filesize; }
   uint64_t fileoff() const { return m_fileoff; }
+  const char* bytes() const { return m_bytes.get(); }
 
   bool write(std::ofstream& file, const mach_object& obj) const;
 
@@ -1108,11 +1174,214 @@ private:
 
 // -------------------------------------------------
 
+/* masks and values for n_type in nlist */
+enum SymbolType: uint8_t {
+  N_STAB = 0xe0,  /* if any of these bits set, a symbolic debugging entry */
+  N_PEXT = 0x10,  /* private external symbol bit */
+  N_TYPE = 0x0e,  /* mask for the type bits */
+  N_EXT  = 0x01,  /* external symbol bit, set for external symbols */
+
+  N_UNDF = 0x0,   /* undefined, n_sect == NO_SECT */
+  N_ABS  = 0x2,   /* absolute, n_sect == NO_SECT */
+  N_SECT = 0xe,   /* defined in section number n_sect */
+  N_PBUD = 0xc,   /* prebound undefined (defined in a dylib) */
+  N_INDR = 0xa,   /* indirect */
+};
+
+/// Symbols in LC_SYMTAB, read in place from the __LINKEDIT bytes
+/// of the mach_object, which must outlive this table.
+/// The name index is built on first lookup, not thread safe.
+class symbol_table
+{
+public:
+  /// a nlist or nlist_64 entry
+  class symbol {
+  public:
+    symbol(const char* entry, const symbol_table& table);
+    std::string_view name() const { return m_name; }
+    uint8_t type() const { return m_type; }
+    uint8_t sect() const { return m_sect; }
+    uint16_t desc() const { return m_desc; }
+    uint64_t value() const { return m_value; }
+
+    bool isDebug() const { return m_type & N_STAB; }
+    bool isExternal() const { return !isDebug() && (m_type & N_EXT); }
+    bool isUndefined() const;
+    /// defined here and visible to other images
+    bool isExported() const;
+    /// the dylib an undefined symbol binds to, 1 based index into the
+    /// LC_LOAD_DYLIB like commands, 0 is self
+    uint8_t libraryOrdinal() const { return (m_desc >> 8) & 0xff; }
+
+  private:
+    std::string_view m_name;
+    uint8_t m_type;
+    uint8_t m_sect;
+    uint16_t m_desc;
+    uint64_t m_value;
+  };
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = symbol;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = symbol;
+
+    iterator(const symbol_table& table, size_t idx)
+      : m_table{&table}, m_idx{idx} {}
+    symbol operator*() const { return m_table->at(m_idx); }
+    iterator& operator++() { ++m_idx; return *this; }
+    bool operator==(const iterator& other) const { return m_idx == other.m_idx; }
+    bool operator!=(const iterator& other) const { return m_idx != other.m_idx; }
+  private:
+    const symbol_table* m_table;
+    size_t m_idx;
+  };
+
+  symbol_table(const mach_object& obj);
+
+  bool failure() const;
+  size_t size() const { return m_nsyms; }
+  symbol at(size_t idx) const;
+  iterator begin() const { return iterator{*this, 0}; }
+  iterator end() const { return iterator{*this, m_nsyms}; }
+
+  /// find a non debug symbol by its name, ie "_main"
+  std::optional<symbol> find(std::string_view name) const;
+  /// symbols this object needs from other images
+  std::vector<symbol> undefined() const;
+  /// symbols this object provides to other images
+  std::vector<symbol> exports() const;
+
+private:
+  std::vector<symbol> range(size_t first, size_t count,
+                            bool (symbol::*pred)() const) const;
+
+  const mach_object& m_obj;
+  const char* m_syms;
+  const char* m_strs;
+  size_t m_nsyms;
+  uint32_t m_strsize;
+  size_t m_entrySize;
+  // from LC_DYSYMTAB when there is one
+  uint32_t m_iextsym, m_nextsym, m_iundefsym, m_nundefsym;
+  bool m_hasDysymtab;
+  mutable std::unordered_map<std::string_view, uint32_t> m_index;
+};
+
+// -------------------------------------------------
+
+/// Reads LEB128 encoded values from a byte range.
+/// Reading past the end sets failure and returns 0
+class leb128_reader
+{
+public:
+  leb128_reader(const char* begin, const char* end);
+  uint64_t uleb();
+  int64_t sleb();
+  uint8_t byte();
+  /// a '\0' terminated string, without the terminator
+  std::string_view cstr();
+  /// move to offset from begin
+  void seek(size_t offset);
+  size_t pos() const { return m_pos - m_begin; }
+  bool atEnd() const { return m_pos >= m_end; }
+  bool failure() const { return m_failed; }
+
+private:
+  const char *m_begin, *m_pos, *m_end;
+  bool m_failed;
+};
+
+/* flags of a symbol in the export trie */
+enum ExportFlags: uint64_t {
+  EXPORT_SYMBOL_FLAGS_KIND_MASK = 0x03,
+  EXPORT_SYMBOL_FLAGS_KIND_REGULAR = 0x00,
+  EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL = 0x01,
+  EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE = 0x02,
+  EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION = 0x04,
+  EXPORT_SYMBOL_FLAGS_REEXPORT = 0x08,
+  EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER = 0x10,
+};
+
+/* special library ordinals */
+enum LibraryOrdinal: int {
+  BIND_SPECIAL_DYLIB_SELF = 0,
+  BIND_SPECIAL_DYLIB_MAIN_EXECUTABLE = -1,
+  BIND_SPECIAL_DYLIB_FLAT_LOOKUP = -2,
+  BIND_SPECIAL_DYLIB_WEAK_LOOKUP = -3,
+};
+
+/// a symbol bound from another image
+struct dyld_import {
+  std::string_view name;
+  /// 1 based index into the dylib load commands or a LibraryOrdinal
+  int libraryOrdinal;
+  bool weak;
+};
+
+/// a symbol in the export trie
+struct dyld_export {
+  /// only valid during the forEachExport callback
+  std::string_view name;
+  uint64_t flags;
+  /// offset from the mach header, 0 for reexports
+  uint64_t address;
+  /// for reexports, the dylib it comes from and its name there
+  /// (empty if the same)
+  int reexportOrdinal;
+  std::string_view importName;
+
+  bool isReexport() const { return flags & EXPORT_SYMBOL_FLAGS_REEXPORT; }
+};
+
+/// Decodes what a mach_object imports and exports from the compressed
+/// dyld info, either LC_DYLD_INFO(_ONLY) bind opcodes and export trie
+/// or LC_DYLD_CHAINED_FIXUPS and LC_DYLD_EXPORTS_TRIE.
+/// Everything is decoded in place from __LINKEDIT, the names handed out
+/// live as long as the object.
+class dyld_info
+{
+public:
+  dyld_info(const mach_object& obj);
+
+  /// call fn with each exported symbol, false if the trie is malformed
+  bool forEachExport(const std::function<void(const dyld_export&)>& fn) const;
+  /// call fn with each imported symbol, false if the data is malformed
+  bool forEachImport(const std::function<void(const dyld_import&)>& fn) const;
+
+  std::vector<std::string> exportedNames() const;
+  /// each imported name once
+  std::vector<dyld_import> imports() const;
+
+  bool hasExportTrie() const { return m_exports.first; }
+  bool hasChainedFixups() const { return m_fixups.first; }
+
+private:
+  using range = std::pair<const char*, const char*>;
+  range linkedit(uint32_t offset, uint32_t size) const;
+  bool bindImports(range opcodes, bool lazy,
+                   const std::function<void(const dyld_import&)>& fn) const;
+  bool chainedImports(
+    const std::function<void(const dyld_import&)>& fn) const;
+
+  const mach_object& m_obj;
+  range m_exports, m_fixups;
+  // weak binds coalesce symbols between images, they are not imports
+  range m_bind, m_lazyBind;
+};
+
+// -------------------------------------------------
+
 class mach_fat_object
 {
 public:
   mach_fat_object();
   mach_fat_object(std::ifstream& file);
+  /// read the file at path, each slice in parallel with its own stream
+  mach_fat_object(PathRef path, bool loadData = true);
 
   std::vector<mach_object>& objects();
   const std::vector<fat_arch>& architectures() const;
@@ -1121,6 +1390,17 @@ public:
   bool failure() const;
 
   bool write(std::ofstream& file);
+  /// write to path, each slice in parallel to its own byte range
+  bool write(PathRef path);
+  /// write fat header and architectures
+  bool writeArchs(std::ofstream& file);
+
+  /// Write the slices of src matching keepArchs to dest, a thin object
+  /// when only one is kept, otherwise a smaller fat file.
+  /// Kept slices are streamed, the others are never read.
+  /// src and dest may be the same file.
+  static bool thin(PathRef src, PathRef dest,
+                   const std::vector<std::string>& keepArchs);
 
   template<typename T>
     T endian(T in) const
@@ -1133,6 +1413,7 @@ public:
 
 private:
   void fail();
+  bool readArchs(std::ifstream& file);
 
   std::unique_ptr<fat_header> m_hdr;
   std::vector<fat_arch> m_fat_arch;
@@ -1143,29 +1424,81 @@ private:
 
 // --------------------------------------------------
 
+/// streams introspection records as indented text or as NDJSON,
+/// one json object per line, written as they are decoded
+class introspect_writer
+{
+public:
+  enum Format { Text, NDJson };
+
+  introspect_writer(std::ostream& out, Format format = Text);
+
+  Format format() const;
+
+  /// starts a record, text prints "<title> <index>" when given
+  void beginRecord(const char* title = nullptr, int index = -1);
+  void endRecord();
+
+  void field(std::string_view key, std::string_view vlu);
+  void field(std::string_view key, const char* vlu);
+  template<typename T,
+           std::enable_if_t<std::is_integral_v<T>, int> = 0>
+  void field(std::string_view key, T vlu)
+  {
+    number(key, std::to_string(vlu));
+  }
+  void field(std::string_view key, bool vlu);
+
+  /// raw bytes, a hexdump in text and a hex string in json
+  void bytes(std::string_view key, const char* buf, size_t nBytes);
+
+  /// a list holding either values or items
+  void beginList(std::string_view key);
+  void endList();
+  void value(std::string_view vlu);
+  /// a nested record in a list, title is only shown in text
+  void beginItem(std::string_view title);
+  void endItem();
+
+private:
+  void key(std::string_view key);
+  void separate();
+  void indent();
+  void string(std::string_view vlu);
+  void number(std::string_view key, const std::string& vlu);
+
+  std::ostream& m_out;
+  Format m_format;
+  int m_depth;
+  bool m_first,
+       m_titled;
+};
+
 class introspect_object
 {
 public:
   introspect_object(const mach_object* obj);
 
   std::string loadCmds() const;
+  /// streams one record per load command to out
+  void loadCmds(std::ostream& out,
+                introspect_writer::Format format) const;
 
   std::string targetInfo() const;
+  void targetInfo(std::ostream& out,
+                  introspect_writer::Format format) const;
 
 private:
-  std::stringstream& hexdump(
-    std::stringstream& ss, const char* buf, size_t nBytes) const;
-
   std::string versionStr(uint32_t version) const;
   std::string timestampStr(uint32_t timestamp) const;
   template<typename T>
   std::string hexString(T addr) const
   {
-    std::stringstream ss;
-    ss << "0x" << std::hex
-          << std::setw(sizeof(T))
-          << std::setfill('0') << addr;
-    return ss.str();
+    char buf[2 + sizeof(T) * 2 + 1];
+    snprintf(buf, sizeof(buf), "0x%0*llx",
+             static_cast<int>(sizeof(T) * 2),
+             static_cast<unsigned long long>(addr));
+    return buf;
   }
 
   std::string toUUID(const char* uuid) const;
@@ -1175,62 +1508,120 @@ private:
   std::string sourceVersionStr(uint64_t version) const;
 
   template<typename T, typename U>
-  std::string segmentToStr(const load_command_bytes& cmd) const
+  void segment(
+    introspect_writer& out, const load_command_bytes& cmd) const
   {
-    std::stringstream ss;
+    // names are 16 chars and not terminated when all are used
+    auto name = [](const char* str) {
+      return std::string_view{str, strnlen(str, 16)};
+    };
     T seg{cmd, *m_obj};
-    ss << "  segname " << seg.segname() << "\n"
-        << "  vmaddr " << hexString(seg.vmaddr()) << "\n";
-    ss  << "  fileoff " << seg.fileoff() << "\n"
-        << "  filesize " << seg.filesize() <<"\n"
-        << "  maxprot " << seg.maxprot() << "\n"
-        << "  initprot " << seg.initprot() << "\n"
-        << "  nsects " << seg.nsects() << "\n"
-        << "  flags " << seg.flags() << "\n";
-
+    out.field("segname", name(seg.segname()));
+    out.field("vmaddr", hexString(seg.vmaddr()));
+    out.field("fileoff", seg.fileoff());
+    out.field("filesize", seg.filesize());
+    out.field("maxprot", seg.maxprot());
+    out.field("initprot", seg.initprot());
+    out.field("nsects", seg.nsects());
+    out.field("flags", seg.flags());
+
+    out.beginList("sections");
     for (size_t i = 0; i < seg.nsects(); ++i) {
       size_t offset = sizeof(T) - sizeof(load_command);
       offset += sizeof(U) * i;
       U sec{&cmd.bytes[offset], *m_obj};
 
-      ss << " Section " << "-------------------\n"
-          << "   sectname " << sec.sectname() << "\n"
-          << "   segname " << sec.segname() << "\n"
-          << "   addr " << hexString(sec.addr()) << "\n"
-          << "   size " << sec.size() << "\n"
-          << "   offset " << sec.offset() << "\n"
-          << "   align " << sec.align() << "\n"
-          << "   reloff " << sec.reloff() << "\n"
-          << "   nreloc " << sec.nreloc() << "\n"
-          << "   flags " << hexString(sec.flags()) << "\n"
-          << "   reserved1 " << sec.reserved1() << "\n"
-          << "   reserved2 " << sec.reserved2() << "\n";
+      out.beginItem("Section");
+      out.field("sectname", name(sec.sectname()));
+      out.field("segname", name(sec.segname()));
+      out.field("addr", hexString(sec.addr()));
+      out.field("size", sec.size());
+      out.field("offset", sec.offset());
+      out.field("align", sec.align());
+      out.field("reloff", sec.reloff());
+      out.field("nreloc", sec.nreloc());
+      out.field("flags", hexString(sec.flags()));
+      out.field("reserved1", sec.reserved1());
+      out.field("reserved2", sec.reserved2());
       if constexpr(std::is_same_v<section_64, U>)
-        ss << "   reserved3 " << sec.reserved3() << "\n";
+        out.field("reserved3", sec.reserved3());
+      out.endItem();
     }
-    return ss.str();
+    out.endList();
   }
 
-  std::string buildVersionToStr(const load_command_bytes& cmd) const;
+  void buildVersion(
+    introspect_writer& out, const load_command_bytes& cmd) const;
 
 
   const mach_object* m_obj;
 };
 
 
+/// rewrites install names, ids and rpaths from a table of rules
+/// compiled once and shared between threads, rules are tried in
+/// order and the first one that matches wins
+class path_rewriter
+{
+public:
+  enum Targets {
+    Load  = 1, // LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB
+    Id    = 2, // LC_ID_DYLIB
+    RPath = 4, // LC_RPATH
+    All   = Load | Id | RPath
+  };
+
+  /// add a rule from a line such as:
+  ///   <all|load|id|rpath[,...]> <prefix|regex> <match> <replacement>
+  /// a regex must match the whole path, replacement may use $1...
+  /// empty lines and lines starting with # are ignored
+  bool addRule(std::string_view line);
+  /// addRule for each line of the file at path
+  bool readRules(PathRef path);
+  size_t size() const { return m_rules.size(); }
+
+  /// path rewritten by the first matching rule, nullopt if none matched
+  std::optional<std::string> rewrite(
+    std::string_view path, Targets target) const;
+
+  /// rewrite the paths in obj, changed counts the edited load commands
+  /// returns false if any of them couldn't be changed
+  bool apply(mach_object& obj, size_t& changed) const;
+
+private:
+  struct rule {
+    int targets;
+    std::string match,
+                replacement;
+    std::optional<std::regex> regex;
+  };
+
+  std::vector<rule> m_rules;
+};
+
+
 class MachOLoader
 {
 public:
-  MachOLoader(PathRef binPath);
+  /// without loadData segment contents are not read, see mach_object
+  MachOLoader(PathRef binPath, bool loadData = true);
 
   bool isFat() const;
   bool isObject() const;
+  /// starts with a mach-o or fat magic, even if it then failed to parse
+  bool hasMagic() const;
 
+  /// Write header and load commands from memory, everything after them
+  /// is copied from the file this was loaded from. Goes through a temp
+  /// file beside toFile which is then renamed over it.
   bool write(PathRef toFile, bool overwrite = false);
 
   mach_fat_object* fatObject();
   mach_object* object();
 
+  /// Run fn on each object, the slices of a fat binary in parallel
+  void forEachObject(const std::function<void(mach_object&)>& fn);
+
 
 private:
   void readHeader(std::ifstream& file);
@@ -1238,6 +1629,7 @@ private:
   Path m_binPath;
   std::unique_ptr<mach_fat_object> m_fat;
   std::unique_ptr<mach_object> m_object;
+  bool m_hasMagic;
 };
 
 } // namespace Macho
@@ -34,6 +34,7 @@ THE SOFTWARE.
 #include "ScriptRunner.h"
 #include "ArgParser.h"
 #include "Tools.h"
+#include "ThreadPool.h"
 
 /*
  TODO
@@ -64,9 +65,12 @@ ArgParser args{
   },
   {nullptr, "no-scripts","Prevent app bundle scripts from running",Settings::preventScripts},
   {nullptr, "only-scripts","Don't do anything more than running scripts",Settings::setOnlyRunScripts},
+  {nullptr, "script-timeout","seconds before a script is killed, 0 is never (default 20)",Settings::setScriptTimeout, ArgItem::ReqVluString},
+  {nullptr, "script-worker","unix socket of a running scripts/worker.py, runs scripts there without starting a new interpreter",Settings::setScriptWorker, ArgItem::ReqVluString},
 #endif // USE_SCRIPTS
   {"pl","app-info-plist","Optional path to a Info.plist to bundle into app", Settings::setInfoPlist, ArgItem::ReqVluString},
   {"b","bundle-deps","Bundle library dependencies.", Settings::setBundleLibs},
+  {nullptr,"prune-unused","Don't bundle dylibs that no binary imports a symbol from", Settings::setPruneUnused},
   {"f","bundle-frameworks", "Bundle frameworks into app bundle", Settings::setBundleFrameworks},
   {"d","dest-dir","directory to send bundled libraries (relative to fix-file)",Settings::setDestFolder, ArgItem::ReqVluString},
   {"p","install-path","'inner' path of bundled libraries (usually relative to executable, by default '@executable_path/../libs/')",
@@ -86,7 +90,15 @@ ArgParser args{
   {nullptr, "otool-path","give the path to otool or llvm-otool, useful when tools not in path", Settings::setOToolPath,ArgItem::ReqVluString},
   {nullptr, "install-name-tool-path","absolute path to install_name_tool, useful when not in path",Settings::setInstallNameToolPath,ArgItem::ReqVluString},
   {"cs","codesign","path to codesigning binary, might be zsign for example",Settings::setCodeSign,ArgItem::ReqVluString},
-  {nullptr,"no-interactive","Prevent dylibbundler from asking user for inputs when it is lost. Useful when running in a bash script", Settings::preventAskUser},
+  {nullptr,"no-interactive","Prevent dylibbundler from asking user for inputs when it is lost, all missing libraries are reported at once. Useful when running in a bash script", Settings::preventAskUser},
+  {nullptr,"resolve-map","file of '<library name> <dir>' lines telling where missing libraries are, used instead of asking",Settings::setResolveMap, ArgItem::ReqVluString},
+  {nullptr,"store","share identical bundled dylibs between runs, hardlinked from this directory",Settings::setStoreDir, ArgItem::ReqVluString},
+  {nullptr,"graph","write the dependency graph with sizes to this file, graphviz if it ends with .dot otherwise json",Settings::setGraphFile, ArgItem::ReqVluString},
+  {nullptr,"dry-run","only show what would be done, =file saves the plan to file instead",Settings::setDryRun},
+  {nullptr,"apply-plan","do what a plan saved by --dry-run=file says, without collecting dependencies again",Settings::setApplyPlan, ArgItem::ReqVluString},
+  {nullptr,"verify","check that every bundled binary loads its dylibs from within the bundle, exit with an error if not",Settings::setVerifyBundle},
+  {nullptr,"thin","only keep these architectures in bundled binaries, comma separated ie. arm64 or arm64,x86_64",Settings::setThinArchs, ArgItem::ReqVluString},
+  {"j","jobs","number of parallel jobs (default one per cpu)",Settings::setJobs, ArgItem::ReqVluString},
   {"v","verbose","verbose mode",Settings::setVerbose},
   {"h","help","Show help",showHelp}
 };
@@ -104,6 +116,7 @@ int main (int argc, const char * argv[])
 {
     Settings::init(argc, argv);
     args.parse(argc, argv);
+    ThreadPool::setSharedSize(Settings::jobs());
 
     Tools::InstallName::initDefaults(
     //  Settings::installNameToolCmd(),
@@ -114,7 +127,7 @@ int main (int argc, const char * argv[])
       "",Settings::verbose());
 
     auto amount = Settings::srcFiles().size();
-    if(!Settings::bundleLibs() && amount < 1)
+    if(!Settings::bundleLibs() && amount < 1 && Settings::applyPlan().empty())
     {
         showHelp();
         exit(0);
@@ -122,6 +135,18 @@ int main (int argc, const char * argv[])
 
     DylibBundler bundler{};
 
+    if (!Settings::applyPlan().empty()) {
+        std::cout << "* Applying plan " << Settings::applyPlan() << std::endl;
+        bundler.executePlan(BundlePlan::load(Settings::applyPlan()));
+#ifdef USE_SCRIPTS
+        if (!Settings::shouldPreventScripts())
+          runPythonScripts_afterHook();
+#endif
+        if (Settings::verifyBundle() && !bundler.verifyBundle())
+          return 1;
+        return 0;
+    }
+
     for(const auto& file : Settings::srcFiles()) {
         std::cout << "* Collecting dependencies for:"
                   << file.src <<" \n";
@@ -129,12 +154,32 @@ int main (int argc, const char * argv[])
     }
 
     bundler.collectSubDependencies();
+    if (bundler.reportUnresolved())
+      return 1;
+    if (Settings::pruneUnused())
+      bundler.pruneUnusedDependencies();
+    if (!Settings::graphFile().empty())
+      bundler.exportGraph(Settings::graphFile());
+    if (Settings::dryRun()) {
+      auto plan = bundler.makePlan();
+      if (Settings::dryRunFile().empty()) {
+        std::cout << "\n";
+        plan.print(std::cout);
+      } else {
+        plan.save(Settings::dryRunFile());
+        std::cout << "\n* Saved plan to " << Settings::dryRunFile() << std::endl;
+      }
+      return 0;
+    }
     if (!Settings::shouldOnlyRunScripts())
       bundler.moveAndFixBinaries();
 #ifdef USE_SCRIPTS
     if (!Settings::shouldPreventScripts())
       runPythonScripts_afterHook();
 #endif
+    // scripts may move things around, check the final result
+    if (Settings::verifyBundle() && !bundler.verifyBundle())
+      return 1;
 
     std::cout << "\n\n -- Processed " << amount << " file"
               << (amount > 1 ? "s" :"") << "." << std::endl;
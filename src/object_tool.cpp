@@ -25,11 +25,15 @@ THE SOFTWARE.
 #include <iostream>
 #include <filesystem>
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstring>
+#include <vector>
 #include "ArgParser.h"
 #include "Types.h"
 #include "MachO.h"
+#include "Json.h"
+#include "ThreadPool.h"
 
 struct inputs {
 
@@ -66,24 +70,39 @@ struct inputs {
   static void setNewPath(std::string path) {
     inputs::newPath = path;
   }
+  static void addBatchInput(std::string path) {
+    inputs::batchInputs.emplace_back(path);
+  }
+  static void setJson(bool json) {
+    inputs::json = json;
+  }
+  static void setRewriteRules(std::string path) {
+    inputs::rewriteRules = Path(path);
+  }
 
   static Actions action;
 
   static Path inputFile,
-              outputFile;
+              outputFile,
+              rewriteRules;
 
   static bool overwrite,
-              overwriteInputFile;
+              overwriteInputFile,
+              json;
   static std::string arch, oldPath, newPath;
+  static std::vector<std::string> batchInputs;
 };
 bool inputs::overwrite = false;
 bool inputs::overwriteInputFile = false;
+bool inputs::json = false;
 Path inputs::inputFile{};
 Path inputs::outputFile{};
+Path inputs::rewriteRules{};
 inputs::Actions inputs::action{inputs::Help};
 std::string inputs::arch{};
 std::string inputs::oldPath{};
 std::string inputs::newPath{};
+std::vector<std::string> inputs::batchInputs{};
 
 void showHelp();
 
@@ -118,7 +137,7 @@ ArgParser args {
   {
     "L","list-load-paths", "print all load paths for input",
     [](){
-      inputs::setAction(inputs::ReexportLoad);
+      inputs::setAction(inputs::Load);
     }
   },
   {
@@ -165,6 +184,23 @@ ArgParser args {
     nullptr,"new-path", "Change to this path",
     inputs::setNewPath, ArgItem::ReqVluString
   },
+  {
+    "b","batch", "report on many binaries at once as json, a file, "
+                 "a directory searched recursively or @file with a path "
+                 "per line. May be repeated. --arch limits the slices",
+    inputs::addBatchInput, ArgItem::ReqVluString
+  },
+  {
+    nullptr,"rewrite-rules", "rewrite load paths, ids and rpaths of the input "
+                 "and --batch inputs in place from a rules file, one rule "
+                 "per line: <all|load|id|rpath[,...]> <prefix|regex> "
+                 "<match> <replacement>",
+    inputs::setRewriteRules, ArgItem::ReqVluString
+  },
+  {
+    "j","json", "print results as NDJSON, one json object per line",
+    inputs::setJson, ArgItem::VluTrue
+  },
   {
     nullptr, "force-overwrite",
     "overwrite output file",
@@ -186,6 +222,46 @@ void showHelp() {
 
 namespace fs = std::filesystem;
 
+MachO::introspect_writer::Format outputFormat()
+{
+  return inputs::json ? MachO::introspect_writer::NDJson
+                      : MachO::introspect_writer::Text;
+}
+
+void printPaths(const char* cmd, const std::vector<Path>& paths)
+{
+  if (!inputs::json) {
+    std::cout << cmd << "\n";
+    for (const auto& path : paths)
+      std::cout << "  " << path << "\n";
+    return;
+  }
+
+  MachO::introspect_writer out{std::cout, outputFormat()};
+  out.beginRecord();
+  out.field("cmd", cmd);
+  out.beginList("paths");
+  for (const auto& path : paths)
+    out.value(path.string());
+  out.endList();
+  out.endRecord();
+}
+
+void printWritten(bool written)
+{
+  if (!inputs::json) {
+    std::cout << (written ? "Written to " : "Failed to write to ")
+              << inputs::outputFile << "\n";
+    return;
+  }
+
+  MachO::introspect_writer out{std::cout, outputFormat()};
+  out.beginRecord();
+  out.field("output", inputs::outputFile.string());
+  out.field("written", written);
+  out.endRecord();
+}
+
 int writeToFile(MachO::mach_object& obj)
 {
   std::ofstream file;
@@ -193,36 +269,28 @@ int writeToFile(MachO::mach_object& obj)
   if (file.bad()) {
     std::cerr << "Failed to open file '" << inputs::outputFile << "'\n";
   } else if (obj.write(file)) {
-    std::cout << "Written to " << inputs::outputFile << "\n";
+    printWritten(true);
     return 0;
   }
-  std::cout << "Failed to write to " << inputs::outputFile << "\n";
+  printWritten(false);
   return 2;
 }
 
 int runAction(MachO::mach_object& obj, inputs::Actions action)
 {
   switch (action) {
-  case inputs::RPaths: {
-    std::cout << "LC_RPATH\n";
-    for (const auto& path : obj.rpaths())
-      std::cout << "  " << path << "\n";
-  } break;
-  case inputs::ReexportLoad: {
-    std::cout << "LC_REEXPORT\n";
-    for (const auto& path : obj.reexportDylibPaths())
-      std::cout << "  " << path << "\n";
-  } break;
-  case inputs::WeakLoad: {
-    std::cout << "LC_WEAK_LOAD\n";
-    for (const auto& path : obj.weakLoadDylib())
-      std::cout << "  " << path << "\n";
-  } break;
-  case inputs::Load: {
-    std::cout << "LC_LOAD\n";
-    for (const auto& path : obj.loadDylibPaths())
-      std::cout << "  " << path << "\n";
-  } break;
+  case inputs::RPaths:
+    printPaths("LC_RPATH", obj.rpaths());
+    break;
+  case inputs::ReexportLoad:
+    printPaths("LC_REEXPORT", obj.reexportDylibPaths());
+    break;
+  case inputs::WeakLoad:
+    printPaths("LC_WEAK_LOAD", obj.weakLoadDylib());
+    break;
+  case inputs::Load:
+    printPaths("LC_LOAD", obj.loadDylibPaths());
+    break;
   case inputs::AllPaths:
     runAction(obj, inputs::Load);
     runAction(obj, inputs::WeakLoad);
@@ -231,8 +299,9 @@ int runAction(MachO::mach_object& obj, inputs::Actions action)
     break;
   case inputs::ListCmds: {
     MachO::introspect_object insp{&obj};
-    std::cout << "Load command for: " << inputs::inputFile << "\n";
-    std::cout << insp.loadCmds();
+    if (!inputs::json)
+      std::cout << "Load command for: " << inputs::inputFile << "\n";
+    insp.loadCmds(std::cout, outputFormat());
   } break;
   case inputs::ExtractTo: {
     if (inputs::outputFile.empty()) {
@@ -252,7 +321,11 @@ int runAction(MachO::mach_object& obj, inputs::Actions action)
       return 2;
     }
 
-    obj.write(file);
+    bool written = obj.write(file);
+    if (inputs::json || !written)
+      printWritten(written);
+    if (!written)
+      return 2;
   } break;
   case inputs::ChangeRPaths: {
     if (inputs::oldPath.empty() || inputs::newPath.empty()) {
@@ -277,7 +350,7 @@ int runAction(MachO::mach_object& obj, inputs::Actions action)
   } break;
   case inputs::TargetInfo: {
     MachO::introspect_object insp(&obj);
-    std::cout << insp.targetInfo();
+    insp.targetInfo(std::cout, outputFormat());
   } break;
   default:
     std::cerr << "**Unknown action \n";
@@ -287,9 +360,274 @@ int runAction(MachO::mach_object& obj, inputs::Actions action)
   return 0;
 }
 
+// -----------------------------------------------------------
+
+struct BatchFile {
+  Path path;
+  bool fromDir; // found when searching, skip it if not mach-o
+};
+
+/// expand directories and @response files into the files to report on
+std::vector<BatchFile> collectBatchFiles(bool& ok)
+{
+  std::vector<BatchFile> files;
+  std::function<void(const std::string&)> add = [&](const std::string& in) {
+    std::error_code err;
+    if (in.size() > 1 && in[0] == '@') {
+      std::ifstream list{in.substr(1)};
+      if (!list) {
+        std::cerr << "Failed to read response file " << in.substr(1) << "\n";
+        ok = false;
+      }
+      for (std::string line; std::getline(list, line);) {
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        if (!line.empty() && line[0] != '#')
+          add(line);
+      }
+    } else if (fs::is_directory(in, err)) {
+      // directory order is arbitrary, sort for a stable report
+      auto first = files.size();
+      for (fs::recursive_directory_iterator it{in, err}, end;
+           !err && it != end; it.increment(err))
+      {
+        if (it->is_regular_file(err) && !it->is_symlink(err))
+          files.push_back({Path(it->path()), true});
+      }
+      std::sort(files.begin() + first, files.end(),
+        [](const BatchFile& a, const BatchFile& b) { return a.path < b.path; });
+    } else {
+      files.push_back({Path(in), false});
+    }
+    if (err) {
+      std::cerr << "Failed to read " << in << " " << err.message() << "\n";
+      ok = false;
+    }
+  };
+
+  for (const auto& in : inputs::batchInputs)
+    add(in);
+  return files;
+}
+
+/// what batch mode reports about a slice
+std::unique_ptr<Json::Object> reportObject(const MachO::mach_object& obj)
+{
+  auto paths = [](const std::vector<Path>& vec) {
+    Json::Array arr;
+    for (const auto& path : vec)
+      arr.push(path.string());
+    return arr;
+  };
+
+  std::string id;
+  auto idCmds = obj.filterCmds(MachO::LC_ID_DYLIB);
+  if (!idCmds.empty()) {
+    MachO::lc_str name{idCmds[0]->bytes.get(), obj};
+    id = name.str(idCmds[0]->bytes.get());
+  }
+
+  const auto hdr = obj.header32();
+  return std::make_unique<Json::Object>(Json::ObjInitializer{
+    {"arch", Json::String(MachO::archName(hdr->cputype(),
+                                          hdr->cpusubtype()))},
+    {"filetype", Json::String(MachO::FiletypeStr(hdr->filetype()))},
+    {"uuid", Json::String(obj.uuid())},
+    {"id", Json::String(id)},
+    {"signed", Json::Bool(obj.hasBeenSigned())},
+    {"load", paths(obj.loadDylibPaths())},
+    {"weak", paths(obj.weakLoadDylib())},
+    {"reexport", paths(obj.reexportDylibPaths())},
+    {"rpaths", paths(obj.rpaths())}
+  });
+}
+
+/// the report for file, nullptr for files found in a directory
+/// that aren't mach-o. A mach-o that fails to parse is an error
+std::unique_ptr<Json::Object> reportFile(const BatchFile& file, char& failed)
+{
+  auto report = std::make_unique<Json::Object>(Json::ObjInitializer{
+    {"path", Json::String(file.path.string())}
+  });
+
+  MachO::MachOLoader loader{file.path, false};
+  std::vector<const MachO::mach_object*> objs;
+  if (loader.isFat()) {
+    for (const auto& obj : loader.fatObject()->objects())
+      objs.push_back(&obj);
+  } else if (loader.isObject()) {
+    objs.push_back(loader.object());
+  } else if (file.fromDir && !loader.hasMagic()) {
+    return nullptr;
+  } else {
+    report->set("error", Json::String(loader.hasMagic()
+      ? "failed to parse mach-o file" : "not a mach-o file"));
+    failed = true;
+    return report;
+  }
+
+  Json::Array slices;
+  for (const auto obj : objs) {
+    if (inputs::arch.empty() ||
+        MachO::archMatches(obj->header32()->cputype(),
+                           obj->header32()->cpusubtype(), inputs::arch))
+    {
+      slices.push(reportObject(*obj));
+    }
+  }
+  report->set("fat", Json::Bool(loader.isFat()));
+  report->set("slices", slices);
+  return report;
+}
+
+/// report on all batch inputs in parallel, as one json document
+int runBatch()
+{
+  bool ok = true;
+  auto files = collectBatchFiles(ok);
+
+  std::vector<std::unique_ptr<Json::Object>> reports(files.size());
+  std::vector<char> failures(files.size(), false);
+  ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+    reports[i] = reportFile(files[i], failures[i]);
+  });
+
+  Json::Array all;
+  for (auto& report : reports) {
+    if (report)
+      all.push(std::move(report));
+  }
+  int failed = std::count(failures.begin(), failures.end(), true);
+  Json::Object root{Json::ObjInitializer{
+    {"files", all},
+    {"count", Json::Number(static_cast<int>(all.length()))},
+    {"failed", Json::Number(failed)}
+  }};
+
+  if (inputs::outputFile.empty()) {
+    std::cout << root.serialize(2).rdbuf() << "\n";
+  } else {
+    if (fs::exists(inputs::outputFile) && !inputs::overwrite) {
+      std::cerr << "Not allowed to overwrite existing file,"
+                << " try again with --force-overwrite\n";
+      return 1;
+    }
+    std::ofstream out{inputs::outputFile.string()};
+    out << root.serialize(2).rdbuf() << "\n";
+    if (!out) {
+      std::cerr << "Failed to write to " << inputs::outputFile << "\n";
+      return 2;
+    }
+  }
+
+  return ok && failed == 0 ? 0 : 2;
+}
+
+// -----------------------------------------------------------
+
+struct RewriteResult {
+  size_t changed = 0;
+  bool isMachO = true,
+       parsed = true,
+       ok = true,
+       resign = false; // its code signature no longer matches
+};
+
+/// rewrite every input in place with the rules, each file is
+/// parsed and written once, files in parallel
+int runRewrite()
+{
+  MachO::path_rewriter rules;
+  if (!rules.readRules(inputs::rewriteRules))
+    return 1;
+  if (rules.size() == 0) {
+    std::cerr << "No rules in " << inputs::rewriteRules << "\n";
+    return 1;
+  }
+
+  if (!inputs::inputFile.empty())
+    inputs::batchInputs.push_back(inputs::inputFile.string());
+  bool ok = true;
+  auto files = collectBatchFiles(ok);
+
+  std::vector<RewriteResult> results(files.size());
+  ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+    auto& res = results[i];
+    MachO::MachOLoader loader{files[i].path, false};
+    if (!loader.isFat() && !loader.isObject()) {
+      // mach-o magic but it didn't parse, never skip that
+      res.isMachO = loader.hasMagic();
+      res.parsed = false;
+      res.ok = files[i].fromDir && !res.isMachO;
+      return;
+    }
+
+    std::atomic<size_t> changed{0};
+    std::atomic<bool> applied{true}, wasSigned{false};
+    loader.forEachObject([&](MachO::mach_object& obj) {
+      size_t count = 0;
+      if (!rules.apply(obj, count))
+        applied = false;
+      if (count && obj.hasBeenSigned())
+        wasSigned = true;
+      changed += count;
+    });
+    res.changed = changed;
+    res.ok = applied;
+    // a slice that failed leaves the whole file as it was
+    if (!applied || !res.changed)
+      return;
+    if (!loader.write(files[i].path, true))
+      res.ok = false;
+    else
+      res.resign = wasSigned;
+  });
+
+  size_t nChanged = 0, nFailed = 0;
+  MachO::introspect_writer out{std::cout, outputFormat()};
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto& res = results[i];
+    if (!res.isMachO && res.ok)
+      continue;
+    nChanged += res.changed > 0;
+    nFailed += !res.ok;
+    if (inputs::json) {
+      out.beginRecord();
+      out.field("path", files[i].path.string());
+      out.field("changed", res.changed);
+      out.field("ok", res.ok);
+      out.field("resign", res.resign);
+      out.endRecord();
+    } else if (!res.isMachO) {
+      std::cerr << "Not a mach-o file " << files[i].path << "\n";
+    } else if (!res.parsed) {
+      std::cerr << "Failed to parse mach-o file " << files[i].path << "\n";
+    } else if (!res.ok) {
+      std::cerr << "Failed to rewrite " << files[i].path << "\n";
+    } else if (res.changed) {
+      std::cout << "Rewrote " << res.changed << " paths in "
+                << files[i].path << "\n";
+      if (res.resign)
+        std::cerr << "Warning: the code signature of " << files[i].path
+                  << " is invalid now, re-sign it with codesign -f -s -\n";
+    }
+  }
+  if (!inputs::json)
+    std::cout << nChanged << " files changed, " << nFailed << " failed\n";
+
+  return ok && nFailed == 0 ? 0 : 2;
+}
+
 int main(int argc, const char *argv[])
 {
   args.parse(argc, argv);
+  // load command dumps can be large, don't sync every write with stdio
+  std::ios::sync_with_stdio(false);
+
+  if (!inputs::rewriteRules.empty())
+    return runRewrite();
+  if (!inputs::batchInputs.empty())
+    return runBatch();
 
   if (inputs::inputFile.empty())
     showHelp();
@@ -326,17 +664,12 @@ int main(int argc, const char *argv[])
 
   MachO::mach_fat_object fat{file};
   if (!fat.failure()) {
-    std::string keyArch = inputs::arch;
-
-    std::transform(keyArch.begin(), keyArch.end(),
-      keyArch.begin(), ::toupper);
-
     if (!inputs::arch.empty()) {
       auto arches = fat.architectures();
       auto found = std::find_if(arches.begin(), arches.end(),
         [&](const auto& arch) {
-          std::string name = MachO::CpuTypeStr(arch.cputype());
-          return name.size() && name.substr(3) == keyArch;
+          return MachO::archMatches(arch.cputype(), arch.cpusubtype(),
+                                    inputs::arch);
         }
       );
 
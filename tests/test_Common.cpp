@@ -27,8 +27,12 @@ THE SOFTWARE.
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
 #include "Common.h"
 #include "Types.h"
+#include "ThreadPool.h"
 
 using ::testing::MatchesRegex;
 
@@ -242,3 +246,43 @@ TEST(extended_path, end_name) {
   EXPECT_EQ(p6.end_name(), "..");
 };
 
+// ---------------------------------------------------------
+
+TEST(ThreadPoolTest, submitReturnsResult) {
+  ThreadPool pool{2};
+  auto f1 = pool.submit([]{ return 21 * 2; });
+  auto f2 = pool.submit([]{ return std::string("done"); });
+  EXPECT_EQ(f1.get(), 42);
+  EXPECT_EQ(f2.get(), "done");
+}
+
+TEST(ThreadPoolTest, parallelForVisitsAll) {
+  ThreadPool pool{4};
+  std::vector<int> hits(1000, 0);
+  pool.parallelFor(hits.size(), [&](size_t i) { ++hits[i]; });
+  EXPECT_EQ(std::count(hits.begin(), hits.end(), 1), 1000);
+}
+
+TEST(ThreadPoolTest, nestedParallelForDoesNotDeadlock) {
+  ThreadPool pool{2};
+  std::atomic<int> sum{0};
+  std::vector<std::future<void>> futs;
+  for (int i = 0; i < 4; ++i) {
+    futs.emplace_back(pool.submit([&]{
+      pool.parallelFor(10, [&](size_t) { ++sum; });
+    }));
+  }
+  for (auto& fut : futs)
+    fut.get();
+  EXPECT_EQ(sum, 40);
+}
+
+TEST(ThreadPoolTest, parallelForRethrows) {
+  ThreadPool pool{2};
+  std::atomic<int> ran{0};
+  EXPECT_THROW(pool.parallelFor(8, [&](size_t i) {
+    ++ran;
+    if (i == 3) throw std::runtime_error("fail");
+  }), std::runtime_error);
+  EXPECT_EQ(ran, 8);
+}
@@ -27,8 +27,21 @@ THE SOFTWARE.
 
 #include <algorithm>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <thread>
+#include <unistd.h>
 #include "Types.h"
 #include "Tools.h"
+#include "RPathResolver.h"
+#include "PathTable.h"
+#include "Utils.h"
+#include "Settings.h"
+#include "DylibBundler.h"
+#include "Plan.h"
+#include "ScriptRunner.h"
+#include "Json.h"
 
 
 using ::testing::MatchesRegex;
@@ -83,6 +96,26 @@ TEST(Tools_InstallNameDeath, failResponse) {
   EXPECT_DEATH(test.id(Path("newId"), Path("toBin")),"Error: .* id");
 }
 
+TEST(Tools_InstallNameDeath, changeShortfall) {
+  auto bin = fs::temp_directory_path() / "shortfalltest";
+  fs::copy_file("testbinaries/testprog.arm64", bin,
+                fs::copy_options::overwrite_existing);
+  Tools::OTool otool("", false);
+  ASSERT_TRUE(otool.scanBinary(Path(bin.string())));
+  ASSERT_FALSE(otool.dependencies.empty());
+
+  Tools::InstallName test("", false);
+  // not loaded at all is fine
+  test.change(Path("/not/loaded.dylib"), Path("/other.dylib"),
+              Path(bin.string()));
+  // but far more than the header padding fits must fail the edit
+  Path tooLong{"/" + std::string(64 * 1024, 'x') + ".dylib"};
+  EXPECT_EXIT(test.change(otool.dependencies.front(), tooLong,
+                          Path(bin.string())),
+              testing::ExitedWithCode(1), "Could not change lib path");
+  fs::remove(bin);
+}
+
 TEST(Tools_InstallName, add_rpath) {
   testing::internal::CaptureStdout();
   Tools::InstallName test("test", false);
@@ -148,6 +181,48 @@ TEST(Tools_InstallName, CustomDefaults) {
   EXPECT_EQ(tool.verbose(), true);
 }
 
+TEST(Tools_InstallName, batch) {
+  Tools::InstallName::initDefaults("", false);
+  auto tests = fs::path(__FILE__).parent_path();
+  auto bin = tests / "__batch";
+  fs::copy_file(tests / "testbinaries" / "testprog.arm64", bin,
+                fs::copy_options::overwrite_existing);
+  auto contents = [&]() {
+    std::ifstream file{bin, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>(file), {}};
+  };
+  const auto orig = contents();
+
+  Tools::InstallName tool;
+  {
+    Tools::InstallName::Batch batch{bin};
+    tool.change(Path("foolib/libfoo.arm64.dylib"),
+                Path("@rpath/libfoo.dylib"), bin);
+    tool.add_rpath(Path("@loader_path"), bin);
+    // nothing written until the batch ends
+    EXPECT_TRUE(contents() == orig);
+    batch.commit();
+  }
+  auto edited = contents();
+  EXPECT_FALSE(edited == orig);
+  EXPECT_NE(edited.find("@rpath/libfoo.dylib"), std::string::npos);
+  EXPECT_NE(edited.find("@loader_path"), std::string::npos);
+
+  // outside a batch every edit is written at once
+  tool.delete_rpath(Path("@loader_path"), bin);
+  EXPECT_EQ(contents().find("@loader_path"), std::string::npos);
+
+  // a batch ended by an exception writes nothing
+  const auto before = contents();
+  try {
+    Tools::InstallName::Batch batch{bin};
+    tool.add_rpath(Path("@loader_path"), bin);
+    throw std::runtime_error("failed half way");
+  } catch (const std::runtime_error&) {}
+  EXPECT_TRUE(contents() == before);
+  fs::remove(bin);
+}
+
 // -----------------------------------------------------
 
 struct POpenFnMock {
@@ -235,3 +310,884 @@ TEST(Tools_OTool, paths) {
   EXPECT_EQ(tool.dependencies[15].string(), "/usr/lib/libSystem.B.dylib");
 }
 
+
+// -----------------------------------------------------------------
+
+TEST(RPathResolver, resolve) {
+  auto root = fs::temp_directory_path() / "rpathresolvertest";
+  fs::remove_all(root);
+  fs::create_directories(root / "bin");
+  fs::create_directories(root / "lib");
+  fs::create_directories(root / "plugins");
+  std::ofstream(root / "lib" / "libfoo.dylib") << "foo";
+  std::ofstream(root / "plugins" / "libbar.dylib") << "bar";
+  Path exe{(root / "bin" / "app").string()},
+       plugin{(root / "plugins" / "libplugin.dylib").string()};
+  auto lib = fs::canonical(root / "lib" / "libfoo.dylib");
+
+  RPathResolver resolver;
+  resolver.addLoader(exe, {Path("@executable_path/../lib")}, true);
+  resolver.addLoader(plugin, {Path("@loader_path/nothere")}, false);
+  ASSERT_EQ(resolver.rpaths(exe).size(), 1);
+  EXPECT_EQ(resolver.rpaths(exe)[0], Path((root / "lib").string()));
+
+  EXPECT_EQ(resolver.resolve(Path("@rpath/libfoo.dylib"), exe), lib);
+  // falls back on the rpaths of the executable
+  EXPECT_EQ(resolver.resolve(Path("@rpath/libfoo.dylib"), plugin), lib);
+  EXPECT_EQ(resolver.resolve(Path("@loader_path/libbar.dylib"), plugin),
+            fs::canonical(root / "plugins" / "libbar.dylib"));
+  EXPECT_EQ(resolver.resolve(Path("@executable_path/../lib/libfoo.dylib"),
+                             plugin), lib);
+  EXPECT_EQ(resolver.lookups(), 4);
+
+  // remembered per loader, not looked up again
+  EXPECT_EQ(resolver.resolve(Path("@rpath/libfoo.dylib"), exe), lib);
+  EXPECT_EQ(resolver.lookups(), 4);
+
+  EXPECT_TRUE(resolver.resolve(Path("@rpath/libnone.dylib"), exe).empty());
+  resolver.remember(Path("@rpath/libnone.dylib"), exe, Path("/found"));
+  EXPECT_EQ(resolver.resolve(Path("@rpath/libnone.dylib"), exe),
+            Path("/found"));
+
+  EXPECT_EQ(RPathResolver::suffix("@rpath/a/b.dylib"), "a/b.dylib");
+  EXPECT_EQ(RPathResolver::suffix("@loader_path/../b.dylib"), "../b.dylib");
+  EXPECT_EQ(RPathResolver::suffix("/usr/lib/b.dylib"), "/usr/lib/b.dylib");
+  fs::remove_all(root);
+}
+
+// -----------------------------------------------------------------
+
+TEST(PathTable, intern) {
+  PathTable table;
+  auto a = table.intern(std::string_view("/usr/lib/libz.dylib"));
+  auto b = table.intern(Path("/usr/lib/libz.dylib"));
+  auto c = table.intern(std::string_view("/usr/lib/libc.dylib"));
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(table.str(a), "/usr/lib/libz.dylib");
+  EXPECT_EQ(table.size(a), 4);
+  EXPECT_EQ(table.component(a, 0), "/");
+  EXPECT_EQ(table.component(a, 2), "lib");
+  EXPECT_EQ(table.filename(a), "libz.dylib");
+  EXPECT_EQ(table.parent(a), "/usr/lib");
+  EXPECT_TRUE(table.startsWith(a, "/usr/"));
+  EXPECT_FALSE(table.startsWith(a, "/opt/"));
+}
+
+TEST(PathTable, sameAsExtendedPath) {
+  PathTable table;
+  const char* paths[] = {
+    "/Library/Frameworks/Qt.framework/Versions/A/Qt",
+    "lib/Qt.framework/Qt",
+    "Qt.framework",
+    "/opt/local/lib/libfoo.dylib",
+    "@executable_path/../libs/libfoo.dylib",
+    "libs/",
+    ""
+  };
+  const char* names[] = {".framework", "lib", "@executable_path", "none"};
+  for (auto str : paths) {
+    Path path(str);
+    auto id = table.intern(path);
+    for (auto name : names) {
+      SCOPED_TRACE(std::string(str) + " " + name);
+      EXPECT_EQ(Path(std::string(table.before(id, name))), path.before(name));
+      EXPECT_EQ(Path(std::string(table.upto(id, name))), path.upto(name));
+      EXPECT_EQ(Path(std::string(table.from(id, name))), path.from(name));
+      EXPECT_EQ(Path(std::string(table.after(id, name))), path.after(name));
+      EXPECT_EQ(table.contains(id, name), path.before(name) != path);
+    }
+  }
+}
+
+TEST(PathTable, readWhileInterning) {
+  PathTable table;
+  auto first = table.intern(std::string_view("/usr/lib/libz.dylib"));
+  // enough entries to need new chunks while the reader runs
+  std::thread writer([&]() {
+    for (int i = 0; i < 20000; ++i)
+      table.intern("/opt/lib" + std::to_string(i) + "/libfoo.dylib");
+  });
+  for (int i = 0; i < 20000; ++i)
+    ASSERT_EQ(table.filename(first), "libz.dylib");
+  writer.join();
+  auto last = table.intern(std::string_view("/opt/lib19999/libfoo.dylib"));
+  EXPECT_EQ(table.parent(last), "/opt/lib19999");
+  EXPECT_THROW(table.str(last + 1), std::out_of_range);
+}
+
+TEST(PathTable, canonical) {
+  auto dir = fs::temp_directory_path() / "pathtabletest";
+  fs::create_directories(dir / "sub");
+  PathTable table;
+  auto id = table.intern((dir / "sub" / "..").string());
+  auto canonical = table.canonical(id);
+  EXPECT_EQ(table.str(canonical), fs::canonical(dir).string());
+  EXPECT_EQ(table.canonical(id), canonical);
+  EXPECT_EQ(table.canonical(canonical), canonical);
+  auto missing = table.intern(std::string_view("/no/such/path"));
+  EXPECT_EQ(table.canonical(missing), missing);
+  fs::remove_all(dir);
+}
+
+// -----------------------------------------------------------------
+
+TEST(Utils, copyFramework) {
+  auto root = fs::temp_directory_path() / "copyframeworktest";
+  fs::remove_all(root);
+  auto src = root / "Foo.framework";
+  fs::create_directories(src / "Versions" / "A" / "Resources" / "en.lproj");
+  fs::create_directories(src / "Versions" / "A" / "Headers");
+  fs::create_directories(src / "Versions" / "B");
+  std::ofstream(src / "Versions" / "A" / "Foo") << "binary";
+  std::ofstream(src / "Versions" / "A" / "Resources" / "Info.plist") << "x";
+  std::ofstream(src / "Versions" / "A" / "Resources" / "en.lproj" / "a")
+    << "a";
+  std::ofstream(src / "Versions" / "A" / "Headers" / "foo.h") << "h";
+  std::ofstream(src / "Versions" / "B" / "Foo") << "old";
+  fs::create_directory_symlink("A", src / "Versions" / "Current");
+  fs::create_symlink("Versions/Current/Foo", src / "Foo");
+  fs::create_directory_symlink("Versions/Current/Resources",
+                               src / "Resources");
+  fs::create_directory_symlink("Versions/Current/Headers", src / "Headers");
+
+  auto dest = root / "out" / "Foo.framework";
+  copyFramework(Path(src.string()), Path(dest.string()), {"Foo"});
+
+  EXPECT_TRUE(fs::is_regular_file(dest / "Versions" / "A" / "Foo"));
+  EXPECT_TRUE(fs::is_regular_file(
+    dest / "Versions" / "A" / "Resources" / "en.lproj" / "a"));
+  EXPECT_EQ(fs::read_symlink(dest / "Versions" / "Current"), "A");
+  EXPECT_EQ(fs::read_symlink(dest / "Foo"), "Versions/Current/Foo");
+  EXPECT_TRUE(fs::is_symlink(dest / "Resources"));
+  EXPECT_TRUE(fs::is_regular_file(dest / "Resources" / "Info.plist"));
+  // nothing that isn't bundled
+  EXPECT_FALSE(fs::exists(dest / "Versions" / "B"));
+  EXPECT_FALSE(fs::exists(fs::symlink_status(dest / "Headers")));
+  EXPECT_FALSE(fs::exists(dest / "Versions" / "A" / "Headers"));
+
+  // again over the existing copy
+  copyFramework(Path(src.string()), Path(dest.string()), {"Foo"});
+  EXPECT_EQ(fs::read_symlink(dest / "Foo"), "Versions/Current/Foo");
+  fs::remove_all(root);
+}
+
+namespace {
+  /// root/Foo.framework with two binaries, headers and an old version
+  fs::path makeFooFramework(const fs::path& root) {
+    auto src = root / "Foo.framework";
+    auto version = src / "Versions" / "A";
+    fs::create_directories(version / "Libraries");
+    fs::create_directories(version / "Headers");
+    fs::create_directories(version / "Resources");
+    fs::create_directories(src / "Versions" / "B");
+    fs::copy_file("testbinaries/testprog.arm64", version / "Foo");
+    fs::copy_file("testbinaries/testprog.x86-64",
+                  version / "Libraries" / "libFooHelper.dylib");
+    std::ofstream(version / "Headers" / "foo.h") << "h";
+    std::ofstream(version / "Resources" / "Info.plist") << "plist";
+    std::ofstream(src / "Versions" / "B" / "Foo") << "old";
+    fs::create_directory_symlink("A", src / "Versions" / "Current");
+    fs::create_symlink("Versions/Current/Foo", src / "Foo");
+    fs::create_directory_symlink("Versions/Current/Headers", src / "Headers");
+    fs::create_directory_symlink("Versions/Current/Resources",
+                                 src / "Resources");
+    return src;
+  }
+}
+
+TEST(Utils, thinFileKeepsOtherArchs) {
+  auto root = fs::temp_directory_path() / "thinkeeptest";
+  fs::remove_all(root);
+  fs::create_directories(root);
+  auto lib = root / "libfoo.dylib";
+
+  testing::internal::CaptureStderr();
+  thinFile(Path("testbinaries/foolib/libfoo.arm64.dylib"), Path(lib.string()),
+           {"x86_64"});
+  auto err = testing::internal::GetCapturedStderr();
+
+  EXPECT_THAT(err, testing::HasSubstr("keeping it as is"));
+  EXPECT_EQ(fs::file_size(lib),
+            fs::file_size("testbinaries/foolib/libfoo.arm64.dylib"));
+  fs::remove_all(root);
+}
+
+TEST(DylibBundler, fixupCopiesFrameworkOnce) {
+  auto root = fs::temp_directory_path() / "bundlerframeworktest";
+  fs::remove_all(root);
+  auto src = makeFooFramework(root);
+  auto version = src / "Versions" / "A";
+
+  auto dest = root / "Frameworks" / "Foo.framework";
+  auto destVersion = dest / "Versions" / "A";
+  BundlePlan plan;
+  for (auto bin : {"Foo", "Libraries/libFooHelper.dylib"}) {
+    FixupPlan fixup;
+    fixup.src = Path((version / bin).string());
+    fixup.dest = Path((destVersion / bin).string());
+    fixup.copy = true;
+    fixup.framework = true;
+    plan.fixups.push_back(fixup);
+  }
+
+  testing::internal::CaptureStdout();
+  DylibBundler bundler;
+  bundler.executePlan(plan);
+  testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(fs::is_regular_file(destVersion / "Foo"));
+  EXPECT_TRUE(fs::is_regular_file(
+    destVersion / "Libraries" / "libFooHelper.dylib"));
+  EXPECT_EQ(fs::file_size(destVersion / "Foo"),
+            fs::file_size(version / "Foo"));
+  EXPECT_EQ(fs::read_symlink(dest / "Versions" / "Current"), "A");
+  EXPECT_EQ(fs::read_symlink(dest / "Foo"), "Versions/Current/Foo");
+  // only what is bundled was copied
+  EXPECT_FALSE(fs::exists(dest / "Versions" / "B"));
+  EXPECT_FALSE(fs::exists(destVersion / "Headers"));
+  EXPECT_FALSE(fs::exists(fs::symlink_status(dest / "Headers")));
+  fs::remove_all(root);
+}
+
+TEST(DylibBundler, frameworkFromStore) {
+  auto root = fs::temp_directory_path() / "bundlerframeworkstoretest";
+  fs::remove_all(root);
+  auto src = makeFooFramework(root);
+  Settings::setStoreDir((root / "store").string());
+
+  // the second bundle gets the binary from the store, its bundle still
+  // has to be copied around it
+  testing::internal::CaptureStdout();
+  for (auto bundle : {"first", "second"}) {
+    FixupPlan fixup;
+    fixup.src = Path((src / "Versions" / "A" / "Foo").string());
+    fixup.dest = Path((root / bundle / "Foo.framework" / "Versions" / "A"
+                       / "Foo").string());
+    fixup.copy = true;
+    fixup.framework = true;
+    fixup.storeKey = fixup.hashKey({});
+    BundlePlan plan;
+    plan.fixups.push_back(fixup);
+    DylibBundler bundler;
+    bundler.executePlan(plan);
+  }
+  testing::internal::GetCapturedStdout();
+  Settings::setStoreDir("");
+
+  auto dest = root / "second" / "Foo.framework";
+  EXPECT_TRUE(fs::is_regular_file(dest / "Versions" / "A" / "Foo"));
+  EXPECT_TRUE(fs::is_regular_file(
+    dest / "Versions" / "A" / "Resources" / "Info.plist"));
+  EXPECT_EQ(fs::read_symlink(dest / "Versions" / "Current"), "A");
+  EXPECT_EQ(fs::read_symlink(dest / "Foo"), "Versions/Current/Foo");
+  EXPECT_EQ(fs::read_symlink(dest / "Resources"),
+            "Versions/Current/Resources");
+  // the same file as stored for the first bundle
+  EXPECT_TRUE(fs::equivalent(dest / "Versions" / "A" / "Foo",
+    root / "first" / "Foo.framework" / "Versions" / "A" / "Foo"));
+  fs::remove_all(root);
+}
+
+// -----------------------------------------------------------------
+
+TEST(Settings, resolveMap) {
+  auto file = fs::temp_directory_path() / "resolvemaptest.txt";
+  std::ofstream(file)
+    << "# comment\n"
+    << "\n"
+    << "libfoo.dylib  /opt/foo/lib\n"
+    << "@rpath/QtCore.framework/Versions/A/QtCore\t/opt/qt/lib dir \r\n";
+  Settings::setResolveMap(file.string());
+  EXPECT_EQ(Settings::resolveMapFile(), Path(file.string()));
+  EXPECT_EQ(Settings::resolveMapping("libfoo.dylib"), Path("/opt/foo/lib"));
+  EXPECT_EQ(Settings::resolveMapping("foolib/libfoo.dylib"),
+            Path("/opt/foo/lib"));
+  EXPECT_EQ(Settings::resolveMapping(
+              "@rpath/QtCore.framework/Versions/A/QtCore"),
+            Path("/opt/qt/lib dir"));
+  EXPECT_EQ(Settings::resolveMapping("QtCore"), Path("/opt/qt/lib dir"));
+  EXPECT_TRUE(Settings::resolveMapping("libbar.dylib").empty());
+  fs::remove(file);
+}
+
+// -----------------------------------------------------------------
+
+TEST(FixupPlan, hashKey) {
+  auto dir = fs::temp_directory_path() / "hashkeytest";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  auto bin = dir / "prog", edited = dir / "prog.edited";
+  fs::copy_file("testbinaries/testprog.arm64", bin);
+  fs::copy_file("testbinaries/testprog.arm64", edited);
+
+  Tools::OTool otool("", false);
+  ASSERT_TRUE(otool.scanBinary(Path(bin.string())));
+  ASSERT_FALSE(otool.dependencies.empty());
+  auto loaded = otool.dependencies.front();
+
+  FixupPlan plan;
+  plan.src = Path(bin.string());
+  plan.dest = Path("libs/prog");
+  plan.changes.emplace_back(loaded, Path("@executable_path/libs/x"));
+  auto key = plan.hashKey({});
+  EXPECT_EQ(plan.hashKey({}), key);
+
+  // weakened by --prune-unused or not
+  auto pruned = plan;
+  pruned.weaken.push_back(loaded);
+  EXPECT_NE(pruned.hashKey({}), key);
+
+  // thinned, and to what
+  auto thin = plan;
+  thin.thin = true;
+  EXPECT_NE(thin.hashKey({"arm64"}), key);
+  EXPECT_NE(thin.hashKey({"arm64"}), thin.hashKey({"x86_64"}));
+
+  // a framework binary, its bundle is copied around it
+  auto framework = plan;
+  framework.framework = true;
+  EXPECT_NE(framework.hashKey({}), key);
+
+  // same build, so same UUID, but loading from another path
+  Tools::InstallName installName("", false);
+  installName.change(loaded, Path("/elsewhere/libother.dylib"),
+                     Path(edited.string()));
+  auto uuid = contentKey(Path(bin.string()));
+  ASSERT_NE(uuid.find(':'), std::string::npos); // keyed by its LC_UUID
+  uuid = uuid.substr(0, uuid.find(':'));
+  EXPECT_EQ(contentKey(Path(edited.string())).substr(0, uuid.size()), uuid);
+  auto other = plan;
+  other.src = Path(edited.string());
+  EXPECT_NE(other.hashKey({}), key);
+  fs::remove_all(dir);
+}
+
+// -----------------------------------------------------------------
+
+TEST(BundlePlan, roundTrip) {
+  BundlePlan plan;
+  plan.appBundle = Path("Prog.app");
+  plan.dirs = {Path("Prog.app/Contents/libs/")};
+  plan.thinArchs = {"arm64", "x86_64"};
+  FixupPlan fixup;
+  fixup.src = Path("/opt/lib/libfoo.dylib");
+  fixup.dest = Path("Prog.app/Contents/libs/libfoo.dylib");
+  fixup.framework = true;
+  fixup.copy = true;
+  fixup.thin = true;
+  fixup.changes.emplace_back(Path("/opt/lib/libbar.dylib"),
+                             Path("@executable_path/../libs/libbar.dylib"));
+  fixup.rpaths.emplace_back(Path("/opt/lib"), Path("@loader_path/"));
+  fixup.weaken.emplace_back("/opt/lib/libunused.dylib");
+  fixup.storeKey = "abc123";
+  plan.fixups.push_back(fixup);
+  FixupPlan exec;
+  exec.src = exec.dest = Path("Prog.app/Contents/MacOS/prog");
+  exec.executable = true;
+  exec.codesign = true;
+  plan.fixups.push_back(exec);
+
+  auto file = fs::temp_directory_path() / "bundleplantest.json";
+  plan.save(Path(file.string()));
+  auto loaded = BundlePlan::load(Path(file.string()));
+  fs::remove(file);
+
+  EXPECT_EQ(loaded.appBundle, plan.appBundle);
+  EXPECT_EQ(loaded.dirs, plan.dirs);
+  EXPECT_EQ(loaded.thinArchs, plan.thinArchs);
+  ASSERT_EQ(loaded.fixups.size(), 2u);
+  const auto& lib = loaded.fixups[0];
+  EXPECT_EQ(lib.src, fixup.src);
+  EXPECT_EQ(lib.dest, fixup.dest);
+  EXPECT_FALSE(lib.executable);
+  EXPECT_TRUE(lib.framework);
+  EXPECT_TRUE(lib.copy);
+  EXPECT_TRUE(lib.thin);
+  EXPECT_FALSE(lib.codesign);
+  EXPECT_EQ(lib.changes, fixup.changes);
+  EXPECT_EQ(lib.rpaths, fixup.rpaths);
+  EXPECT_EQ(lib.weaken, fixup.weaken);
+  EXPECT_EQ(lib.storeKey, fixup.storeKey);
+  EXPECT_TRUE(loaded.fixups[1].executable);
+  EXPECT_TRUE(loaded.fixups[1].codesign);
+  EXPECT_EQ(loaded.toJson()->serialize().str(),
+            plan.toJson()->serialize().str());
+}
+
+TEST(DylibBundler, makePlanTouchesNothing) {
+  auto root = fs::temp_directory_path() / "bundlerplantest";
+  fs::remove_all(root);
+  fs::create_directories(root);
+  auto prog = root / "prog";
+  fs::copy_file("testbinaries/testprog.arm64", prog);
+  auto libs = root / "libs";
+  auto readAll = [](const fs::path& file) {
+    std::ifstream in{file, std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>(in), {}};
+  };
+  auto before = readAll(prog);
+
+  Settings::addFileToFix(prog.string());
+  Settings::setBundleLibs(true);
+  Settings::setDestFolder(libs.string() + "/");
+  Settings::addSearchPath(Path("testbinaries/foolib"));
+  Settings::addSearchPath(Path("testbinaries/barlib"));
+  testing::internal::CaptureStdout();
+  BundlePlan plan;
+  {
+    DylibBundler bundler;
+    bundler.collectDependencies(Path(prog.string()), true);
+    bundler.collectSubDependencies();
+    plan = bundler.makePlan();
+  }
+  testing::internal::GetCapturedStdout();
+  Settings::setBundleLibs(false);
+  Settings::setDestFolder("./libs/");
+
+  std::vector<std::string> dests;
+  for (const auto& fixup : plan.fixups) {
+    dests.push_back(fixup.dest.filename().string());
+    // nothing is pruned, so nothing is weakened
+    EXPECT_TRUE(fixup.weaken.empty());
+  }
+  EXPECT_THAT(dests, testing::UnorderedElementsAre(
+    "prog", "libfoo.arm64.dylib", "libbar.arm64.dylib"));
+  EXPECT_FALSE(fs::exists(libs));
+  EXPECT_EQ(readAll(prog), before);
+  EXPECT_EQ(std::distance(fs::directory_iterator(root),
+                          fs::directory_iterator()), 1);
+  fs::remove_all(root);
+}
+
+TEST(DylibBundler, executePlanAsItIsNow) {
+  auto root = fs::temp_directory_path() / "bundlerapplytest";
+  fs::remove_all(root);
+  auto libs = root / "libs";
+  fs::create_directories(libs);
+
+  // planned where dest was already there, thinned to the plan's archs
+  BundlePlan plan;
+  plan.dirs.push_back(Path(libs.string()));
+  plan.thinArchs = {"arm64"};
+  FixupPlan fixup;
+  fixup.src = Path("testbinaries/foolib/libfoo.arm64.dylib");
+  fixup.dest = Path((libs / "libfoo.dylib").string());
+  fixup.copy = false;
+  fixup.thin = true;
+  plan.fixups.push_back(fixup);
+
+  testing::internal::CaptureStdout();
+  {
+    DylibBundler bundler;
+    bundler.executePlan(plan);
+  }
+  testing::internal::GetCapturedStdout();
+  EXPECT_TRUE(fs::exists(libs / "libfoo.dylib"));
+  EXPECT_TRUE(Settings::thinArchs().empty());
+  fs::remove_all(root);
+}
+
+// -----------------------------------------------------------------
+
+TEST(ScriptRunner, pipelinedRequests) {
+  int toHost[2], fromHost[2];
+  ASSERT_EQ(pipe(toHost), 0);
+  ASSERT_EQ(pipe(fromHost), 0);
+  bool served = false;
+  std::thread host([&]() {
+    served = serveScriptRequests(toHost[0], fromHost[1]);
+  });
+
+  auto send = [&](const std::string& msg) {
+    uint32_t sz = static_cast<uint32_t>(msg.size());
+    unsigned char len[4] = {
+      static_cast<unsigned char>(sz >> 24), static_cast<unsigned char>(sz >> 16),
+      static_cast<unsigned char>(sz >> 8), static_cast<unsigned char>(sz)
+    };
+    ASSERT_EQ(write(toHost[1], len, 4), 4);
+    ASSERT_EQ(write(toHost[1], msg.data(), msg.size()),
+              static_cast<ssize_t>(msg.size()));
+  };
+  const int tagged = 20;
+  for (int id = 0; id < tagged; ++id) {
+    send("{\"id\":" + std::to_string(id) +
+         (id % 2 ? ",\"binary_encoding\":null}" : ",\"can_code_sign\":null}"));
+  }
+  // untagged, answered after all tagged requests sent before it
+  send("{\"binary_encoding\":null}");
+  close(toHost[1]);
+
+  std::vector<std::string> answers;
+  for (;;) {
+    unsigned char len[4];
+    if (read(fromHost[0], len, 4) != 4) break;
+    size_t sz = (size_t(len[0]) << 24) | (size_t(len[1]) << 16) |
+                (size_t(len[2]) << 8) | size_t(len[3]);
+    std::string msg(sz, '\0');
+    size_t got = 0;
+    for (ssize_t n; got < sz; got += n)
+      if ((n = read(fromHost[0], msg.data() + got, sz - got)) <= 0) break;
+    ASSERT_EQ(got, sz);
+    answers.push_back(msg);
+  }
+  close(fromHost[0]);
+  host.join();
+  EXPECT_TRUE(served);
+
+  ASSERT_EQ(answers.size(), size_t(tagged + 1));
+  std::vector<bool> seen(tagged, false);
+  for (int i = 0; i < tagged; ++i) {
+    auto res = Json::parse(answers[i]);
+    ASSERT_TRUE(res->isObject());
+    auto obj = res->asObject();
+    ASSERT_TRUE(obj->contains("id"));
+    int id = static_cast<int>(obj->get("id")->asNumber()->vlu());
+    ASSERT_TRUE(id >= 0 && id < tagged);
+    EXPECT_FALSE(seen[id]);
+    seen[id] = true;
+    EXPECT_TRUE(obj->contains(id % 2 ? "binary_encoding" : "can_code_sign"));
+  }
+  auto last = Json::parse(answers.back());
+  ASSERT_TRUE(last->isObject());
+  EXPECT_FALSE(last->asObject()->contains("id"));
+  EXPECT_EQ(last->asObject()->get("binary_encoding")->asString()->vlu(),
+            "msgpack");
+}
+
+TEST(ScriptRunner, failedTaggedRequest) {
+  int toHost[2], fromHost[2];
+  ASSERT_EQ(pipe(toHost), 0);
+  ASSERT_EQ(pipe(fromHost), 0);
+  std::thread host([&]() { serveScriptRequests(toHost[0], fromHost[1]); });
+
+  // a command throwing on the pool is answered with its id
+  std::string msg = "{\"id\":7,\"add_search_paths\":[1]}";
+  unsigned char len[4] = {0, 0, 0, static_cast<unsigned char>(msg.size())};
+  ASSERT_EQ(write(toHost[1], len, 4), 4);
+  ASSERT_EQ(write(toHost[1], msg.data(), msg.size()),
+            static_cast<ssize_t>(msg.size()));
+  close(toHost[1]);
+
+  testing::internal::CaptureStderr();
+  std::string answer;
+  if (read(fromHost[0], len, 4) == 4) {
+    answer.resize(len[3]);
+    size_t got = 0;
+    for (ssize_t n; got < answer.size(); got += n)
+      if ((n = read(fromHost[0], answer.data() + got, answer.size() - got)) <= 0)
+        break;
+  }
+  close(fromHost[0]);
+  host.join();
+  testing::internal::GetCapturedStderr();
+
+  auto res = Json::parse(answer);
+  ASSERT_TRUE(res && res->isObject());
+  EXPECT_EQ(res->asObject()->get("id")->asNumber()->vlu(), 7);
+  EXPECT_TRUE(res->asObject()->contains("error"));
+}
+
+namespace {
+  /// an executable shell script in dir that logs its name to dir/log
+  std::unique_ptr<Script> logScript(const fs::path& dir, const char* name,
+                                    const char* header, const char* body) {
+    auto path = dir / name;
+    std::ofstream(path)
+      << "#!/bin/sh\n"
+      << "# dylibbundler: " << header << "\n"
+      << body << "\n"
+      << "echo " << name << " >> \"" << (dir / "log").string() << "\"\n";
+    fs::permissions(path, fs::perms::owner_all);
+    return std::make_unique<Script>(Path(path.string()),
+                                    std::vector<std::string>{});
+  }
+
+  std::string readLog(const fs::path& dir) {
+    std::ifstream in{dir / "log"};
+    return std::string{std::istreambuf_iterator<char>(in), {}};
+  }
+}
+
+TEST(ScriptRunner, superviseOrder) {
+  auto dir = fs::temp_directory_path() / "scriptordertest";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::vector<std::unique_ptr<Script>> scripts;
+  scripts.push_back(logScript(dir, "last.sh", "parallel after=first", ""));
+  scripts.push_back(logScript(dir, "first.sh", "parallel", "sleep 0.2"));
+  // not parallel, runs alone after the ones before it
+  scripts.push_back(logScript(dir, "alone.sh", "", ""));
+
+  testing::internal::CaptureStdout();
+  EXPECT_TRUE(superviseScripts(scripts, 4));
+  testing::internal::GetCapturedStdout();
+  EXPECT_EQ(readLog(dir), "first.sh\nlast.sh\nalone.sh\n");
+  fs::remove_all(dir);
+}
+
+TEST(ScriptRunner, superviseSkipsAfterFailed) {
+  auto dir = fs::temp_directory_path() / "scriptskiptest";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::vector<std::unique_ptr<Script>> scripts;
+  scripts.push_back(logScript(dir, "fails.sh", "parallel", "exit 1"));
+  scripts.push_back(logScript(dir, "needs.sh", "parallel after=fails", ""));
+  scripts.push_back(logScript(dir, "free.sh", "parallel", ""));
+
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(superviseScripts(scripts, 4));
+  testing::internal::GetCapturedStdout();
+  EXPECT_THAT(testing::internal::GetCapturedStderr(),
+              testing::HasSubstr("Skipping script"));
+  EXPECT_EQ(readLog(dir), "free.sh\n");
+  fs::remove_all(dir);
+}
+
+TEST(ScriptRunner, superviseKillsOnTimeout) {
+  auto dir = fs::temp_directory_path() / "scripttimeouttest";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  std::vector<std::unique_ptr<Script>> scripts;
+  scripts.push_back(logScript(dir, "hangs.sh", "timeout=1", "sleep 30"));
+  scripts.push_back(logScript(dir, "next.sh", "", ""));
+
+  auto started = std::chrono::steady_clock::now();
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(superviseScripts(scripts, 4));
+  testing::internal::GetCapturedStdout();
+  EXPECT_THAT(testing::internal::GetCapturedStderr(),
+              testing::HasSubstr("Script timeout, killed script"));
+  EXPECT_LT(std::chrono::steady_clock::now() - started,
+            std::chrono::seconds(10));
+  // killed before it got to log, the next one still runs
+  EXPECT_EQ(readLog(dir), "next.sh\n");
+  fs::remove_all(dir);
+}
+
+// -----------------------------------------------------------------
+
+TEST(DylibBundler, verifyWithoutExecutable) {
+  auto root = fs::temp_directory_path() / "bundlerverifytest";
+  fs::remove_all(root);
+  auto bundle = root / "bundle";
+  fs::create_directories(bundle);
+  fs::create_directories(root / "outside");
+  for (auto plugin : {"a.plugin", "b.plugin", "c.plugin"})
+    fs::copy_file("testbinaries/testprog.arm64", bundle / plugin);
+  fs::copy_file("testbinaries/foolib/libfoo.arm64.dylib",
+                bundle / "libfoo.dylib");
+  fs::copy_file("testbinaries/foolib/libfoo.arm64.dylib",
+                root / "outside" / "libfoo.dylib");
+
+  // plugins only, nothing is an executable
+  auto absolute = fs::weakly_canonical(bundle / "libfoo.dylib").string();
+  std::vector<std::pair<std::string, std::string>> loads {
+    {"a.plugin", absolute},
+    {"b.plugin", "@loader_path/../outside/libfoo.dylib"},
+    {"c.plugin", "@rpath/libmissing.dylib"}
+  };
+  BundlePlan plan;
+  for (const auto& [plugin, loadPath] : loads) {
+    FixupPlan fixup;
+    fixup.src = fixup.dest = Path((bundle / plugin).string());
+    fixup.changes.emplace_back(Path("foolib/libfoo.arm64.dylib"),
+                               Path(loadPath));
+    plan.fixups.push_back(fixup);
+  }
+
+  testing::internal::CaptureStdout();
+  DylibBundler bundler;
+  bundler.executePlan(plan);
+  testing::internal::CaptureStderr();
+  EXPECT_FALSE(bundler.verifyBundle());
+  auto err = testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+  EXPECT_THAT(err, testing::HasSubstr("absolute " + absolute));
+  EXPECT_THAT(err, testing::HasSubstr(
+    "outside of bundle @loader_path/../outside/libfoo.dylib"));
+  EXPECT_THAT(err, testing::HasSubstr("unresolved @rpath/libmissing.dylib"));
+  EXPECT_THAT(err, testing::HasSubstr("3 problems in 3 binaries"));
+
+  fs::remove_all(root);
+}
+
+TEST(DylibBundler, exportGraph) {
+  auto dir = fs::weakly_canonical(fs::temp_directory_path())
+           / "bundlergraphtest";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  auto prog = dir / "prog";
+  fs::copy_file("testbinaries/testprog.arm64", prog);
+  fs::copy_file("testbinaries/foolib/libfoo.arm64.dylib", dir / "libfoo.dylib");
+  fs::copy_file("testbinaries/barlib/libbar.arm64.dylib", dir / "libbar.dylib");
+  fs::copy_file("testbinaries/barlib/libbar.arm64.dylib", dir / "libbaz.dylib");
+
+  // prog loads foo and weakly baz, foo loads bar
+  Tools::InstallName installName("", false);
+  auto lib = [&](const char* name) { return Path((dir / name).string()); };
+  installName.change(Path("foolib/libfoo.arm64.dylib"), lib("libfoo.dylib"),
+                     Path(prog.string()));
+  installName.change(Path("barlib/libbar.arm64.dylib"), lib("libbaz.dylib"),
+                     Path(prog.string()));
+  installName.change(Path("/usr/lib/libSystem.B.dylib"), lib("libbar.dylib"),
+                     lib("libfoo.dylib"));
+
+  auto file = dir / "graph.json";
+  Settings::addFileToFix(prog.string());
+  testing::internal::CaptureStdout();
+  {
+    DylibBundler bundler;
+    bundler.collectDependencies(Path(prog.string()), true);
+    bundler.collectSubDependencies();
+    bundler.exportGraph(Path(file.string()));
+  }
+  testing::internal::GetCapturedStdout();
+
+  std::ifstream in{file};
+  auto root = Json::parse(std::string{std::istreambuf_iterator<char>(in), {}});
+  ASSERT_TRUE(root && root->isObject());
+  std::map<std::string, Json::Object*> nodes;
+  std::map<int, std::string> byId;
+  for (const auto& node : *root->asObject()->get("nodes")->asArray()) {
+    auto obj = node->asObject();
+    auto name = Path(obj->get("path")->asString()->vlu()).filename().string();
+    nodes[name] = obj;
+    byId[static_cast<int>(obj->get("id")->asNumber()->vlu())] = name;
+  }
+  ASSERT_EQ(nodes.size(), 4u);
+  for (auto name : {"prog", "libfoo.dylib", "libbar.dylib", "libbaz.dylib"})
+    ASSERT_EQ(nodes.count(name), 1u) << name;
+
+  std::set<std::string> edges;
+  for (const auto& edge : *root->asObject()->get("edges")->asArray()) {
+    auto obj = edge->asObject();
+    edges.insert(byId[static_cast<int>(obj->get("from")->asNumber()->vlu())]
+      + " " + obj->get("kind")->asString()->vlu() + " "
+      + byId[static_cast<int>(obj->get("to")->asNumber()->vlu())]);
+  }
+  EXPECT_THAT(edges, testing::UnorderedElementsAre(
+    "prog load libfoo.dylib",
+    "prog weak libbaz.dylib",
+    "libfoo.dylib load libbar.dylib"));
+
+  auto num = [&](const char* name, const char* key) {
+    return static_cast<int>(nodes[name]->get(key)->asNumber()->vlu());
+  };
+  EXPECT_EQ(num("prog", "depth"), 0);
+  EXPECT_EQ(num("libfoo.dylib", "depth"), 1);
+  EXPECT_EQ(num("libbaz.dylib", "depth"), 1);
+  EXPECT_EQ(num("libbar.dylib", "depth"), 2);
+
+  auto kiB = [](uint64_t size) { return static_cast<int>((size + 1023) / 1024); };
+  uint64_t total = 0;
+  for (const auto& [name, node] : nodes) {
+    auto size = fs::file_size(dir / name);
+    EXPECT_EQ(num(name.c_str(), "size_kib"), kiB(size)) << name;
+    total += size;
+  }
+  EXPECT_EQ(num("prog", "closure_count"), 4);
+  EXPECT_EQ(num("prog", "closure_size_kib"), kiB(total));
+  EXPECT_EQ(num("libfoo.dylib", "closure_count"), 2);
+  EXPECT_EQ(num("libfoo.dylib", "closure_size_kib"),
+            kiB(fs::file_size(dir / "libfoo.dylib") +
+                fs::file_size(dir / "libbar.dylib")));
+  EXPECT_EQ(num("libbar.dylib", "closure_count"), 1);
+  fs::remove_all(dir);
+}
+
+TEST(DylibBundler, scriptBinariesUnprune) {
+  auto root = fs::temp_directory_path() / "bundlerunprunetest";
+  fs::remove_all(root);
+  fs::create_directories(root);
+  // the executable uses nothing bundled, the plugin a script adds later
+  // imports from libfoo and libbar
+  auto host = root / "host";
+  auto plugin = root / "plugin";
+  fs::copy_file("testbinaries/barlib/libbar.arm64.dylib", host);
+  fs::copy_file("testbinaries/testprog.arm64", plugin);
+
+  Settings::addFileToFix(host.string());
+  Settings::addSearchPath(Path("testbinaries/foolib"));
+  Settings::addSearchPath(Path("testbinaries/barlib"));
+  Settings::setDestFolder((root / "libs").string() + "/");
+  Settings::setPruneUnused(true);
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    DylibBundler bundler;
+    bundler.collectDependencies(Path(host.string()), true);
+    bundler.collectDependencies(Path(plugin.string()), false);
+    bundler.collectSubDependencies();
+    bundler.pruneUnusedDependencies();
+
+    auto planned = [&]() {
+      Settings::setBundleLibs(true);
+      std::set<std::string> dests;
+      for (const auto& fixup : bundler.makePlan().fixups)
+        dests.insert(fixup.dest.filename().string());
+      Settings::setBundleLibs(false);
+      return dests;
+    };
+    EXPECT_EQ(planned().count("libfoo.arm64.dylib"), 0u);
+
+    // bundleLibs is off, only collects and unprunes
+    Json::Array files;
+    files.push(Json::String(plugin.string()));
+    auto res = bundler.fixPathsInBinAndCodesign(&files);
+    EXPECT_TRUE(res->asObject()->contains("result"));
+    EXPECT_EQ(planned().count("libfoo.arm64.dylib"), 1u);
+    EXPECT_EQ(planned().count("libbar.arm64.dylib"), 1u);
+  }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+  Settings::setPruneUnused(false);
+  Settings::setDestFolder("./libs/");
+  fs::remove_all(root);
+}
+
+TEST(DylibBundler, scriptBinariesUnresolved) {
+  auto root = fs::temp_directory_path() / "unresolvedtest";
+  fs::remove_all(root);
+  fs::create_directories(root);
+  auto plugin = root / "plugin";
+  fs::copy_file("testbinaries/testprog.arm64", plugin);
+  {
+    Tools::OTool otool("", false);
+    ASSERT_TRUE(otool.scanBinary(Path(plugin.string())));
+    Tools::InstallName installTool("", false);
+    installTool.change(otool.dependencies.front(),
+                       Path("nowhere/libnowhere.dylib"),
+                       Path(plugin.string()));
+  }
+
+  Settings::addFileToFix(plugin.string());
+  Settings::preventAskUser();
+  Settings::setBundleLibs(true);
+  Settings::setDestFolder((root / "libs").string() + "/");
+  testing::internal::CaptureStdout();
+  testing::internal::CaptureStderr();
+  {
+    DylibBundler bundler;
+    Json::Array files;
+    files.push(Json::String(plugin.string()));
+    auto res = bundler.fixPathsInBinAndCodesign(&files);
+    ASSERT_TRUE(res->asObject()->contains("error"));
+    EXPECT_THAT(res->asObject()->get("error")->asString()->vlu(),
+                testing::HasSubstr("libnowhere.dylib"));
+    EXPECT_FALSE(fs::exists(root / "libs" / "libnowhere.dylib"));
+
+    for (const auto& fixup : bundler.makePlan().fixups) {
+      EXPECT_NE(fixup.dest.filename().string(), "libnowhere.dylib");
+      for (const auto& [from, to] : fixup.changes)
+        EXPECT_NE(from.filename().string(), "libnowhere.dylib");
+    }
+  }
+  testing::internal::GetCapturedStderr();
+  testing::internal::GetCapturedStdout();
+  Settings::setBundleLibs(false);
+  Settings::setDestFolder("./libs/");
+  fs::remove_all(root);
+}
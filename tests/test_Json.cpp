@@ -525,6 +525,27 @@ TEST(ObjectTest, values) {
   EXPECT_EQ(values[1]->asNumber()->vlu(),123);
   EXPECT_EQ(values[2]->asString()->vlu(), "nej");
 };
+TEST(ObjectTest, keysSortedWhenSetOutOfOrder) {
+  Object o1;
+  o1.set("d", Number(4));
+  o1.set("b", Number(2));
+  o1.set("e", Number(5));
+  o1.set("a", Number(1));
+  o1.set("c", Number(3));
+  o1.set("b", Number(22)); // replace, should not add key
+  auto keys = o1.keys();
+  ASSERT_EQ(keys.size(), 5);
+  EXPECT_EQ(keys[0], "a");
+  EXPECT_EQ(keys[1], "b");
+  EXPECT_EQ(keys[2], "c");
+  EXPECT_EQ(keys[3], "d");
+  EXPECT_EQ(keys[4], "e");
+  EXPECT_EQ(o1["b"].asNumber()->vlu(), 22);
+  EXPECT_EQ(o1.get("b")->parent(), &o1);
+  o1.remove("c");
+  EXPECT_EQ(o1.contains("c"), false);
+  EXPECT_EQ(o1.keys()[2], "d");
+};
 
 // -------------------------------------------------------------
 
@@ -640,6 +661,9 @@ TEST(ParseTest, numberNoTrow) {
   EXPECT_NO_THROW(parse("[-300e+10]"));
   EXPECT_NO_THROW(parse("[-3.00E+10]"));
   EXPECT_NO_THROW(parse("[-30.0e-10]"));
+  EXPECT_NO_THROW(parse("[0]"));
+  EXPECT_NO_THROW(parse("{\"a\": 0}"));
+  EXPECT_EQ(parse("[0, -0]")->asArray()->at(0)->asNumber()->vlu(), 0);
 };
 TEST(ParseTest, numberThrow) {
   EXPECT_ANY_THROW(parse("[01]"));
@@ -704,4 +728,52 @@ TEST(ParseTest, utf8StringsThrows) {
   EXPECT_ANY_THROW(parse("[\"\\uC\"]"));
   EXPECT_ANY_THROW(parse("[\"\\uaC\"]"));
 }
+
+// -------------------------------------------------------------
+
+TEST(MsgPackTest, roundTrip) {
+  Object o1{
+    {"n", Null()}, {"t", Bool(true)}, {"f", Bool(false)},
+    {"i", Number(5)}, {"neg", Number(-7)}, {"big", Number(70000)},
+    {"fl", Number(1.5f)}, {"s", String("nej")},
+    {"long", String(std::string(300, 'x'))},
+    {"a", Array{Number(1), String("two"), Object{{"k", Null()}}}}};
+  auto bytes = MsgPack::pack(&o1);
+  EXPECT_TRUE(MsgPack::isMsgPack(bytes));
+  auto vlu = MsgPack::unpack(bytes);
+  ASSERT_TRUE(vlu->isObject());
+  EXPECT_EQ(*vlu->asObject(), o1);
+  EXPECT_EQ(vlu->asObject()->get("a")->parent(), vlu.get());
+}
+TEST(MsgPackTest, knownBytes) {
+  // {"a":[1,-1,300]} as packed by the python msgpack package
+  const char bytes[] = "\x81\xa1" "a" "\x93\x01\xff\xcd\x01\x2c";
+  auto vlu = MsgPack::unpack(std::string_view(bytes, sizeof(bytes) -1));
+  auto arr = vlu->asObject()->get("a")->asArray();
+  ASSERT_EQ(arr->length(), 3);
+  EXPECT_EQ(arr->at(0)->asNumber()->vlu(), 1);
+  EXPECT_EQ(arr->at(1)->asNumber()->vlu(), -1);
+  EXPECT_EQ(arr->at(2)->asNumber()->vlu(), 300);
+  EXPECT_FALSE(MsgPack::isMsgPack("{\"a\":1}"));
+}
+TEST(MsgPackTest, throws) {
+  EXPECT_ANY_THROW(MsgPack::unpack(std::string_view("\x92\x01", 2)));
+  EXPECT_ANY_THROW(MsgPack::unpack(std::string_view("\xc4\x01\x00", 3)));
+  EXPECT_ANY_THROW(MsgPack::unpack(std::string_view("\x01\x01", 2)));
+  EXPECT_ANY_THROW(MsgPack::unpack(std::string_view("\x81\x01\x01", 3)));
+}
+TEST(MsgPackTest, detection) {
+  // UTF-8 text and scalars are not taken for MsgPack
+  EXPECT_FALSE(MsgPack::isMsgPack("\xc3\xa5ngstr\xc3\xb6m"));
+  EXPECT_FALSE(MsgPack::isMsgPack("\xef\xbb\xbf{}"));
+  EXPECT_FALSE(MsgPack::isMsgPack(std::string_view("\xc0", 1)));
+  EXPECT_TRUE(MsgPack::isMsgPack(std::string_view("\x90", 1)));
+  EXPECT_TRUE(MsgPack::isMsgPack(std::string_view("\xde\x00\x00", 3)));
+}
+TEST(MsgPackTest, depthLimit) {
+  std::string nested(MsgPack::maxDepth, '\x91');
+  nested += '\xc0';
+  EXPECT_NO_THROW(MsgPack::unpack(nested));
+  EXPECT_THROW(MsgPack::unpack('\x91' + nested), ParseException);
+}
 } // namespace Json
\ No newline at end of file
@@ -24,6 +24,7 @@ THE SOFTWARE.
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
@@ -67,6 +68,26 @@ TEST_F(MachOTest, readHeader) {
   EXPECT_STREQ(MachO::CpuTypeStr(type), "MH_X86_64");
 }
 
+TEST(MachO, archNames) {
+  EXPECT_EQ(MachO::archName(MachO::MH_X86, 3), "i386");
+  EXPECT_EQ(MachO::archName(MachO::MH_X86_64, 3), "x86_64");
+  EXPECT_EQ(MachO::archName(MachO::MH_ARM64, 0), "arm64");
+  // capability bits don't change the arch
+  EXPECT_EQ(MachO::archName(MachO::MH_ARM64, 0x80000002), "arm64e");
+  EXPECT_EQ(MachO::archName(MachO::MH_ARM64_32, 1), "arm64_32");
+  EXPECT_EQ(MachO::archName(MachO::MH_POWERPC, 0), "ppc");
+
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_X86, 3, "i386"));
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_X86, 3, "x86"));
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_ARM64, 0, "ARM64"));
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_ARM64, 2, "arm64e"));
+  EXPECT_FALSE(MachO::archMatches(MachO::MH_ARM64, 2, "arm64"));
+  EXPECT_FALSE(MachO::archMatches(MachO::MH_ARM64, 0, "arm64e"));
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_ARM64_32, 1, "arm64_32"));
+  EXPECT_TRUE(MachO::archMatches(MachO::MH_POWERPC, 0, "powerpc"));
+  EXPECT_FALSE(MachO::archMatches(MachO::MH_X86_64, 3, "i386"));
+}
+
 TEST_F(MachOTest, readLoadCmds) {
   MachO::mach_object macho(file);
   EXPECT_FALSE(file.bad());
@@ -87,6 +108,101 @@ TEST_F(MachOTest, sections) {
   EXPECT_STREQ(segm.at(2)->segname(), "__LINKEDIT");
 }
 
+TEST_F(MachOTest, filterCmds) {
+  MachO::mach_object macho(file);
+  const std::vector<MachO::LoadCmds> match{
+    MachO::LC_LOAD_DYLIB, MachO::LC_SEGMENT_64, MachO::LC_ID_DYLIB};
+  const auto& all = macho.loadCommands();
+  std::vector<const MachO::load_command_bytes*> scanned;
+  for (const auto& cmd : all)
+    if (std::find(match.begin(), match.end(), cmd.cmd()) != match.end())
+      scanned.push_back(&cmd);
+
+  // same commands as a full scan, in file order
+  auto cmds = macho.filterCmds(match);
+  EXPECT_EQ(cmds.size(), 5);
+  EXPECT_TRUE(std::equal(cmds.begin(), cmds.end(),
+                         scanned.begin(), scanned.end()));
+
+  // edits keep the index current
+  EXPECT_TRUE(macho.filterCmds(MachO::LC_RPATH).empty());
+  EXPECT_TRUE(macho.addRPath(Path("@loader_path")));
+  ASSERT_EQ(macho.filterCmds(MachO::LC_RPATH).size(), 1);
+  EXPECT_EQ(macho.rpaths()[0].string(), "@loader_path");
+  EXPECT_TRUE(macho.removeRPath(Path("@loader_path")));
+  EXPECT_TRUE(macho.filterCmds(MachO::LC_RPATH).empty());
+  EXPECT_EQ(macho.filterCmds(match).size(), 5);
+}
+
+TEST_F(MachOTest, uuid) {
+  MachO::mach_object macho(file);
+  EXPECT_THAT(macho.uuid(), MatchesRegex("[0-9A-F]{32}"));
+
+  std::ifstream other{fs::path(__FILE__).parent_path() /
+    "testbinaries" / "testprog.arm64", std::ios::binary};
+  MachO::mach_object prog(other);
+  EXPECT_EQ(prog.uuid().size(), 32);
+  EXPECT_NE(prog.uuid(), macho.uuid());
+}
+
+TEST_F(MachOTest, symbols) {
+  MachO::mach_object macho{file};
+  auto syms = macho.symbols();
+  ASSERT_FALSE(syms.failure());
+  EXPECT_EQ(syms.size(), 3);
+
+  std::vector<std::string> names;
+  for (const auto& sym : syms)
+    names.emplace_back(sym.name());
+  EXPECT_THAT(names, ::testing::ElementsAre("_foo", "_printf", "_puts"));
+
+  auto foo = syms.find("_foo");
+  ASSERT_TRUE(foo.has_value());
+  EXPECT_TRUE(foo->isExported());
+  EXPECT_FALSE(syms.find("_bar").has_value());
+
+  auto undef = syms.undefined();
+  ASSERT_EQ(undef.size(), 2);
+  EXPECT_EQ(undef[0].name(), "_printf");
+  EXPECT_EQ(undef[1].libraryOrdinal(), 1); // libSystem
+  auto exports = syms.exports();
+  ASSERT_EQ(exports.size(), 1);
+  EXPECT_EQ(exports[0].name(), "_foo");
+}
+
+TEST(MachOLeb128, read) {
+  const char bytes[] = "\xe5\x8e\x26" "\xc0\xbb\x78" "ab\0" "\x80";
+  MachO::leb128_reader rd{bytes, bytes + sizeof(bytes) - 1};
+  EXPECT_EQ(rd.uleb(), 624485u);
+  EXPECT_EQ(rd.sleb(), -123456);
+  EXPECT_EQ(rd.cstr(), "ab");
+  EXPECT_FALSE(rd.failure());
+  EXPECT_EQ(rd.uleb(), 0u); // truncated
+  EXPECT_TRUE(rd.failure());
+}
+
+TEST(MachODyldInfo, chainedFixups) {
+  std::ifstream file{fs::path(__FILE__).parent_path()
+                     / "testbinaries" / "testprog.arm64", std::ios::binary};
+  MachO::mach_object macho{file};
+  MachO::dyld_info info{macho};
+  EXPECT_TRUE(info.hasExportTrie());
+  EXPECT_TRUE(info.hasChainedFixups());
+
+  EXPECT_THAT(info.exportedNames(),
+              ::testing::ElementsAre("__mh_execute_header", "_main"));
+
+  auto imports = info.imports();
+  ASSERT_EQ(imports.size(), 3);
+  EXPECT_EQ(imports[0].name, "_bar");
+  EXPECT_EQ(imports[0].libraryOrdinal, MachO::BIND_SPECIAL_DYLIB_WEAK_LOOKUP);
+  EXPECT_TRUE(imports[0].weak);
+  EXPECT_EQ(imports[1].name, "_foo");
+  EXPECT_EQ(imports[1].libraryOrdinal, 1);
+  EXPECT_EQ(imports[2].name, "_puts");
+  EXPECT_EQ(imports[2].libraryOrdinal, 3);
+}
+
 TEST_F(MachOTest, readToEnd) {
   MachO::mach_object macho{file};
   EXPECT_FALSE(file.bad());
@@ -159,6 +275,145 @@ TEST_F(MachOWrite, write) {
   EXPECT_TRUE(noDiff());
 }
 
+TEST_F(MachOWrite, weakenDylib) {
+  MachO::mach_object obj{infile};
+  auto names = [](const MachO::mach_object& obj) {
+    std::vector<std::string> vec;
+    for (const auto& path : obj.dylibsByOrdinal())
+      vec.push_back(path.string());
+    return vec;
+  };
+  const auto ordinals = names(obj);
+  EXPECT_THAT(ordinals, ::testing::ElementsAre(
+    "foolib/libfoo.arm64.dylib", "barlib/libbar.arm64.dylib",
+    "/usr/lib/libSystem.B.dylib"));
+
+  EXPECT_TRUE(obj.weakenDylib(Path("foolib/libfoo.arm64.dylib")));
+  EXPECT_FALSE(obj.weakenDylib(Path("barlib/libbar.arm64.dylib")));
+  EXPECT_TRUE(obj.write(outfile));
+  outfile.close();
+
+  std::ifstream written{outPath, std::ios::binary};
+  MachO::mach_object weak{written};
+  ASSERT_FALSE(weak.failure());
+  EXPECT_EQ(weak.weakLoadDylib().size(), 2);
+  EXPECT_EQ(names(weak), ordinals);
+}
+
+TEST_F(MachOWrite, streamed) {
+  // in memory edit as reference
+  MachO::mach_object obj{infile};
+  EXPECT_TRUE(obj.changeDylibPaths(Path("foolib/libfoo.arm64.dylib"),
+                                   Path("@rpath/libfoo.dylib")));
+  EXPECT_TRUE(obj.write(outfile));
+  outfile.close();
+  std::ifstream ref{outPath, std::ios::binary};
+  std::string expect{std::istreambuf_iterator<char>(ref), {}};
+  ref.close();
+
+  // only load commands in memory, the rest is copied from inPath
+  MachO::MachOLoader loader{inPath, false};
+  ASSERT_TRUE(loader.isObject());
+  EXPECT_EQ(loader.object()->dataSegments()[1]->bytes(), nullptr);
+  EXPECT_TRUE(loader.object()->changeDylibPaths(
+    Path("foolib/libfoo.arm64.dylib"), Path("@rpath/libfoo.dylib")));
+  EXPECT_FALSE(loader.write(outPath));
+  EXPECT_TRUE(loader.write(outPath, true));
+
+  std::ifstream out{outPath, std::ios::binary};
+  std::string streamed{std::istreambuf_iterator<char>(out), {}};
+  EXPECT_EQ(streamed.size(), fs::file_size(inPath));
+  EXPECT_TRUE(streamed == expect);
+  EXPECT_EQ(fs::status(outPath).permissions(), fs::status(inPath).permissions());
+}
+
+TEST_F(MachOWrite, headerPadding) {
+  MachO::mach_object obj{infile};
+  const size_t padding = obj.headerPadding();
+  ASSERT_GT(padding, 200);
+  ASSERT_LT(padding, 0x4000);
+  auto cmdSize = [](const std::string& path) {
+    return (24 - 8 + path.size()) / 8 * 8 + 8 + 8;
+  };
+
+  // a name that cannot fit reports what is missing and changes nothing
+  const std::string old = "foolib/libfoo.arm64.dylib";
+  const std::string huge = "/" + std::string(padding + 100, 'x');
+  EXPECT_FALSE(obj.changeDylibPaths(Path(old), Path(huge)));
+  EXPECT_EQ(obj.paddingShortfall(), cmdSize(huge) - cmdSize(old) - padding);
+  EXPECT_EQ(obj.headerPadding(), padding);
+  EXPECT_EQ(obj.dylibsByOrdinal()[0].string(), old);
+
+  // compacting loads through the long rpath, that alone fits
+  EXPECT_TRUE(obj.addRPath(Path("@loader_path")));
+  EXPECT_TRUE(obj.addRPath(Path("@loader_path")));
+  const std::string dir = "/" + std::string((padding - 64) * 6 / 10, 'd');
+  EXPECT_TRUE(obj.addRPath(Path(dir)));
+  EXPECT_EQ(obj.rpaths().size(), 3);
+  obj.setCompactLoadCommands(true);
+  EXPECT_TRUE(obj.changeDylibPaths(Path(old), Path(dir + "/libfoo.dylib")));
+  EXPECT_EQ(obj.paddingShortfall(), 0);
+  EXPECT_EQ(obj.rpaths().size(), 3);
+  EXPECT_EQ(obj.dylibsByOrdinal()[0].string(), "@rpath/libfoo.dylib");
+
+  // the repeated rpath frees 32 bytes, it is only dropped if that does it
+  const std::string bar = obj.dylibsByOrdinal()[1].string();
+  auto longer = [&](size_t grow) {
+    return "/" + std::string(cmdSize(bar) + grow - 32 - 1, 'b');
+  };
+  const size_t left = obj.headerPadding();
+  EXPECT_FALSE(obj.changeDylibPaths(Path(bar), Path(longer(left + 40))));
+  EXPECT_EQ(obj.rpaths().size(), 3);
+  EXPECT_EQ(obj.headerPadding(), left);
+  EXPECT_TRUE(obj.changeDylibPaths(Path(bar), Path(longer(left + 8))));
+  EXPECT_EQ(obj.rpaths().size(), 2);
+  EXPECT_TRUE(obj.write(outfile));
+  outfile.close();
+
+  std::ifstream written{outPath, std::ios::binary};
+  MachO::mach_object edited{written};
+  ASSERT_FALSE(edited.failure());
+  EXPECT_EQ(edited.rpaths().size(), 2);
+  EXPECT_EQ(edited.dylibsByOrdinal()[0].string(), "@rpath/libfoo.dylib");
+  EXPECT_EQ(edited.headerPadding(), obj.headerPadding());
+}
+
+TEST_F(MachOWrite, pathRewriter) {
+  MachO::path_rewriter rules;
+  EXPECT_FALSE(rules.addRule("load prefix only-three"));
+  EXPECT_FALSE(rules.addRule("nope prefix a b"));
+  EXPECT_FALSE(rules.addRule("load regex ( b"));
+  EXPECT_TRUE(rules.addRule("# comment"));
+  EXPECT_TRUE(rules.addRule("load prefix foolib/ @rpath/foo/"));
+  EXPECT_TRUE(rules.addRule(
+    "load,id regex (.*)/libbar\\.(\\w+)\\.dylib @rpath/bar/$2.dylib"));
+  EXPECT_TRUE(rules.addRule("all prefix /usr/lib/ /usr/lib/"));
+  ASSERT_EQ(rules.size(), 3);
+
+  EXPECT_EQ(rules.rewrite("foolib/libfoo.dylib", MachO::path_rewriter::Load),
+            "@rpath/foo/libfoo.dylib");
+  EXPECT_FALSE(rules.rewrite("foolib/libfoo.dylib",
+                             MachO::path_rewriter::RPath));
+  EXPECT_EQ(rules.rewrite("x/libbar.arm64.dylib", MachO::path_rewriter::Id),
+            "@rpath/bar/arm64.dylib");
+  EXPECT_FALSE(rules.rewrite("libbar.arm64.dylib",
+                             MachO::path_rewriter::Load));
+
+  MachO::mach_object obj{infile};
+  size_t changed = 0;
+  EXPECT_TRUE(rules.apply(obj, changed));
+  EXPECT_EQ(changed, 2);
+  auto dylibs = obj.dylibsByOrdinal();
+  EXPECT_EQ(dylibs[0].string(), "@rpath/foo/libfoo.arm64.dylib");
+  EXPECT_EQ(dylibs[1].string(), "@rpath/bar/arm64.dylib");
+  EXPECT_EQ(dylibs[2].string(), "/usr/lib/libSystem.B.dylib");
+
+  // applying again is a no-op
+  changed = 0;
+  EXPECT_TRUE(rules.apply(obj, changed));
+  EXPECT_EQ(changed, 0);
+}
+
 // ------------------------------------------------------------
 
 TEST(MachoIOS, readTest) {
@@ -187,6 +442,9 @@ public:
     ASSERT_EQ(file.fail(), false);
   }
 
+  MachO::mach_fat_object fat{fs::path(__FILE__).parent_path()
+                             / "testbinaries" / "testprog.fat"};
+
   void TearDown() override {
     file.close();
   }
@@ -211,6 +469,62 @@ TEST_F(FatMachO, readHeader) {
   EXPECT_TRUE(obj[1].is64bits());
 }
 
+TEST_F(FatMachO, writeIdentical) {
+  auto tests = fs::path(__FILE__).parent_path();
+  auto outPath = tests / "__dump";
+  MachO::MachOLoader loader{tests / "testbinaries" / "testprog.fat", false};
+  ASSERT_TRUE(loader.isFat());
+
+  std::atomic<int> visited{0};
+  loader.forEachObject([&](MachO::mach_object&) { ++visited; });
+  EXPECT_EQ(visited, 2);
+
+  EXPECT_TRUE(loader.write(outPath, true));
+  std::ifstream out{outPath, std::ios::binary};
+  std::string orig{std::istreambuf_iterator<char>(file), {}},
+              copy{std::istreambuf_iterator<char>(out), {}};
+  EXPECT_EQ(orig.size(), copy.size());
+  EXPECT_TRUE(orig == copy);
+  out.close();
+  fs::remove(outPath);
+}
+
+TEST_F(FatMachO, thin) {
+  auto tests = fs::path(__FILE__).parent_path();
+  auto fatPath = tests / "testbinaries" / "testprog.fat";
+  auto outPath = tests / "__dump";
+
+  EXPECT_FALSE(MachO::mach_fat_object::thin(fatPath, outPath, {"ppc"}));
+  EXPECT_FALSE(fs::exists(outPath));
+
+  ASSERT_TRUE(MachO::mach_fat_object::thin(fatPath, outPath, {"arm64"}));
+  {
+    std::ifstream out{outPath, std::ios::binary};
+    MachO::mach_fat_object notFat{out};
+    EXPECT_TRUE(notFat.failure());
+    out.clear();
+    out.seekg(0);
+    MachO::mach_object obj{out};
+    EXPECT_FALSE(obj.failure());
+    EXPECT_STREQ(MachO::CpuTypeStr(obj.header64()->cputype()), "MH_ARM64");
+    EXPECT_EQ(fs::file_size(outPath), fat.architectures()[1].size());
+  }
+  // thin in place, already thin
+  EXPECT_TRUE(MachO::mach_fat_object::thin(outPath, outPath, {"ARM64"}));
+  EXPECT_FALSE(MachO::mach_fat_object::thin(outPath, outPath, {"x86_64"}));
+
+  ASSERT_TRUE(MachO::mach_fat_object::thin(
+    fatPath, outPath, {"x86_64", "arm64"}));
+  {
+    std::ifstream out{outPath, std::ios::binary};
+    MachO::mach_fat_object both{out};
+    ASSERT_FALSE(both.failure());
+    ASSERT_EQ(both.architectures().size(), 2);
+    EXPECT_EQ(both.architectures()[1].size(), fat.architectures()[1].size());
+  }
+  fs::remove(outPath);
+}
+
 // --------------------------------------------------------------
 
 class MachOIntropect : public testing::Test
@@ -241,3 +555,20 @@ TEST_F(MachOIntropect, loadCmds) {
   EXPECT_THAT(insp.loadCmds(),
     testing::ContainsRegex("cmd LC_LOAD_DYLIB"));
 }
+
+TEST_F(MachOIntropect, loadCmdsNDJson) {
+  MachO::introspect_object insp(macho.get());
+  std::stringstream ss;
+  insp.loadCmds(ss, MachO::introspect_writer::NDJson);
+
+  size_t lines = 0;
+  for (std::string line; std::getline(ss, line); ++lines) {
+    ASSERT_FALSE(line.empty());
+    EXPECT_EQ(line.front(), '{');
+    EXPECT_EQ(line.back(), '}');
+  }
+  EXPECT_EQ(lines, macho->loadCommands().size());
+  EXPECT_THAT(ss.str(), testing::HasSubstr(
+    "\"cmd\":\"LC_LOAD_DYLIB\",\"cmdsize\":56,"
+    "\"name\":\"foolib/libfoo.watchos.dylib\""));
+}
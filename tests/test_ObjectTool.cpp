@@ -0,0 +1,187 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2024 Fredrik Johansson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <sys/wait.h>
+#include "Json.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+  /// run object_tool --batch on inputs, returns its exit code
+  /// and parses the report into root
+  int runBatch(const std::string& args, Json::VluType& root) {
+    auto out = fs::temp_directory_path() / "objecttoolreport.json";
+    fs::remove(out);
+    auto cmd = std::string(OBJECT_TOOL_PATH) + " " + args +
+               " -o \"" + out.string() + "\" 2>/dev/null";
+    int status = std::system(cmd.c_str());
+    std::ifstream in{out};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    root = Json::parse(ss.str());
+    fs::remove(out);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+  std::vector<std::string> paths(const Json::Object& root) {
+    std::vector<std::string> res;
+    for (const auto& file : *root.get("files")->asArray())
+      res.push_back(file->asObject()->get("path")->asString()->vlu());
+    return res;
+  }
+
+  /// a dir holding mach-o files, a text file and a corrupt mach-o
+  fs::path makeTree(const char* name) {
+    auto dir = fs::temp_directory_path() / name;
+    fs::remove_all(dir);
+    fs::create_directories(dir / "a");
+    fs::create_directories(dir / "b");
+    fs::copy_file("testbinaries/testprog.fat", dir / "b" / "prog.fat");
+    fs::copy_file("testbinaries/testprog.arm64", dir / "a" / "prog.arm64");
+    std::ofstream(dir / "a" / "readme.txt") << "not a binary\n";
+    // MH_MAGIC_64 followed by a header cut short
+    std::ofstream(dir / "corrupt.dylib", std::ios::binary)
+      << "\xcf\xfa\xed\xfe\x0c\x00";
+    return dir;
+  }
+}
+
+TEST(ObjectTool_Batch, directoryIsSorted) {
+  auto dir = makeTree("objecttooldirtest");
+  Json::VluType root;
+  // the corrupt one is reported, and fails the run
+  EXPECT_EQ(runBatch("-b \"" + dir.string() + "\"", root), 2);
+  ASSERT_TRUE(root && root->isObject());
+  auto obj = root->asObject();
+  EXPECT_THAT(paths(*obj), testing::ElementsAre(
+    (dir / "a" / "prog.arm64").string(),
+    (dir / "b" / "prog.fat").string(),
+    (dir / "corrupt.dylib").string()));
+  EXPECT_EQ(obj->get("count")->asNumber()->vlu(), 3);
+  EXPECT_EQ(obj->get("failed")->asNumber()->vlu(), 1);
+
+  auto corrupt = obj->get("files")->asArray()->at(2)->asObject();
+  EXPECT_EQ(corrupt->get("error")->asString()->vlu(),
+            "failed to parse mach-o file");
+  fs::remove_all(dir);
+}
+
+TEST(ObjectTool_Batch, responseFile) {
+  auto dir = makeTree("objecttoolresponsetest");
+  auto list = dir / "list.txt";
+  std::ofstream(list)
+    << "# comment\n"
+    << (dir / "b" / "prog.fat").string() << "\r\n"
+    << "\n"
+    << (dir / "a" / "readme.txt").string() << "\n";
+  Json::VluType root;
+  EXPECT_EQ(runBatch("-b @\"" + list.string() + "\"", root), 2);
+  ASSERT_TRUE(root && root->isObject());
+  auto obj = root->asObject();
+  EXPECT_THAT(paths(*obj), testing::ElementsAre(
+    (dir / "b" / "prog.fat").string(),
+    (dir / "a" / "readme.txt").string()));
+  // given by name, so it is reported even if it isn't mach-o
+  auto readme = obj->get("files")->asArray()->at(1)->asObject();
+  EXPECT_EQ(readme->get("error")->asString()->vlu(), "not a mach-o file");
+  fs::remove_all(dir);
+}
+
+TEST(ObjectTool_Batch, reportShapeAndArch) {
+  Json::VluType root;
+  EXPECT_EQ(runBatch("-b testbinaries/testprog.fat --arch arm64", root), 0);
+  ASSERT_TRUE(root && root->isObject());
+  auto obj = root->asObject();
+  EXPECT_EQ(obj->get("failed")->asNumber()->vlu(), 0);
+  ASSERT_EQ(obj->get("files")->asArray()->length(), 1u);
+  auto file = obj->get("files")->asArray()->at(0)->asObject();
+  EXPECT_EQ(file->get("path")->asString()->vlu(), "testbinaries/testprog.fat");
+  EXPECT_TRUE(file->get("fat")->asBool()->vlu());
+  auto slices = file->get("slices")->asArray();
+  ASSERT_EQ(slices->length(), 1u);
+  auto slice = slices->at(0)->asObject();
+  EXPECT_EQ(slice->get("arch")->asString()->vlu(), "arm64");
+  EXPECT_EQ(slice->get("filetype")->asString()->vlu(), "MH_EXECUTE");
+  EXPECT_EQ(slice->get("id")->asString()->vlu(), "");
+  EXPECT_FALSE(slice->get("uuid")->asString()->vlu().empty());
+  EXPECT_TRUE(slice->get("signed")->isBool());
+  EXPECT_EQ(slice->get("load")->asArray()->at(0)->asString()->vlu(),
+            "foolib/libfoo.arm64.dylib");
+  EXPECT_EQ(slice->get("weak")->asArray()->at(0)->asString()->vlu(),
+            "barlib/libbar.arm64.dylib");
+  EXPECT_EQ(slice->get("reexport")->asArray()->length(), 0u);
+  EXPECT_EQ(slice->get("rpaths")->asArray()->length(), 0u);
+
+  // without --arch every slice is reported
+  EXPECT_EQ(runBatch("-b testbinaries/testprog.fat", root), 0);
+  file = root->asObject()->get("files")->asArray()->at(0)->asObject();
+  EXPECT_GT(file->get("slices")->asArray()->length(), 1u);
+}
+
+TEST(ObjectTool_Rewrite, onlyWritesAppliedRules) {
+  auto dir = fs::temp_directory_path() / "objecttoolrewrite";
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  auto bin = dir / "prog";
+  auto rulesFile = dir / "rules";
+  auto out = dir / "out.json";
+  fs::copy_file("testbinaries/testprog.arm64", bin);
+  auto rewrite = [&](const std::string& rule) {
+    std::ofstream{rulesFile} << rule << "\n";
+    auto cmd = std::string(OBJECT_TOOL_PATH) + " --rewrite-rules \"" +
+               rulesFile.string() + "\" --json -i \"" + bin.string() +
+               "\" > \"" + out.string() + "\" 2>/dev/null";
+    int status = std::system(cmd.c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  };
+  auto contents = [&]() {
+    std::ifstream in{bin, std::ios::binary};
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  };
+
+  // far more than the header padding holds, nothing is written
+  auto before = contents();
+  EXPECT_EQ(rewrite("load prefix foolib/ /" + std::string(64 * 1024, 'x')), 2);
+  EXPECT_EQ(contents(), before);
+
+  EXPECT_EQ(rewrite("load prefix foolib/ @rpath/"), 0);
+  EXPECT_NE(contents(), before);
+  std::ifstream in{out};
+  std::string line;
+  std::getline(in, line);
+  auto record = Json::parse(line);
+  ASSERT_TRUE(record && record->isObject());
+  EXPECT_EQ(record->asObject()->get("changed")->asNumber()->vlu(), 1);
+  EXPECT_TRUE(record->asObject()->get("resign")->isBool());
+  fs::remove_all(dir);
+}